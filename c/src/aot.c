@@ -0,0 +1,522 @@
+#pragma once
+
+#include "ast.c"
+#include "env.c"
+#include "jit.c"
+#include "mem.c"
+#include "string.c"
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ahead-of-time compilation to C
+//
+// `monkey build` translates a resolved program into C that includes
+// `aot_runtime.c`, and has the system C compiler build it. Every node becomes
+// straight-line code on `Object` temporaries, with gotos in place of the
+// early exits of errors and returns. Expressions that `jit_type` accepts are
+// also computed on plain `int64_t`s, falling back on the boxed code when a
+// name does not hold an integer or a division cannot be done in C.
+
+// top-level statements per C function, to keep each one easy to compile
+#define AOT_CHUNK_SIZE 256
+#define AOT_SCRATCH_RESERVE ((size_t)1 << 30)
+
+#ifndef MONKEY_RUNTIME_DIR
+#define MONKEY_RUNTIME_DIR "src" // where `aot_runtime.c` is, if not set
+#endif
+#ifndef MONKEY_CC
+#define MONKEY_CC "zig cc" // the compiler, unless `CC` is set
+#endif
+
+/** State for emitting one C function. */
+typedef struct AotEmitter {
+  Writer *out;
+  const Ast *ast;
+  uint32_t temps;  // `Object t1` to `t<temps>`
+  uint32_t scopes; // `TempArenaMemory s1` to `s<scopes>`
+  uint32_t labels;
+} AotEmitter;
+
+const char *const aot_operator_names[OPERATOR_COUNT] = {
+    [OPERATOR_PLUS] = "OPERATOR_PLUS",
+    [OPERATOR_MINUS] = "OPERATOR_MINUS",
+    [OPERATOR_ASTERISK] = "OPERATOR_ASTERISK",
+    [OPERATOR_SLASH] = "OPERATOR_SLASH",
+    [OPERATOR_LT] = "OPERATOR_LT",
+    [OPERATOR_GT] = "OPERATOR_GT",
+    [OPERATOR_EQ] = "OPERATOR_EQ",
+    [OPERATOR_NOT_EQ] = "OPERATOR_NOT_EQ",
+    [OPERATOR_BANG] = "OPERATOR_BANG",
+    [OPERATOR_ILLEGAL] = "OPERATOR_ILLEGAL",
+};
+
+void aot_emit_statement(AotEmitter *e, NodeIndex statement, uint32_t dst,
+                        bool unboxed);
+void aot_emit_expression(AotEmitter *e, NodeIndex expression, uint32_t dst,
+                         bool unboxed);
+
+uint32_t aot_temp(AotEmitter *e) { return ++e->temps; }
+
+uint32_t aot_label(AotEmitter *e) { return ++e->labels; }
+
+void aot_emit_unhandled(AotEmitter *e, const Node *node) {
+  String type = node_type_strings[node->type];
+  writer_fmt(e->out, "  aot_unhandled(\"%.*s\");\n", (int)type.length,
+             type.buffer);
+}
+
+// unboxed
+
+/**
+ * Writes `expression`, which `jit_type` accepts, as a C expression on
+ * `int64_t`s to `c`. Names are read from `g<slot>`.
+ */
+void aot_emit_unboxed(const Ast *ast, NodeIndex expression, Writer *c) {
+  const Node *node = ast_node(ast, expression);
+  switch (node->type) {
+  case NODE_INTEGER:
+    writer_fmt(c, "INT64_C(%" PRId64 ")", ast_integer_value(node));
+    break;
+  case NODE_BOOLEAN:
+    writer_write_char(c, node->lhs ? '1' : '0');
+    break;
+  case NODE_IDENTIFIER:
+    writer_fmt(c, "g%" PRIu32, node->rhs);
+    break;
+  case NODE_PREFIX:
+    if (node->operator == OPERATOR_MINUS) {
+      writer_fmt(c, "aot_neg(");
+      aot_emit_unboxed(ast, node->lhs, c);
+      writer_write_char(c, ')');
+    } else if (jit_type(ast, node->lhs) == JIT_BOOLEAN) {
+      writer_fmt(c, "!(");
+      aot_emit_unboxed(ast, node->lhs, c);
+      writer_write_char(c, ')');
+    } else {
+      // false whatever the value; see `object_is_truthy`
+      writer_fmt(c, "aot_then(");
+      aot_emit_unboxed(ast, node->lhs, c);
+      writer_fmt(c, ", 0)");
+    }
+    break;
+  case NODE_INFIX: {
+    static const char *const calls[OPERATOR_COUNT] = {
+        [OPERATOR_PLUS] = "aot_add(",
+        [OPERATOR_MINUS] = "aot_sub(",
+        [OPERATOR_ASTERISK] = "aot_mul(",
+        [OPERATOR_SLASH] = "aot_div(",
+    };
+    static const char *const comparisons[OPERATOR_COUNT] = {
+        [OPERATOR_LT] = " < ",
+        [OPERATOR_GT] = " > ",
+        [OPERATOR_EQ] = " == ",
+        [OPERATOR_NOT_EQ] = " != ",
+    };
+    const char *call = calls[node->operator];
+    writer_fmt(c, "%s", call ? call : "(");
+    aot_emit_unboxed(ast, node->lhs, c);
+    writer_fmt(c, "%s", call ? ", " : comparisons[node->operator]);
+    aot_emit_unboxed(ast, node->rhs, c);
+    writer_fmt(c, "%s",
+               node->operator == OPERATOR_SLASH ? ", &bail)" : ")");
+  } break;
+  case NODE_IF: {
+    bool boolean = jit_type(ast, node->lhs) == JIT_BOOLEAN;
+    writer_fmt(c, boolean ? "(" : "aot_then(");
+    aot_emit_unboxed(ast, node->lhs, c);
+    writer_fmt(c, boolean ? " ? " : ", ");
+    NodeIndex blocks[] = {ast_if_consequence(ast, node),
+                          ast_if_alternative(ast, node)};
+    // an integer condition takes the consequence; see `object_is_truthy`
+    for (size_t i = 0; i < (boolean ? 2 : 1); ++i) {
+      if (i == 1) {
+        writer_fmt(c, " : ");
+      }
+      uint32_t length;
+      const NodeIndex *statements =
+          ast_list(ast, ast_node(ast, blocks[i])->lhs, &length);
+      for (uint32_t j = 0; j < length; ++j) {
+        if (j + 1 < length) {
+          writer_fmt(c, "aot_then(");
+        }
+        aot_emit_unboxed(ast, ast_node(ast, statements[j])->lhs, c);
+        if (j + 1 < length) {
+          writer_fmt(c, ", ");
+        }
+      }
+      for (uint32_t j = 1; j < length; ++j) {
+        writer_write_char(c, ')');
+      }
+    }
+    writer_write_char(c, ')');
+  } break;
+  default:
+    assert(false && "only what jit_type accepts is unboxed");
+  }
+}
+
+// the slots of the names that `expression` reads, each once
+void aot_collect_slots(const Ast *ast, NodeIndex expression, uint32_t *slots,
+                       uint32_t *slots_len) {
+  const Node *node = ast_node(ast, expression);
+  switch (node->type) {
+  case NODE_IDENTIFIER:
+    for (uint32_t i = 0; i < *slots_len; ++i) {
+      if (slots[i] == node->rhs) {
+        return;
+      }
+    }
+    slots[(*slots_len)++] = node->rhs;
+    break;
+  case NODE_PREFIX:
+    aot_collect_slots(ast, node->lhs, slots, slots_len);
+    break;
+  case NODE_INFIX:
+    aot_collect_slots(ast, node->lhs, slots, slots_len);
+    aot_collect_slots(ast, node->rhs, slots, slots_len);
+    break;
+  case NODE_IF: {
+    aot_collect_slots(ast, node->lhs, slots, slots_len);
+    NodeIndex blocks[] = {ast_if_consequence(ast, node),
+                          ast_if_alternative(ast, node)};
+    for (size_t i = 0; i < 2; ++i) {
+      uint32_t length;
+      const NodeIndex *statements =
+          ast_list(ast, ast_node(ast, blocks[i])->lhs, &length);
+      for (uint32_t j = 0; j < length; ++j) {
+        aot_collect_slots(ast, ast_node(ast, statements[j])->lhs, slots,
+                          slots_len);
+      }
+    }
+  } break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Emits code that computes `expression` on `int64_t`s into `t<dst>`, and
+ * falls through to the returned label when it cannot.
+ */
+uint32_t aot_emit_fast_path(AotEmitter *e, NodeIndex expression, uint32_t dst,
+                            uint32_t done) {
+  uint32_t slow = aot_label(e);
+  uint32_t slots[JIT_MAX_NODES];
+  uint32_t slots_len = 0;
+  aot_collect_slots(e->ast, expression, slots, &slots_len);
+
+  writer_fmt(e->out, "  {\n");
+  for (uint32_t i = 0; i < slots_len; ++i) {
+    writer_fmt(e->out,
+               "    int64_t g%" PRIu32 ";\n"
+               "    if (!aot_integer(rt, %" PRIu32 ", &g%" PRIu32 "))\n"
+               "      goto l%" PRIu32 ";\n",
+               slots[i], slots[i], slots[i], slow);
+  }
+  writer_fmt(e->out, "    bool bail = false;\n"
+                     "    int64_t value = ");
+  aot_emit_unboxed(e->ast, expression, e->out);
+  writer_fmt(e->out,
+             ";\n"
+             "    if (bail)\n"
+             "      goto l%" PRIu32 ";\n",
+             slow);
+  if (jit_type(e->ast, expression) == JIT_BOOLEAN) {
+    writer_fmt(e->out, "    boolean_object(&t%" PRIu32 ", value != 0);\n",
+               dst);
+  } else {
+    writer_fmt(e->out,
+               "    integer_object(&t%" PRIu32 ", &rt->arena, value);\n", dst);
+  }
+  writer_fmt(e->out,
+             "    goto l%" PRIu32 ";\n"
+             "  }\n",
+             done);
+  return slow;
+}
+
+// boxed
+
+// makes an error in `t<value>` the result in `t<dst>`, skipping to `done`
+void aot_emit_propagate_error(AotEmitter *e, uint32_t value, uint32_t dst,
+                              uint32_t done) {
+  writer_fmt(e->out,
+             "  if (object_type(&t%" PRIu32 ") == OBJECT_ERROR) {\n"
+             "    t%" PRIu32 " = t%" PRIu32 ";\n"
+             "    goto l%" PRIu32 ";\n"
+             "  }\n",
+             value, dst, value, done);
+}
+
+void aot_emit_block(AotEmitter *e, NodeIndex block, uint32_t dst,
+                    bool unboxed) {
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(e->ast, ast_node(e->ast, block)->lhs, &length);
+  uint32_t scope = ++e->scopes;
+  uint32_t done = aot_label(e);
+  writer_fmt(e->out,
+             "  s%" PRIu32 " = temp_arena_memory_begin(&rt->arena);\n", scope);
+  for (uint32_t i = 0; i < length; ++i) {
+    aot_emit_statement(e, statements[i], dst, unboxed);
+    writer_fmt(e->out,
+               "  eval_end_scope(s%" PRIu32 ", &t%" PRIu32 ");\n"
+               "  if (aot_stops(&t%" PRIu32 "))\n"
+               "    goto l%" PRIu32 ";\n",
+               scope, dst, dst, done);
+  }
+  writer_fmt(e->out, "l%" PRIu32 ":;\n", done);
+}
+
+/**
+ * Emits code that evaluates `expression` into `t<dst>`. If `unboxed`,
+ * subtrees that `jit_type` accepts get a fast path first.
+ */
+void aot_emit_expression(AotEmitter *e, NodeIndex expression, uint32_t dst,
+                         bool unboxed) {
+  const Node *node = ast_node(e->ast, expression);
+  uint32_t done = aot_label(e);
+  if (unboxed &&
+      (node->type == NODE_PREFIX || node->type == NODE_INFIX ||
+       node->type == NODE_IF) &&
+      jit_type(e->ast, expression) != JIT_NONE) {
+    uint32_t slow = aot_emit_fast_path(e, expression, dst, done);
+    writer_fmt(e->out, "l%" PRIu32 ":\n", slow);
+    // everything below is unboxable too, and would fail the same way
+    unboxed = false;
+  }
+
+  switch (node->type) {
+  case NODE_INTEGER:
+    writer_fmt(e->out,
+               "  integer_object(&t%" PRIu32 ", &rt->arena, INT64_C(%" PRId64
+               "));\n",
+               dst, ast_integer_value(node));
+    break;
+  case NODE_BOOLEAN:
+    writer_fmt(e->out, "  boolean_object(&t%" PRIu32 ", %s);\n", dst,
+               node->lhs ? "true" : "false");
+    break;
+  case NODE_IDENTIFIER:
+    if (!node->resolved) {
+      String name = ast_identifier_name(e->ast, node);
+      writer_fmt(e->out, "  aot_not_found(rt, \"%.*s\", &t%" PRIu32 ");\n",
+                 (int)name.length, name.buffer, dst);
+    } else if (node->depth == 0) {
+      writer_fmt(e->out, "  aot_read(rt, %" PRIu32 ", &t%" PRIu32 ");\n",
+                 node->rhs, dst);
+    } else {
+      // only inside functions, which are never compiled
+      aot_emit_unhandled(e, node);
+    }
+    break;
+  case NODE_PREFIX:
+    aot_emit_expression(e, node->lhs, dst, unboxed);
+    writer_fmt(e->out,
+               "  if (object_type(&t%" PRIu32 ") != OBJECT_ERROR)\n"
+               "    aot_%s(rt, &t%" PRIu32 ");\n",
+               dst, node->operator == OPERATOR_MINUS ? "minus" : "bang", dst);
+    break;
+  case NODE_INFIX: {
+    uint32_t left = aot_temp(e);
+    aot_emit_expression(e, node->lhs, left, unboxed);
+    aot_emit_propagate_error(e, left, dst, done);
+    uint32_t right = aot_temp(e);
+    aot_emit_expression(e, node->rhs, right, unboxed);
+    aot_emit_propagate_error(e, right, dst, done);
+    writer_fmt(e->out,
+               "  eval_infix_expression(&rt->arena, &t%" PRIu32
+               ", %s, &t%" PRIu32 ", &t%" PRIu32 ");\n",
+               dst, aot_operator_names[node->operator], left, right);
+  } break;
+  case NODE_IF: {
+    uint32_t condition = aot_temp(e);
+    uint32_t otherwise = aot_label(e);
+    aot_emit_expression(e, node->lhs, condition, unboxed);
+    aot_emit_propagate_error(e, condition, dst, done);
+    writer_fmt(e->out,
+               "  if (!object_is_truthy(&t%" PRIu32 "))\n"
+               "    goto l%" PRIu32 ";\n",
+               condition, otherwise);
+    aot_emit_block(e, ast_if_consequence(e->ast, node), dst, unboxed);
+    writer_fmt(e->out,
+               "  goto l%" PRIu32 ";\n"
+               "l%" PRIu32 ":\n",
+               done, otherwise);
+    NodeIndex alternative = ast_if_alternative(e->ast, node);
+    if (alternative != NODE_NONE) {
+      aot_emit_block(e, alternative, dst, unboxed);
+    } else {
+      writer_fmt(e->out, "  null_object(&t%" PRIu32 ");\n", dst);
+    }
+  } break;
+  default:
+    aot_emit_unhandled(e, node);
+    break;
+  }
+  writer_fmt(e->out, "l%" PRIu32 ":;\n", done);
+}
+
+/** Emits code that runs `statement`, leaving its value in `t<dst>`. */
+void aot_emit_statement(AotEmitter *e, NodeIndex statement, uint32_t dst,
+                        bool unboxed) {
+  const Node *node = ast_node(e->ast, statement);
+  switch (node->type) {
+  case NODE_EXPRESSION_STATEMENT:
+    aot_emit_expression(e, node->lhs, dst, unboxed);
+    break;
+  case NODE_RETURN: {
+    uint32_t value = aot_temp(e);
+    uint32_t done = aot_label(e);
+    aot_emit_expression(e, node->lhs, value, unboxed);
+    aot_emit_propagate_error(e, value, dst, done);
+    writer_fmt(e->out,
+               "  aot_return(rt, &t%" PRIu32 ", &t%" PRIu32 ");\n"
+               "l%" PRIu32 ":;\n",
+               dst, value, done);
+  } break;
+  case NODE_LET: {
+    const Node *name = ast_node(e->ast, node->lhs);
+    assert(name->resolved && "program must be resolved before compiling");
+    aot_emit_expression(e, node->rhs, dst, unboxed);
+    if (name->depth == 0) {
+      writer_fmt(e->out,
+                 "  if (object_type(&t%" PRIu32 ") != OBJECT_ERROR)\n"
+                 "    aot_set(rt, %" PRIu32 ", &t%" PRIu32 ");\n",
+                 dst, name->rhs, dst);
+    } else {
+      aot_emit_unhandled(e, node);
+    }
+  } break;
+  default:
+    aot_emit_unhandled(e, node);
+    break;
+  }
+}
+
+/**
+ * Writes `program`, which must have been resolved against `globals`, to
+ * `out` as a C program that runs it and prints its value. Each function is
+ * written to `scratch` first, which must not be the arena `out` grows in.
+ */
+void aot_emit_program(const Program *program, const Environment *globals,
+                      Arena *scratch, Writer *out) {
+  writer_fmt(out, "// generated by `monkey build`\n"
+                  "#include \"aot_runtime.c\"\n");
+  uint32_t chunks = 0;
+  uint32_t i = 0;
+  do {
+    // the temporaries are only known once the body has been written
+    TempArenaMemory temp = temp_arena_memory_begin(scratch);
+    Writer body = {0};
+    writer_init_arena(&body, scratch);
+    AotEmitter e = {.out = &body, .ast = &program->ast};
+    for (uint32_t end = i + AOT_CHUNK_SIZE;
+         i < program->statements_len && i < end; ++i) {
+      uint32_t value = aot_temp(&e);
+      aot_emit_statement(&e, program->statements[i], value, true);
+      writer_fmt(&body,
+                 "  eval_end_scope(rt->scope, &t%" PRIu32 ");\n"
+                 "  *result = t%" PRIu32 ";\n"
+                 "  if (aot_stops(result))\n"
+                 "    return false;\n",
+                 value, value);
+    }
+
+    writer_fmt(out, "\nstatic bool chunk%" PRIu32
+                    "(AotRuntime *rt, Object *result) {\n",
+               chunks++);
+    for (uint32_t t = 1; t <= e.temps; ++t) {
+      writer_fmt(out, "  Object t%" PRIu32 " = {0};\n", t);
+    }
+    for (uint32_t s = 1; s <= e.scopes; ++s) {
+      writer_fmt(out, "  TempArenaMemory s%" PRIu32 ";\n", s);
+    }
+    String code = writer_string(&body);
+    writer_write_string(out, code);
+    writer_fmt(out, "  return true;\n}\n");
+    temp_arena_memory_end(temp);
+  } while (i < program->statements_len);
+
+  writer_fmt(out, "\nstatic const AotChunk chunks[] = {\n");
+  for (uint32_t c = 0; c < chunks; ++c) {
+    writer_fmt(out, "    chunk%" PRIu32 ",\n", c);
+  }
+  writer_fmt(out, "};\n\nstatic const char *const names[] = {\n");
+  for (size_t g = 0; g < globals->count; ++g) {
+    String name = globals->bindings[g].name->string;
+    writer_fmt(out, "    \"%.*s\",\n", (int)name.length, name.buffer);
+  }
+  writer_fmt(out,
+             "    NULL,\n"
+             "};\n"
+             "\n"
+             "int main(void) {\n"
+             "  return aot_main(chunks, %" PRIu32 ", names, %zu);\n"
+             "}\n",
+             chunks, globals->count);
+}
+
+// `path` in single quotes for the shell
+void aot_write_quoted(Writer *out, const char *path) {
+  writer_write_char(out, '\'');
+  for (; *path; ++path) {
+    if (*path == '\'') {
+      writer_fmt(out, "'\\''");
+    } else {
+      writer_write_char(out, *path);
+    }
+  }
+  writer_write_char(out, '\'');
+}
+
+/**
+ * Compiles `program`, resolved against `globals`, to an executable at
+ * `output` with the C compiler named by `CC` or `MONKEY_CC`. Returns false,
+ * after printing why, if it could not.
+ */
+bool aot_build(const Program *program, const Environment *globals,
+               Arena *arena, const char *output) {
+  const char *cc = getenv("CC");
+  Writer command = {0};
+  writer_init_arena(&command, arena);
+  writer_fmt(&command, "%s -std=c99 -O2 -o ", cc && *cc ? cc : MONKEY_CC);
+  aot_write_quoted(&command, output);
+  writer_fmt(&command, " -I");
+  aot_write_quoted(&command, MONKEY_RUNTIME_DIR);
+  writer_fmt(&command, " -x c -");
+  writer_write_char(&command, '\0');
+
+  Arena scratch = {0};
+  if (!arena_init_virtual(&scratch, AOT_SCRATCH_RESERVE, true)) {
+    perror("failed to reserve memory");
+    return false;
+  }
+  Writer source = {0};
+  writer_init_arena(&source, arena);
+  aot_emit_program(program, globals, &scratch, &source);
+  arena_release(&scratch);
+  String code = writer_string(&source);
+
+  // a compiler that is missing or fails early closes the pipe unread
+  void (*on_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+  FILE *compiler = popen(command.buffer, "w");
+  if (!compiler) {
+    perror("failed to run the C compiler");
+    signal(SIGPIPE, on_pipe);
+    return false;
+  }
+  size_t written = fwrite(code.buffer, 1, code.length, compiler);
+  int status = pclose(compiler);
+  signal(SIGPIPE, on_pipe);
+  if (written != code.length || status != 0) {
+    fprintf(stderr, "ERROR: `%s` failed\n", command.buffer);
+    return false;
+  }
+  return true;
+}
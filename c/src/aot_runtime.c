@@ -0,0 +1,179 @@
+#pragma once
+
+#include "eval.c"
+#include "gc.c"
+#include "mem.c"
+#include "object.c"
+#include "string.c"
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// the runtime of compiled programs
+//
+// C emitted by `aot.c` includes this file and calls into it for everything
+// but its unboxed integer arithmetic. Values, errors and the order of
+// evaluation are those of the closure engine; the handlers of `eval.c` cover
+// whatever is not an integer.
+
+#define AOT_ARENA_RESERVE ((size_t)1 << 30)
+
+/** The state of a running program. */
+typedef struct AotRuntime {
+  Arena arena;          // temporaries
+  TempArenaMemory scope; // released after each top-level statement
+  Gc gc;                // values bound by `let`
+  // global names by slot, as the resolver numbered them
+  Object *globals;
+  bool *bound;
+  const char *const *names;
+  uint32_t globals_len;
+} AotRuntime;
+
+/**
+ * Runs a chunk of top-level statements into `result`. Returns false if one
+ * of them returned or failed, so that the rest must not run.
+ */
+typedef bool (*AotChunk)(AotRuntime *rt, Object *result);
+
+void aot_mark(Gc *gc, void *context) {
+  AotRuntime *rt = context;
+  for (uint32_t i = 0; i < rt->globals_len; ++i) {
+    if (rt->bound[i]) {
+      gc_mark_object(gc, &rt->globals[i]);
+    }
+  }
+}
+
+/** Whether `result` ends the block that produced it. */
+bool aot_stops(const Object *result) {
+  ObjectType type = object_type(result);
+  return type == OBJECT_RETURN || type == OBJECT_ERROR;
+}
+
+// names
+
+void aot_not_found(AotRuntime *rt, const char *name, Object *result) {
+  error_object(result, &rt->arena,
+               string_fmt(&rt->arena, "identifier not found: %s", name));
+}
+
+void aot_read(AotRuntime *rt, uint32_t slot, Object *result) {
+  if (!rt->bound[slot]) {
+    aot_not_found(rt, rt->names[slot], result);
+    return;
+  }
+  object_copy(result, &rt->arena, &rt->globals[slot]);
+}
+
+/** Reads global `slot` into `value` if it holds an integer. */
+bool aot_integer(AotRuntime *rt, uint32_t slot, int64_t *value) {
+  if (!rt->bound[slot] || object_type(&rt->globals[slot]) != OBJECT_INTEGER) {
+    return false;
+  }
+  *value = object_integer(&rt->globals[slot]);
+  return true;
+}
+
+void aot_set(AotRuntime *rt, uint32_t slot, const Object *value) {
+  gc_object_copy(&rt->gc, &rt->globals[slot], value);
+  rt->bound[slot] = true;
+}
+
+// boxed operators, for operands that may not be integers
+
+void aot_minus(AotRuntime *rt, Object *result) {
+  if (object_type(result) == OBJECT_INTEGER) {
+    integer_object(result, &rt->arena,
+                   integer_neg(object_integer(result)));
+    return;
+  }
+  eval_prefix_expression(&rt->arena, result, OPERATOR_MINUS);
+}
+
+void aot_bang(AotRuntime *rt, Object *result) {
+  eval_prefix_expression(&rt->arena, result, OPERATOR_BANG);
+}
+
+void aot_return(AotRuntime *rt, Object *result, const Object *value) {
+  Object *returned = arena_alloc(&rt->arena, sizeof(Object));
+  memcpy(returned, value, sizeof(Object));
+  return_object(result, &rt->arena, returned);
+}
+
+void aot_unhandled(const char *node_type) {
+  fprintf(stderr, "aot: unhandled node type %s\n", node_type);
+}
+
+// unboxed operators; a division that C cannot do sets `*bail` so the boxed
+// code runs instead
+
+int64_t aot_neg(int64_t value) { return integer_neg(value); }
+
+int64_t aot_add(int64_t l, int64_t r) { return integer_add(l, r); }
+
+int64_t aot_sub(int64_t l, int64_t r) { return integer_sub(l, r); }
+
+int64_t aot_mul(int64_t l, int64_t r) { return integer_mul(l, r); }
+
+int64_t aot_div(int64_t l, int64_t r, bool *bail) {
+  if (r == 0 || r == -1) {
+    *bail = true;
+    return 0;
+  }
+  return l / r;
+}
+
+// evaluates `dropped` for its bailing out only
+int64_t aot_then(int64_t dropped, int64_t value) {
+  (void)dropped;
+  return value;
+}
+
+/**
+ * Runs the chunks of a compiled program and prints its value, or its
+ * error, the way `monkey` prints a script's.
+ */
+int aot_main(const AotChunk *chunks, size_t chunks_len,
+             const char *const *names, uint32_t globals_len) {
+  static AotRuntime rt;
+  if (!arena_init_virtual(&rt.arena, AOT_ARENA_RESERVE, true)) {
+    perror("failed to reserve memory");
+    return EXIT_FAILURE;
+  }
+  rt.globals = calloc(globals_len + 1, sizeof(Object));
+  rt.bound = calloc(globals_len + 1, sizeof(bool));
+  if (!rt.globals || !rt.bound) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    return EXIT_FAILURE;
+  }
+  rt.names = names;
+  rt.globals_len = globals_len;
+  gc_init(&rt.gc, GC_DEFAULT_THRESHOLD);
+  gc_add_root(&rt.gc, aot_mark, &rt);
+
+  Object result = {0};
+  jmp_buf out_of_memory;
+  if (setjmp(out_of_memory)) {
+    out_of_memory_object(&result);
+  } else {
+    rt.arena.out_of_memory = &out_of_memory;
+    rt.gc.out_of_memory = &out_of_memory;
+    rt.scope = temp_arena_memory_begin(&rt.arena);
+    for (size_t i = 0; i < chunks_len && chunks[i](&rt, &result); ++i) {
+    }
+    if (object_type(&result) == OBJECT_RETURN) {
+      memcpy(&result, object_return_value(&result), sizeof(Object));
+    }
+  }
+
+  char buffer[4096];
+  Writer out = {0};
+  writer_init_file(&out, stdout, buffer, sizeof(buffer));
+  object_write(&result, &out);
+  writer_write_char(&out, '\n');
+  writer_flush(&out);
+  return object_type(&result) == OBJECT_ERROR ? EXIT_FAILURE : EXIT_SUCCESS;
+}
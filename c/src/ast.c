@@ -3,377 +3,553 @@
 #include "mem.c"
 #include "string.c"
 #include "token.c"
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
-typedef struct Identifier {
-  Token token;
-  String value;
-} Identifier;
-
-// expressions
-
-typedef struct Expression Expression;
-
-typedef enum ExpressionType {
-  EXPRESSION_IDENTIFIER,
-  EXPRESSION_INTEGER,
-  EXPRESSION_PREFIX,
-  EXPRESSION_INFIX,
-  EXPRESSION_BOOLEAN,
-  EXPRESSION_IF,
-  EXPRESSION_FUNCTION,
-  EXPRESSION_CALL,
-} ExpressionType;
-
-const String expression_type_strings[] = {
-    String("IDENTIFIER"), String("INTEGER"), String("PREFIX"),
-    String("INFIX"),      String("BOOLEAN"), String("IF"),
-    String("FUNCTION"),   String("CALL"),
+typedef enum Operator {
+  OPERATOR_PLUS,
+  OPERATOR_MINUS,
+  OPERATOR_ASTERISK,
+  OPERATOR_SLASH,
+  OPERATOR_LT,
+  OPERATOR_GT,
+  OPERATOR_EQ,
+  OPERATOR_NOT_EQ,
+  OPERATOR_BANG,
+  OPERATOR_ILLEGAL,
+} Operator;
+
+#define OPERATOR_COUNT (OPERATOR_ILLEGAL + 1)
+
+const String operator_strings[] = {
+    String("+"), String("-"),  String("*"),  String("/"), String("<"),
+    String(">"), String("=="), String("!="), String("!"), String("ILLEGAL"),
 };
 
-typedef struct IntegerLiteral {
-  Token token;
-  int64_t value;
-} IntegerLiteral;
-
-typedef struct PrefixExpression {
-  Token token;
-  String op;
-  Expression *right;
-} PrefixExpression;
-
-typedef struct InfixExpression {
-  Token token;
-  Expression *left;
-  String op;
-  Expression *right;
-} InfixExpression;
-
-typedef struct Boolean {
-  Token token;
-  bool value;
-} Boolean;
-
-typedef struct StatementChunk StatementChunk;
-
-typedef struct BlockStatement {
-  Token token;
-  StatementChunk *first_chunk;
-  StatementChunk *current_chunk;
-  size_t statements_len;
-} BlockStatement;
-
-BlockStatement *block_statement_create(Arena *arena);
-String block_statement_to_string(BlockStatement *block, Arena *arena);
-
-typedef struct IfExpression {
-  Token token;
-  Expression *condition;
-  BlockStatement *consequence;
-  BlockStatement *alternative;
-} IfExpression;
-
-typedef struct ParameterList {
-  Identifier *items;
-  size_t length;
-  size_t capacity;
-} ParameterList;
-
-typedef struct FunctionLiteral {
-  Token token;
-  ParameterList parameters;
-  BlockStatement *body;
-} FunctionLiteral;
-
-typedef struct ArgumentList {
-  Expression *items;
-  size_t length;
-  size_t capacity;
-} ArgumentList;
-
-typedef struct CallExpression {
-  Token token;
-  Expression *function;
-  ArgumentList arguments;
-} CallExpression;
-
-typedef union ExpressionData {
-  Identifier identifier;
-  IntegerLiteral integer;
-  PrefixExpression prefix;
-  InfixExpression infix;
-  Boolean boolean;
-  IfExpression if_expression;
-  FunctionLiteral function;
-  CallExpression call;
-} ExpressionData;
-
-struct Expression {
-  ExpressionType type;
-  ExpressionData data;
+Operator operator_from_token_type(TokenType type) {
+  switch (type) {
+  case TOKEN_PLUS:
+    return OPERATOR_PLUS;
+  case TOKEN_MINUS:
+    return OPERATOR_MINUS;
+  case TOKEN_ASTERISK:
+    return OPERATOR_ASTERISK;
+  case TOKEN_SLASH:
+    return OPERATOR_SLASH;
+  case TOKEN_LT:
+    return OPERATOR_LT;
+  case TOKEN_GT:
+    return OPERATOR_GT;
+  case TOKEN_EQ:
+    return OPERATOR_EQ;
+  case TOKEN_NOT_EQ:
+    return OPERATOR_NOT_EQ;
+  case TOKEN_BANG:
+    return OPERATOR_BANG;
+  default:
+    return OPERATOR_ILLEGAL;
+  }
+}
+
+// nodes
+
+/**
+ * A node's position in its `Ast`. Index 0 is never a node and stands for a
+ * missing child, e.g. an `if` without `else` or a part that failed to parse.
+ */
+typedef uint32_t NodeIndex;
+
+#define NODE_NONE 0
+
+typedef enum NodeType {
+  NODE_INVALID, // only at `NODE_NONE`
+
+  // expressions
+  NODE_IDENTIFIER,
+  NODE_INTEGER,
+  NODE_PREFIX,
+  NODE_INFIX,
+  NODE_BOOLEAN,
+  NODE_IF,
+  NODE_FUNCTION,
+  NODE_CALL,
+
+  // statements
+  NODE_LET,
+  NODE_RETURN,
+  NODE_EXPRESSION_STATEMENT,
+  NODE_BLOCK,
+} NodeType;
+
+const String node_type_strings[] = {
+    String("INVALID"), String("IDENTIFIER"), String("INTEGER"),
+    String("PREFIX"),  String("INFIX"),      String("BOOLEAN"),
+    String("IF"),      String("FUNCTION"),   String("CALL"),
+    String("LET"),     String("RETURN"),     String("EXPRESSION"),
+    String("BLOCK"),
 };
 
-String expression_to_string(const Expression *expression, Arena *arena) {
-  switch (expression->type) {
-  case EXPRESSION_IDENTIFIER:
-    return expression->data.identifier.value;
-  case EXPRESSION_INTEGER:
-    return string_fmt(arena, "%lld", expression->data.integer.value);
-  case EXPRESSION_PREFIX: {
-    String right_str =
-        expression_to_string(expression->data.prefix.right, arena);
-    return string_fmt(arena, "(%.*s%.*s)", expression->data.prefix.op.length,
-                      expression->data.prefix.op.buffer, right_str.length,
-                      right_str.buffer);
-  }
-  case EXPRESSION_INFIX: {
-    String left_str = expression_to_string(expression->data.infix.left, arena);
-    String right_str =
-        expression_to_string(expression->data.infix.right, arena);
-    return string_fmt(arena, "(%.*s %.*s %.*s)", left_str.length,
-                      left_str.buffer, expression->data.infix.op.length,
-                      expression->data.infix.op.buffer, right_str.length,
-                      right_str.buffer);
-  }
-  case EXPRESSION_BOOLEAN:
-    return expression->data.boolean.token.literal;
-  case EXPRESSION_IF: {
-    IfExpression ie = expression->data.if_expression;
-    StringBuilder sb = string_builder_create(arena);
-
-    String condition_str = expression_to_string(ie.condition, arena);
-    String consequence_str = block_statement_to_string(ie.consequence, arena);
-    string_builder_append(
-        &sb, string_fmt(arena, "if %.*s %.*s", condition_str.length,
-                        condition_str.buffer, consequence_str.length,
-                        consequence_str.buffer));
-
-    if (ie.alternative) {
-      String alternative_str = block_statement_to_string(ie.alternative, arena);
-      string_builder_append(&sb, string_fmt(arena, "else %.*s",
-                                            alternative_str.length,
-                                            alternative_str.buffer));
-    }
+/**
+ * Every node is the same 12 bytes. What doesn't fit in `lhs` and `rhs` is
+ * stored out of line in the tree's `extra` array, where a list is a length
+ * followed by that many node indexes (see `ast_list`).
+ *
+ *   IDENTIFIER            lhs: index into `symbols`; rhs: slot, once resolved
+ *   INTEGER               lhs, rhs: low and high 32 bits of the value
+ *   BOOLEAN               lhs: the value
+ *   PREFIX                lhs: operand
+ *   INFIX                 lhs: left; rhs: right
+ *   IF                    lhs: condition; rhs: index into `extra` of the
+ *                         consequence block, followed by the alternative
+ *   FUNCTION              lhs: body block; rhs: list of parameters
+ *   CALL                  lhs: function; rhs: list of arguments
+ *   LET                   lhs: name identifier; rhs: value
+ *   RETURN                lhs: value
+ *   EXPRESSION_STATEMENT  lhs: expression
+ *   BLOCK                 lhs: list of statements
+ *
+ * An identifier's `depth` and slot are filled in by the resolver: `depth` is
+ * the number of environments to walk outwards and the slot the index of the
+ * binding there.
+ *
+ * Prefix and infix nodes have no use for `depth`, so it holds their
+ * `Quickening` instead, which `eval.c` rewrites as it runs.
+ */
+typedef struct Node {
+  uint8_t type;     // NodeType
+  uint8_t operator; // Operator, for prefix and infix nodes
+  bool resolved;    // identifiers
+  uint8_t depth;    // resolved identifiers; Quickening, for prefix and infix
+  uint32_t lhs;
+  uint32_t rhs;
+} Node;
 
-    return string_builder_build(&sb);
-  }
-  case EXPRESSION_FUNCTION: {
-    FunctionLiteral fn = expression->data.function;
-    StringBuilder sb = string_builder_create(arena);
-    string_builder_append(&sb,
-                          string_fmt(arena, "%.*s(", fn.token.literal.length,
-                                     fn.token.literal.buffer));
-
-    for (size_t i = 0; i < fn.parameters.length; ++i) {
-      string_builder_append(&sb, fn.parameters.items[i].value);
-      if (i < fn.parameters.length - 1) {
-        string_builder_append(&sb, String(", "));
-      }
-    }
+/**
+ * The operand types a prefix or infix node has specialized itself to. A node
+ * starts out unspecialized, takes on the type its operands have the first
+ * time it runs, and falls back to generic for good if they ever differ.
+ */
+typedef enum Quickening {
+  QUICKENING_NONE,    // not run yet
+  QUICKENING_GENERIC, // dispatches on its operands' types every time
+  QUICKENING_INTEGER, // integer operands, e.g. `int + int` or `-int`
+  QUICKENING_BOOLEAN, // boolean operands, e.g. `bool == bool` or `!bool`
+} Quickening;
+
+Quickening ast_node_quickening(const Node *node) {
+  return (Quickening)node->depth;
+}
 
-    String body_str = block_statement_to_string(fn.body, arena);
-    string_builder_append(
-        &sb, string_fmt(arena, ") %.*s", body_str.length, body_str.buffer));
+void ast_node_set_quickening(Node *node, Quickening quickening) {
+  node->depth = (uint8_t)quickening;
+}
 
-    return string_builder_build(&sb);
-  }
-  case EXPRESSION_CALL: {
-    CallExpression call = expression->data.call;
-    StringBuilder sb = string_builder_create(arena);
-
-    String fn_str = expression_to_string(call.function, arena);
-    string_builder_append(
-        &sb, string_fmt(arena, "%.*s(", fn_str.length, fn_str.buffer));
-
-    for (size_t i = 0; i < call.arguments.length; ++i) {
-      String arg_str = expression_to_string(&call.arguments.items[i], arena);
-      string_builder_append(
-          &sb, string_fmt(arena, "%.*s", arg_str.length, arg_str.buffer));
-      if (i < call.arguments.length - 1) {
-        string_builder_append(&sb, String(", "));
-      }
-    }
+/**
+ * A syntax tree stored flat: nodes live in one array and refer to each other
+ * by index. Identifiers refer to `symbols`, which holds the interned names.
+ * Everything is allocated in `arena`.
+ */
+typedef struct Ast {
+  Node *nodes;
+  uint32_t nodes_len;
+  uint32_t nodes_capacity;
+  uint32_t *extra;
+  uint32_t extra_len;
+  uint32_t extra_capacity;
+  const InternedString **symbols;
+  uint32_t symbols_len;
+  uint32_t symbols_capacity;
+  Arena *arena;
+} Ast;
+
+void ast_init(Ast *ast, Arena *arena) {
+  ast->arena = arena;
+  ast->nodes_capacity = 64;
+  ast->nodes = arena_alloc(arena, ast->nodes_capacity * sizeof(Node));
+  ast->nodes_len = 1; // `NODE_NONE`, zeroed
+  ast->extra_capacity = 64;
+  ast->extra = arena_alloc(arena, ast->extra_capacity * sizeof(uint32_t));
+  ast->extra_len = 0;
+  ast->symbols_capacity = 16;
+  ast->symbols = arena_alloc(
+      arena, ast->symbols_capacity * sizeof(const InternedString *));
+  ast->symbols_len = 0;
+}
 
-    string_builder_append(&sb, String(")"));
-    return string_builder_build(&sb);
+// grows one of the tree's arrays so that it can hold `want` items
+void *ast_reserve(Arena *arena, void *items, uint32_t *capacity,
+                  size_t item_size, uint32_t want) {
+  if (want <= *capacity) {
+    return items;
   }
+  uint32_t new_capacity = *capacity * 2;
+  while (new_capacity < want) {
+    new_capacity *= 2;
   }
+  items = arena_resize(arena, items, *capacity * item_size,
+                       new_capacity * item_size);
+  *capacity = new_capacity;
+  return items;
+}
+
+/**
+ * The returned pointer is invalidated by adding nodes to the tree.
+ */
+const Node *ast_node(const Ast *ast, NodeIndex index) {
+  return &ast->nodes[index];
 }
 
-// statements
+/**
+ * `ast_node` for passes that rewrite nodes in place: the resolver, the
+ * optimizer and eval's quickening.
+ */
+Node *ast_node_mut(Ast *ast, NodeIndex index) { return &ast->nodes[index]; }
 
-typedef struct LetStatement {
-  Token token;
-  Identifier *name;
-  Expression *value;
-} LetStatement;
+NodeIndex ast_add_node(Ast *ast, Node node) {
+  ast->nodes = ast_reserve(ast->arena, ast->nodes, &ast->nodes_capacity,
+                           sizeof(Node), ast->nodes_len + 1);
+  ast->nodes[ast->nodes_len] = node;
+  return ast->nodes_len++;
+}
 
-String let_statement_to_string(LetStatement let, Arena *arena) {
-  StringBuilder sb = string_builder_create(arena);
-  string_builder_append(
-      &sb, string_fmt(arena, "%.*s %.*s = ", let.token.literal.length,
-                      let.token.literal.buffer, let.name->value.length,
-                      let.name->value.buffer));
-  if (let.value) {
-    string_builder_append(&sb, expression_to_string(let.value, arena));
-  }
-  string_builder_append(&sb, String(";"));
-  return string_builder_build(&sb);
-}
-
-typedef struct ReturnStatement {
-  Token token;
-  Expression *return_value;
-} ReturnStatement;
-
-String return_statement_to_string(ReturnStatement ret, Arena *arena) {
-  StringBuilder sb = string_builder_create(arena);
-  string_builder_append(&sb,
-                        string_fmt(arena, "%.*s ", ret.token.literal.length,
-                                   ret.token.literal.buffer));
-  if (ret.return_value) {
-    string_builder_append(&sb, expression_to_string(ret.return_value, arena));
+/**
+ * Appends `length` items to `extra` and returns the index of the first.
+ */
+uint32_t ast_add_extra(Ast *ast, const uint32_t *items, uint32_t length) {
+  ast->extra = ast_reserve(ast->arena, ast->extra, &ast->extra_capacity,
+                           sizeof(uint32_t), ast->extra_len + length);
+  uint32_t start = ast->extra_len;
+  if (length > 0) {
+    memcpy(&ast->extra[start], items, length * sizeof(uint32_t));
   }
-  string_builder_append(&sb, String(";"));
-  return string_builder_build(&sb);
+  ast->extra_len += length;
+  return start;
 }
 
-typedef struct ExpressionStatement {
-  Token token;
-  Expression *expression;
-} ExpressionStatement;
+uint32_t ast_add_list(Ast *ast, const NodeIndex *items, uint32_t length) {
+  uint32_t start = ast_add_extra(ast, &length, 1);
+  ast_add_extra(ast, items, length);
+  return start;
+}
 
-String expression_statement_to_string(ExpressionStatement exp, Arena *arena) {
-  if (exp.expression) {
-    return expression_to_string(exp.expression, arena);
-  }
-  return String("");
+/**
+ * Returns the items of the list at `list` in `extra`, and its length in
+ * `*length`. The pointer is invalidated by adding to the tree.
+ */
+const NodeIndex *ast_list(const Ast *ast, uint32_t list, uint32_t *length) {
+  *length = ast->extra[list];
+  return &ast->extra[list + 1];
 }
 
-typedef enum StatementType {
-  STATEMENT_LET,
-  STATEMENT_RETURN,
-  STATEMENT_EXPRESSION,
-} StatementType;
+NodeIndex ast_add_identifier(Ast *ast, const InternedString *symbol) {
+  ast->symbols =
+      ast_reserve(ast->arena, ast->symbols, &ast->symbols_capacity,
+                  sizeof(const InternedString *), ast->symbols_len + 1);
+  ast->symbols[ast->symbols_len] = symbol;
+  return ast_add_node(
+      ast, (Node){.type = NODE_IDENTIFIER, .lhs = ast->symbols_len++});
+}
 
-const String statement_type_strings[] = {
-    String("LET"),
-    String("RETURN"),
-    String("EXPRESSION"),
-};
+/** An integer node, e.g. for rewriting another node in place. */
+Node ast_integer_node(int64_t value) {
+  uint64_t bits = (uint64_t)value;
+  return (Node){.type = NODE_INTEGER,
+                .lhs = (uint32_t)bits,
+                .rhs = (uint32_t)(bits >> 32)};
+}
 
-typedef union StatementData {
-  LetStatement let_statement;
-  ReturnStatement return_statement;
-  ExpressionStatement expression_statement;
-} StatementData;
-
-typedef struct Statement {
-  StatementType type;
-  StatementData data;
-} Statement;
-
-String statement_token_literal(const Statement s) {
-  switch (s.type) {
-  case STATEMENT_LET:
-    return s.data.let_statement.token.literal;
-  case STATEMENT_RETURN:
-    return s.data.return_statement.token.literal;
-  case STATEMENT_EXPRESSION:
-    return s.data.expression_statement.token.literal;
-  }
+NodeIndex ast_add_integer(Ast *ast, int64_t value) {
+  return ast_add_node(ast, ast_integer_node(value));
 }
 
-String statement_to_string(const Statement *s, Arena *arena) {
-  switch (s->type) {
-  case STATEMENT_LET:
-    return let_statement_to_string(s->data.let_statement, arena);
-  case STATEMENT_RETURN:
-    return return_statement_to_string(s->data.return_statement, arena);
-  case STATEMENT_EXPRESSION:
-    return expression_statement_to_string(s->data.expression_statement, arena);
-  }
+NodeIndex ast_add_boolean(Ast *ast, bool value) {
+  return ast_add_node(ast, (Node){.type = NODE_BOOLEAN, .lhs = value});
 }
 
-#define STATEMENT_CHUNK_SIZE 64
-struct StatementChunk {
-  Statement statements[STATEMENT_CHUNK_SIZE];
-  StatementChunk *next;
-  size_t used;
-};
+NodeIndex ast_add_prefix(Ast *ast, Operator op, NodeIndex right) {
+  return ast_add_node(
+      ast, (Node){.type = NODE_PREFIX, .operator = op, .lhs = right});
+}
 
-typedef struct StatementIterator {
-  StatementChunk *chunk;
-  size_t index;
-} StatementIterator;
+NodeIndex ast_add_infix(Ast *ast, Operator op, NodeIndex left,
+                        NodeIndex right) {
+  return ast_add_node(ast, (Node){.type = NODE_INFIX,
+                                  .operator = op,
+                                  .lhs = left,
+                                  .rhs = right});
+}
 
-void statement_iterator_init(StatementIterator *iter, StatementChunk *chunk) {
-  iter->chunk = chunk;
-  iter->index = 0;
+NodeIndex ast_add_if(Ast *ast, NodeIndex condition, NodeIndex consequence,
+                     NodeIndex alternative) {
+  uint32_t arms[] = {consequence, alternative};
+  return ast_add_node(ast, (Node){.type = NODE_IF,
+                                  .lhs = condition,
+                                  .rhs = ast_add_extra(ast, arms, 2)});
 }
 
-Statement *statement_iterator_next(StatementIterator *iter) {
-  if (iter->index >= iter->chunk->used) {
-    iter->chunk = iter->chunk->next;
-    iter->index = 0;
-  }
+NodeIndex ast_add_function(Ast *ast, const NodeIndex *parameters,
+                           uint32_t parameters_len, NodeIndex body) {
+  return ast_add_node(
+      ast, (Node){.type = NODE_FUNCTION,
+                  .lhs = body,
+                  .rhs = ast_add_list(ast, parameters, parameters_len)});
+}
 
-  if (!iter->chunk) {
-    return NULL;
-  }
-  return &iter->chunk->statements[iter->index++];
+NodeIndex ast_add_call(Ast *ast, NodeIndex function,
+                       const NodeIndex *arguments, uint32_t arguments_len) {
+  return ast_add_node(
+      ast, (Node){.type = NODE_CALL,
+                  .lhs = function,
+                  .rhs = ast_add_list(ast, arguments, arguments_len)});
 }
 
-BlockStatement *block_statement_create(Arena *arena) {
-  BlockStatement *block = arena_alloc(arena, sizeof(BlockStatement));
-  StatementChunk *chunk = arena_alloc(arena, sizeof(StatementChunk));
+NodeIndex ast_add_let(Ast *ast, NodeIndex name, NodeIndex value) {
+  return ast_add_node(ast,
+                      (Node){.type = NODE_LET, .lhs = name, .rhs = value});
+}
 
-  chunk->next = NULL;
-  chunk->used = 0;
+NodeIndex ast_add_return(Ast *ast, NodeIndex value) {
+  return ast_add_node(ast, (Node){.type = NODE_RETURN, .lhs = value});
+}
 
-  block->first_chunk = chunk;
-  block->current_chunk = chunk;
-  block->statements_len = 0;
+NodeIndex ast_add_expression_statement(Ast *ast, NodeIndex expression) {
+  return ast_add_node(
+      ast, (Node){.type = NODE_EXPRESSION_STATEMENT, .lhs = expression});
+}
 
-  return block;
+NodeIndex ast_add_block(Ast *ast, const NodeIndex *statements,
+                        uint32_t statements_len) {
+  return ast_add_node(
+      ast, (Node){.type = NODE_BLOCK,
+                  .lhs = ast_add_list(ast, statements, statements_len)});
 }
 
-void block_statement_append_statement(BlockStatement *block, Arena *arena,
-                                      Statement statement) {
-  if (block->current_chunk->used == STATEMENT_CHUNK_SIZE) {
-    StatementChunk *new_chunk = arena_alloc(arena, sizeof(StatementChunk));
-    new_chunk->next = NULL;
-    new_chunk->used = 0;
+// payloads that aren't a plain child index
 
-    block->current_chunk->next = new_chunk;
-    block->current_chunk = new_chunk;
+const InternedString *ast_identifier_symbol(const Ast *ast,
+                                            const Node *node) {
+  return ast->symbols[node->lhs];
+}
+
+String ast_identifier_name(const Ast *ast, const Node *node) {
+  return ast_identifier_symbol(ast, node)->string;
+}
+
+int64_t ast_integer_value(const Node *node) {
+  return (int64_t)(((uint64_t)node->rhs << 32) | node->lhs);
+}
+
+NodeIndex ast_if_consequence(const Ast *ast, const Node *node) {
+  return ast->extra[node->rhs];
+}
+
+NodeIndex ast_if_alternative(const Ast *ast, const Node *node) {
+  return ast->extra[node->rhs + 1];
+}
+
+// joining trees
+
+NodeIndex ast_shift(NodeIndex index, uint32_t shift) {
+  return index == NODE_NONE ? NODE_NONE : index + shift;
+}
+
+void ast_shift_list(Ast *ast, uint32_t list, uint32_t shift) {
+  uint32_t length = ast->extra[list];
+  for (uint32_t i = list + 1; i <= list + length; ++i) {
+    ast->extra[i] = ast_shift(ast->extra[i], shift);
+  }
+}
+
+/**
+ * Copies the nodes and extra data of `src` into `dst`, whose arrays must
+ * already be long enough: node 1 of `src` lands at `nodes_offset`, its
+ * extra data at `extra_offset`, and its identifiers are renumbered to refer
+ * to `symbols_offset` onwards. The symbols themselves are left to the
+ * caller. This is how trees built separately are joined into one.
+ */
+void ast_copy_into(Ast *dst, const Ast *src, uint32_t nodes_offset,
+                   uint32_t extra_offset, uint32_t symbols_offset) {
+  uint32_t shift = nodes_offset - 1;
+  if (src->extra_len > 0) {
+    memcpy(&dst->extra[extra_offset], src->extra,
+           src->extra_len * sizeof(uint32_t));
   }
 
-  block->current_chunk->statements[block->current_chunk->used++] = statement;
-  ++block->statements_len;
+  for (uint32_t i = 1; i < src->nodes_len; ++i) {
+    Node node = src->nodes[i];
+    switch ((NodeType)node.type) {
+    case NODE_INVALID:
+    case NODE_INTEGER:
+    case NODE_BOOLEAN:
+      break;
+    case NODE_IDENTIFIER:
+      node.lhs += symbols_offset;
+      break;
+    case NODE_PREFIX:
+    case NODE_RETURN:
+    case NODE_EXPRESSION_STATEMENT:
+      node.lhs = ast_shift(node.lhs, shift);
+      break;
+    case NODE_INFIX:
+    case NODE_LET:
+      node.lhs = ast_shift(node.lhs, shift);
+      node.rhs = ast_shift(node.rhs, shift);
+      break;
+    case NODE_IF:
+      node.lhs = ast_shift(node.lhs, shift);
+      node.rhs += extra_offset;
+      dst->extra[node.rhs] = ast_shift(dst->extra[node.rhs], shift);
+      dst->extra[node.rhs + 1] = ast_shift(dst->extra[node.rhs + 1], shift);
+      break;
+    case NODE_FUNCTION:
+    case NODE_CALL:
+      node.lhs = ast_shift(node.lhs, shift);
+      node.rhs += extra_offset;
+      ast_shift_list(dst, node.rhs, shift);
+      break;
+    case NODE_BLOCK:
+      node.lhs += extra_offset;
+      ast_shift_list(dst, node.lhs, shift);
+      break;
+    }
+    dst->nodes[i + shift] = node;
+  }
 }
 
-String block_statement_to_string(BlockStatement *block, Arena *arena) {
-  StringBuilder sb = string_builder_create(arena);
-  StatementIterator iter = {0};
-  statement_iterator_init(&iter, block->current_chunk);
+// printing
+
+void ast_write_list(const Ast *ast, uint32_t list, Writer *writer);
+
+void ast_write(const Ast *ast, NodeIndex index, Writer *writer) {
+  const Node *node = ast_node(ast, index);
+  switch ((NodeType)node->type) {
+  case NODE_INVALID:
+    break;
+  case NODE_IDENTIFIER:
+    writer_write_string(writer, ast_identifier_name(ast, node));
+    break;
+  case NODE_INTEGER:
+    writer_write_int64(writer, ast_integer_value(node));
+    break;
+  case NODE_BOOLEAN:
+    writer_write_string(writer, node->lhs ? String("true") : String("false"));
+    break;
+  case NODE_PREFIX:
+    writer_write_char(writer, '(');
+    writer_write_string(writer, operator_strings[node->operator]);
+    ast_write(ast, node->lhs, writer);
+    writer_write_char(writer, ')');
+    break;
+  case NODE_INFIX:
+    writer_write_char(writer, '(');
+    ast_write(ast, node->lhs, writer);
+    writer_write_char(writer, ' ');
+    writer_write_string(writer, operator_strings[node->operator]);
+    writer_write_char(writer, ' ');
+    ast_write(ast, node->rhs, writer);
+    writer_write_char(writer, ')');
+    break;
+  case NODE_IF: {
+    writer_write_string(writer, String("if "));
+    ast_write(ast, node->lhs, writer);
+    writer_write_char(writer, ' ');
+    ast_write(ast, ast_if_consequence(ast, node), writer);
+    NodeIndex alternative = ast_if_alternative(ast, node);
+    if (alternative != NODE_NONE) {
+      writer_write_string(writer, String("else "));
+      ast_write(ast, alternative, writer);
+    }
+  } break;
+  case NODE_FUNCTION:
+    writer_write_string(writer, String("fn("));
+    ast_write_list(ast, node->rhs, writer);
+    writer_write_string(writer, String(") "));
+    ast_write(ast, node->lhs, writer);
+    break;
+  case NODE_CALL:
+    ast_write(ast, node->lhs, writer);
+    writer_write_char(writer, '(');
+    ast_write_list(ast, node->rhs, writer);
+    writer_write_char(writer, ')');
+    break;
+  case NODE_LET:
+    writer_write_string(writer, String("let "));
+    ast_write(ast, node->lhs, writer);
+    writer_write_string(writer, String(" = "));
+    ast_write(ast, node->rhs, writer);
+    writer_write_char(writer, ';');
+    break;
+  case NODE_RETURN:
+    writer_write_string(writer, String("return "));
+    ast_write(ast, node->lhs, writer);
+    writer_write_char(writer, ';');
+    break;
+  case NODE_EXPRESSION_STATEMENT:
+    ast_write(ast, node->lhs, writer);
+    break;
+  case NODE_BLOCK: {
+    uint32_t length;
+    const NodeIndex *statements = ast_list(ast, node->lhs, &length);
+    for (uint32_t i = 0; i < length; ++i) {
+      ast_write(ast, statements[i], writer);
+    }
+  } break;
+  }
+}
 
-  Statement *s = {0};
-  while ((s = statement_iterator_next(&iter))) {
-    string_builder_append(&sb, statement_to_string(s, arena));
+// writes a list of expressions separated by commas
+void ast_write_list(const Ast *ast, uint32_t list, Writer *writer) {
+  uint32_t length;
+  const NodeIndex *items = ast_list(ast, list, &length);
+  for (uint32_t i = 0; i < length; ++i) {
+    ast_write(ast, items[i], writer);
+    if (i < length - 1) {
+      writer_write_string(writer, String(", "));
+    }
   }
+}
 
-  return string_builder_build(&sb);
+String ast_to_string(const Ast *ast, NodeIndex index, Arena *arena) {
+  Writer writer = {0};
+  writer_init_arena(&writer, arena);
+  ast_write(ast, index, &writer);
+  return writer_string(&writer);
 }
 
 // program
 
+/**
+ * Where a top-level statement came from. `start` and `end` bound its tokens
+ * in the source, and `depends` is the end of the text parsing it looked at,
+ * which runs past the token after it unless it ended in a `;`. `errors` is
+ * the number of parse errors it reported, and `statement` is NODE_NONE if
+ * it did not parse.
+ */
+typedef struct SourceSpan {
+  uint32_t start;
+  uint32_t end;
+  uint32_t depends;
+  uint32_t errors;
+  NodeIndex statement;
+} SourceSpan;
+
+/**
+ * The top-level statements of a program, in order, and the tree they are
+ * nodes of. `statements` is one array, grown by doubling, so statements can
+ * be indexed directly. Programs parsed from a whole source also record a
+ * span for every top-level statement, including those that failed to parse,
+ * which lets `parser_reparse` keep the ones an edit does not touch.
+ */
 typedef struct Program {
-  StatementChunk *first_chunk;
-  StatementChunk *current_chunk;
-  size_t statements_len;
+  Ast ast;
+  NodeIndex *statements;
+  uint32_t statements_len;
+  uint32_t statements_capacity;
+  SourceSpan *spans;
+  uint32_t spans_len;
+  uint32_t spans_capacity;
 } Program;
 
 /**
@@ -383,58 +559,48 @@ typedef struct Program {
  */
 Program *program_create(Arena *arena) {
   Program *program = arena_alloc(arena, sizeof(Program));
-  StatementChunk *chunk = arena_alloc(arena, sizeof(StatementChunk));
-
-  chunk->next = NULL;
-  chunk->used = 0;
-
-  program->first_chunk = chunk;
-  program->current_chunk = chunk;
+  ast_init(&program->ast, arena);
+  program->statements_capacity = 16;
+  program->statements = arena_alloc(
+      arena, program->statements_capacity * sizeof(NodeIndex));
   program->statements_len = 0;
-
+  program->spans_capacity = 16;
+  program->spans =
+      arena_alloc(arena, program->spans_capacity * sizeof(SourceSpan));
+  program->spans_len = 0;
   return program;
 }
 
-Statement *program_statement_at(const Program *program, size_t index) {
-  StatementChunk *chunk = program->first_chunk;
-  size_t start = 0, end = 0;
-  while (chunk) {
-    start = end;
-    end += chunk->used;
-    if (end >= index + 1) {
-      break;
-    }
-    chunk = chunk->next;
+NodeIndex program_statement_at(const Program *program, size_t index) {
+  if (index >= program->statements_len) {
+    return NODE_NONE;
   }
-  if (!chunk) {
-    return NULL;
-  }
-  return &chunk->statements[index - start];
+  return program->statements[index];
 }
 
-void program_append_statement(Program *program, Arena *arena,
-                              Statement statement) {
-  if (program->current_chunk->used == STATEMENT_CHUNK_SIZE) {
-    StatementChunk *new_chunk = arena_alloc(arena, sizeof(StatementChunk));
-    new_chunk->next = NULL;
-    new_chunk->used = 0;
+void program_append_statement(Program *program, NodeIndex statement) {
+  program->statements = ast_reserve(
+      program->ast.arena, program->statements, &program->statements_capacity,
+      sizeof(NodeIndex), program->statements_len + 1);
+  program->statements[program->statements_len++] = statement;
+}
 
-    program->current_chunk->next = new_chunk;
-    program->current_chunk = new_chunk;
-  }
+void program_append_span(Program *program, SourceSpan span) {
+  program->spans =
+      ast_reserve(program->ast.arena, program->spans, &program->spans_capacity,
+                  sizeof(SourceSpan), program->spans_len + 1);
+  program->spans[program->spans_len++] = span;
+}
 
-  program->current_chunk->statements[program->current_chunk->used++] =
-      statement;
-  ++program->statements_len;
+void program_write(const Program *program, Writer *writer) {
+  for (uint32_t i = 0; i < program->statements_len; ++i) {
+    ast_write(&program->ast, program->statements[i], writer);
+  }
 }
 
 String program_to_string(const Program *program, Arena *arena) {
-  StringBuilder sb = string_builder_create(arena);
-  StatementIterator iter = {0};
-  statement_iterator_init(&iter, program->first_chunk);
-  Statement *s;
-  while ((s = statement_iterator_next(&iter))) {
-    string_builder_append(&sb, statement_to_string(s, arena));
-  }
-  return string_builder_build(&sb);
+  Writer writer = {0};
+  writer_init_arena(&writer, arena);
+  program_write(program, &writer);
+  return writer_string(&writer);
 }
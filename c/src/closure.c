@@ -0,0 +1,510 @@
+#pragma once
+
+#include "ast.c"
+#include "env.c"
+#include "eval.c"
+#include "gc.c"
+#include "jit.c"
+#include "mem.c"
+#include "object.c"
+#include "string.c"
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// closure compilation
+//
+// A second tree-walking engine. Each node of a resolved program is converted
+// once into a `Closure`: a C function chosen for that node's type, operator
+// and, where it helps, the shape of its operands, together with its compiled
+// children. Running a program is then a chain of direct calls, with no
+// switch on node types and no operator table lookups on the common paths.
+// Values, errors and the order of evaluation are exactly those of `eval.c`,
+// whose handlers the closures fall back on for anything unusual.
+//
+// Given a `Jit`, integer expressions are also compiled to machine code, which
+// runs instead of their closures whenever its names hold integers.
+
+typedef struct Closure Closure;
+
+/** What every closure of one run shares. */
+typedef struct ClosureContext {
+  Arena *arena; // temporaries
+  Gc *gc;       // values bound by `let`
+  Environment *env;
+} ClosureContext;
+
+typedef void (*ClosureFn)(const Closure *closure, ClosureContext *context,
+                          Object *result);
+
+struct Closure {
+  ClosureFn run;
+  uint8_t operator; // Operator, for falling back on `eval.c`
+  const Closure *lhs;
+  const Closure *rhs;
+  union {
+    int64_t integer;          // a literal, or a constant right operand
+    bool boolean;             // a literal
+    const Closure *otherwise; // an `if`'s alternative, or NULL
+    String name;              // an identifier that did not resolve
+    const JitCode *jit;       // machine code for `lhs`
+    uint8_t node_type;        // a node no engine handles
+    // an identifier, or the name a `let` binds
+    struct {
+      uint32_t depth;
+      uint32_t slot;
+    } binding;
+    // statements, in order
+    struct {
+      const Closure **items;
+      uint32_t length;
+    } block;
+  } as;
+};
+
+const Closure *closure_compile_statement(Arena *arena, Jit *jit,
+                                         const Ast *ast, NodeIndex statement);
+const Closure *closure_compile_expression(Arena *arena, Jit *jit,
+                                          const Ast *ast, NodeIndex expression);
+const Closure *closure_compile_block(Arena *arena, Jit *jit, const Ast *ast,
+                                     NodeIndex block);
+
+// runs `closure` into `value`, returning its error from the caller in
+// `result` if it fails
+#define CLOSURE_RUN_OR_RETURN(closure, context, value, result)                 \
+  do {                                                                         \
+    (closure)->run((closure), (context), (value));                             \
+    if (object_type(value) == OBJECT_ERROR) {                                  \
+      memcpy((result), (value), sizeof(Object));                               \
+      return;                                                                  \
+    }                                                                          \
+  } while (0)
+
+// literals and names
+
+void closure_integer(const Closure *closure, ClosureContext *context,
+                     Object *result) {
+  integer_object(result, context->arena, closure->as.integer);
+}
+
+void closure_boolean(const Closure *closure, ClosureContext *context,
+                     Object *result) {
+  (void)context;
+  boolean_object(result, closure->as.boolean);
+}
+
+void closure_read(Environment *env, uint32_t slot, Arena *arena,
+                  Object *result) {
+  Binding *binding = &env->bindings[slot];
+  if (!binding->bound) {
+    // declared by a `let` that has not run, as in `if (false) { let x = 1 }`
+    String name = binding->name->string;
+    error_object(result, arena,
+                 string_fmt(arena, "identifier not found: %.*s", name.length,
+                            name.buffer));
+    return;
+  }
+  // temporaries never point into the GC heap; see `eval_expression`
+  object_copy(result, arena, &binding->value);
+}
+
+void closure_global(const Closure *closure, ClosureContext *context,
+                    Object *result) {
+  closure_read(context->env, closure->as.binding.slot, context->arena,
+               result);
+}
+
+void closure_local(const Closure *closure, ClosureContext *context,
+                   Object *result) {
+  closure_read(environment_ancestor(context->env, closure->as.binding.depth),
+               closure->as.binding.slot, context->arena, result);
+}
+
+void closure_unresolved(const Closure *closure, ClosureContext *context,
+                        Object *result) {
+  String name = closure->as.name;
+  error_object(result, context->arena,
+               string_fmt(context->arena, "identifier not found: %.*s",
+                          name.length, name.buffer));
+}
+
+void closure_unhandled(const Closure *closure, ClosureContext *context,
+                       Object *result) {
+  (void)context;
+  (void)result;
+  String type = node_type_strings[closure->as.node_type];
+  fprintf(stderr, "closure: unhandled node type %.*s\n",
+          (int)type.length, type.buffer);
+}
+
+// operators
+
+void closure_minus(const Closure *closure, ClosureContext *context,
+                   Object *result) {
+  closure->lhs->run(closure->lhs, context, result);
+  if (object_type(result) == OBJECT_ERROR) {
+    return;
+  }
+  if (object_type(result) == OBJECT_INTEGER) {
+    integer_object(result, context->arena,
+                   integer_neg(object_integer(result)));
+    return;
+  }
+  eval_prefix_expression(context->arena, result, OPERATOR_MINUS);
+}
+
+void closure_bang(const Closure *closure, ClosureContext *context,
+                  Object *result) {
+  closure->lhs->run(closure->lhs, context, result);
+  if (object_type(result) == OBJECT_ERROR) {
+    return;
+  }
+  ObjectType type = object_type(result);
+  if (type == OBJECT_BOOLEAN || type == OBJECT_INTEGER) {
+    boolean_object(result, !object_is_truthy(result));
+    return;
+  }
+  eval_prefix_expression(context->arena, result, OPERATOR_BANG);
+}
+
+void closure_infix(const Closure *closure, ClosureContext *context,
+                   Object *result) {
+  Object left = {0};
+  CLOSURE_RUN_OR_RETURN(closure->lhs, context, &left, result);
+  Object right = {0};
+  CLOSURE_RUN_OR_RETURN(closure->rhs, context, &right, result);
+  eval_infix_expression(context->arena, result, closure->operator, &left,
+                        &right);
+}
+
+void closure_make_integer(Object *result, Arena *arena, int64_t value) {
+  integer_object(result, arena, value);
+}
+
+void closure_make_boolean(Object *result, Arena *arena, bool value) {
+  (void)arena;
+  boolean_object(result, value);
+}
+
+/**
+ * Defines `closure_<name>`, for an operator applied to two operands, and
+ * `closure_<name>_constant`, for one whose right operand is an integer
+ * literal. Both compute `expr` directly when the operands are integers and
+ * leave everything else to `eval_infix_expression`.
+ */
+#define CLOSURE_INTEGER_INFIX(name, make, expr)                                \
+  void closure_##name(const Closure *closure, ClosureContext *context,         \
+                      Object *result) {                                        \
+    Object left = {0};                                                         \
+    CLOSURE_RUN_OR_RETURN(closure->lhs, context, &left, result);               \
+    Object right = {0};                                                        \
+    CLOSURE_RUN_OR_RETURN(closure->rhs, context, &right, result);              \
+    if (object_type(&left) == OBJECT_INTEGER &&                                \
+        object_type(&right) == OBJECT_INTEGER) {                               \
+      int64_t l = object_integer(&left);                                       \
+      int64_t r = object_integer(&right);                                      \
+      make(result, context->arena, (expr));                                    \
+      return;                                                                  \
+    }                                                                          \
+    eval_infix_expression(context->arena, result, closure->operator, &left,    \
+                          &right);                                             \
+  }                                                                            \
+                                                                               \
+  void closure_##name##_constant(const Closure *closure,                       \
+                                 ClosureContext *context, Object *result) {    \
+    Object left = {0};                                                         \
+    CLOSURE_RUN_OR_RETURN(closure->lhs, context, &left, result);               \
+    if (object_type(&left) == OBJECT_INTEGER) {                                \
+      int64_t l = object_integer(&left);                                       \
+      int64_t r = closure->as.integer;                                         \
+      make(result, context->arena, (expr));                                    \
+      return;                                                                  \
+    }                                                                          \
+    Object right = {0};                                                        \
+    integer_object(&right, context->arena, closure->as.integer);               \
+    eval_infix_expression(context->arena, result, closure->operator, &left,    \
+                          &right);                                             \
+  }
+
+CLOSURE_INTEGER_INFIX(add, closure_make_integer, integer_add(l, r))
+CLOSURE_INTEGER_INFIX(sub, closure_make_integer, integer_sub(l, r))
+CLOSURE_INTEGER_INFIX(mul, closure_make_integer, integer_mul(l, r))
+CLOSURE_INTEGER_INFIX(div, closure_make_integer, l / r)
+CLOSURE_INTEGER_INFIX(lt, closure_make_boolean, l < r)
+CLOSURE_INTEGER_INFIX(gt, closure_make_boolean, l > r)
+CLOSURE_INTEGER_INFIX(eq, closure_make_boolean, l == r)
+CLOSURE_INTEGER_INFIX(not_eq, closure_make_boolean, l != r)
+
+const ClosureFn closure_infix_fns[OPERATOR_COUNT][2] = {
+    [OPERATOR_PLUS] = {closure_add, closure_add_constant},
+    [OPERATOR_MINUS] = {closure_sub, closure_sub_constant},
+    [OPERATOR_ASTERISK] = {closure_mul, closure_mul_constant},
+    [OPERATOR_SLASH] = {closure_div, closure_div_constant},
+    [OPERATOR_LT] = {closure_lt, closure_lt_constant},
+    [OPERATOR_GT] = {closure_gt, closure_gt_constant},
+    [OPERATOR_EQ] = {closure_eq, closure_eq_constant},
+    [OPERATOR_NOT_EQ] = {closure_not_eq, closure_not_eq_constant},
+};
+
+// control flow and statements
+
+void closure_block(const Closure *closure, ClosureContext *context,
+                   Object *result) {
+  TempArenaMemory temp = temp_arena_memory_begin(context->arena);
+  for (uint32_t i = 0; i < closure->as.block.length; ++i) {
+    const Closure *statement = closure->as.block.items[i];
+    statement->run(statement, context, result);
+    eval_end_scope(temp, result);
+    ObjectType type = object_type(result);
+    if (type == OBJECT_RETURN || type == OBJECT_ERROR) {
+      break;
+    }
+  }
+}
+
+void closure_if(const Closure *closure, ClosureContext *context,
+                Object *result) {
+  Object condition = {0};
+  CLOSURE_RUN_OR_RETURN(closure->lhs, context, &condition, result);
+  if (object_is_truthy(&condition)) {
+    closure->rhs->run(closure->rhs, context, result);
+  } else if (closure->as.otherwise) {
+    closure->as.otherwise->run(closure->as.otherwise, context, result);
+  } else {
+    null_object(result);
+  }
+}
+
+void closure_let(const Closure *closure, ClosureContext *context,
+                 Object *result) {
+  closure->rhs->run(closure->rhs, context, result);
+  if (object_type(result) == OBJECT_ERROR) {
+    return;
+  }
+  environment_set(context->env, context->gc, closure->as.binding.depth,
+                  closure->as.binding.slot, result);
+}
+
+void closure_return(const Closure *closure, ClosureContext *context,
+                    Object *result) {
+  Object *value = arena_alloc(context->arena, sizeof(Object));
+  CLOSURE_RUN_OR_RETURN(closure->lhs, context, value, result);
+  return_object(result, context->arena, value);
+}
+
+// machine code
+
+/**
+ * Runs the code compiled for `lhs` if every name it reads holds an integer,
+ * and `lhs` itself otherwise or if the code bails out.
+ */
+void closure_jit(const Closure *closure, ClosureContext *context,
+                 Object *result) {
+  const JitCode *code = closure->as.jit;
+  int64_t arguments[JIT_MAX_ARGUMENTS];
+  for (uint32_t i = 0; i < code->slots_len; ++i) {
+    const Binding *binding = &context->env->bindings[code->slots[i]];
+    if (!binding->bound || object_type(&binding->value) != OBJECT_INTEGER) {
+      closure->lhs->run(closure->lhs, context, result);
+      return;
+    }
+    arguments[i] = object_integer(&binding->value);
+  }
+  int64_t value;
+  if (code->run(arguments, &value) != 0) {
+    closure->lhs->run(closure->lhs, context, result);
+  } else if (code->boolean) {
+    boolean_object(result, value != 0);
+  } else {
+    integer_object(result, context->arena, value);
+  }
+}
+
+// compiling
+
+Closure *closure_new(Arena *arena, ClosureFn run) {
+  Closure *closure = arena_alloc(arena, sizeof(Closure));
+  closure->run = run;
+  return closure;
+}
+
+/**
+ * Compiles the statements of `program`, which must have been resolved, into
+ * a closure for `closure_run_program`. The closures are allocated in
+ * `arena` and do not refer back to the tree. If `jit` is not NULL, machine
+ * code is added to it as well.
+ */
+const Closure *closure_compile_program(Arena *arena, Jit *jit,
+                                       const Program *program) {
+  if (jit && !jit_begin(jit)) {
+    jit = NULL;
+  }
+  Closure *closure = closure_new(arena, closure_block);
+  const Closure **items =
+      arena_alloc(arena, program->statements_len * sizeof(Closure *));
+  for (uint32_t i = 0; i < program->statements_len; ++i) {
+    items[i] = closure_compile_statement(arena, jit, &program->ast,
+                                         program->statements[i]);
+  }
+  closure->as.block.items = items;
+  closure->as.block.length = program->statements_len;
+  if (jit) {
+    jit_end(jit);
+  }
+  return closure;
+}
+
+const Closure *closure_compile_statement(Arena *arena, Jit *jit,
+                                         const Ast *ast, NodeIndex statement) {
+  const Node *node = ast_node(ast, statement);
+  switch (node->type) {
+  case NODE_EXPRESSION_STATEMENT:
+    return closure_compile_expression(arena, jit, ast, node->lhs);
+  case NODE_RETURN: {
+    Closure *closure = closure_new(arena, closure_return);
+    closure->lhs = closure_compile_expression(arena, jit, ast, node->lhs);
+    return closure;
+  }
+  case NODE_LET: {
+    const Node *name = ast_node(ast, node->lhs);
+    assert(name->resolved && "program must be resolved before compiling");
+    Closure *closure = closure_new(arena, closure_let);
+    closure->rhs = closure_compile_expression(arena, jit, ast, node->rhs);
+    closure->as.binding.depth = name->depth;
+    closure->as.binding.slot = name->rhs;
+    return closure;
+  }
+  default: {
+    Closure *closure = closure_new(arena, closure_unhandled);
+    closure->as.node_type = node->type;
+    return closure;
+  }
+  }
+}
+
+const Closure *closure_compile_expression(Arena *arena, Jit *jit,
+                                          const Ast *ast,
+                                          NodeIndex expression) {
+  const Node *node = ast_node(ast, expression);
+  Closure *closure = NULL;
+  if (jit && (node->type == NODE_PREFIX || node->type == NODE_INFIX ||
+              node->type == NODE_IF)) {
+    JitCode *code = arena_alloc(arena, sizeof(JitCode));
+    if (jit_compile(jit, arena, ast, expression, code)) {
+      closure = closure_new(arena, closure_jit);
+      closure->lhs = closure_compile_expression(arena, NULL, ast, expression);
+      closure->as.jit = code;
+      return closure;
+    }
+  }
+  switch (node->type) {
+  case NODE_INTEGER:
+    closure = closure_new(arena, closure_integer);
+    closure->as.integer = ast_integer_value(node);
+    break;
+  case NODE_BOOLEAN:
+    closure = closure_new(arena, closure_boolean);
+    closure->as.boolean = node->lhs;
+    break;
+  case NODE_IDENTIFIER:
+    if (!node->resolved) {
+      closure = closure_new(arena, closure_unresolved);
+      closure->as.name = ast_identifier_name(ast, node);
+      break;
+    }
+    closure =
+        closure_new(arena, node->depth == 0 ? closure_global : closure_local);
+    closure->as.binding.depth = node->depth;
+    closure->as.binding.slot = node->rhs;
+    break;
+  case NODE_PREFIX:
+    closure = closure_new(
+        arena, node->operator == OPERATOR_MINUS ? closure_minus : closure_bang);
+    closure->lhs = closure_compile_expression(arena, jit, ast, node->lhs);
+    break;
+  case NODE_INFIX: {
+    const Node *right = ast_node(ast, node->rhs);
+    bool constant = right->type == NODE_INTEGER;
+    ClosureFn run = closure_infix_fns[node->operator][constant];
+    closure = closure_new(arena, run ? run : closure_infix);
+    closure->operator = node->operator;
+    closure->lhs = closure_compile_expression(arena, jit, ast, node->lhs);
+    if (run && constant) {
+      closure->as.integer = ast_integer_value(right);
+    } else {
+      closure->rhs = closure_compile_expression(arena, jit, ast, node->rhs);
+    }
+  } break;
+  case NODE_IF: {
+    NodeIndex alternative = ast_if_alternative(ast, node);
+    closure = closure_new(arena, closure_if);
+    closure->lhs = closure_compile_expression(arena, jit, ast, node->lhs);
+    closure->rhs = closure_compile_block(arena, jit, ast,
+                                         ast_if_consequence(ast, node));
+    closure->as.otherwise =
+        alternative != NODE_NONE
+            ? closure_compile_block(arena, jit, ast, alternative)
+            : NULL;
+  } break;
+  default:
+    closure = closure_new(arena, closure_unhandled);
+    closure->as.node_type = node->type;
+    break;
+  }
+  return closure;
+}
+
+const Closure *closure_compile_block(Arena *arena, Jit *jit, const Ast *ast,
+                                     NodeIndex block) {
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(ast, ast_node(ast, block)->lhs, &length);
+  Closure *closure = closure_new(arena, closure_block);
+  const Closure **items = arena_alloc(arena, length * sizeof(Closure *));
+  for (uint32_t i = 0; i < length; ++i) {
+    items[i] = closure_compile_statement(arena, jit, ast, statements[i]);
+  }
+  closure->as.block.items = items;
+  closure->as.block.length = length;
+  return closure;
+}
+
+// running
+
+/**
+ * Runs a program compiled by `closure_compile_program`, with the same
+ * results, arena use and out-of-memory handling as `eval_program`.
+ */
+void closure_run_program(const Closure *program, Arena *arena, Gc *gc,
+                         Environment *env, Object *result) {
+  jmp_buf out_of_memory;
+  jmp_buf *prev_arena_handler = arena->out_of_memory;
+  jmp_buf *prev_gc_handler = gc->out_of_memory;
+  if (setjmp(out_of_memory)) {
+    arena->out_of_memory = prev_arena_handler;
+    gc->out_of_memory = prev_gc_handler;
+    out_of_memory_object(result);
+    return;
+  }
+  arena->out_of_memory = &out_of_memory;
+  gc->out_of_memory = &out_of_memory;
+
+  ClosureContext context = {.arena = arena, .gc = gc, .env = env};
+  TempArenaMemory temp = temp_arena_memory_begin(arena);
+  for (uint32_t i = 0; i < program->as.block.length; ++i) {
+    const Closure *statement = program->as.block.items[i];
+    statement->run(statement, &context, result);
+    eval_end_scope(temp, result);
+    ObjectType type = object_type(result);
+    if (type == OBJECT_RETURN) {
+      memcpy(result, object_return_value(result), sizeof(Object));
+      break;
+    } else if (type == OBJECT_ERROR) {
+      break;
+    }
+  }
+
+  arena->out_of_memory = prev_arena_handler;
+  gc->out_of_memory = prev_gc_handler;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "mem.c"
+#include "string.c"
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum Opcode {
+  OP_CONSTANT,
+  OP_ADD,
+  OP_POP,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_TRUE,
+  OP_FALSE,
+  OP_EQUAL,
+  OP_NOT_EQUAL,
+  OP_GREATER_THAN,
+  OP_MINUS,
+  OP_BANG,
+  OP_JUMP_NOT_TRUTHY,
+  OP_JUMP,
+  OP_NULL,
+  OP_GET_GLOBAL,
+  OP_SET_GLOBAL,
+  OP_RETURN_VALUE,
+  // not in the Go implementation, which compiles `a < b` as `b > a` and so
+  // evaluates the operands right to left
+  OP_LESS_THAN,
+  // jumps past the rest of a block once one of its statements has produced
+  // a return value, which leaves it on the stack
+  OP_JUMP_IF_RETURN,
+} Opcode;
+
+#define OPCODE_MAX_OPERANDS 1
+#define INSTRUCTION_MAX_LENGTH 3
+
+typedef struct OpcodeDefinition {
+  String name;
+  size_t operand_count;
+  size_t operand_widths[OPCODE_MAX_OPERANDS];
+} OpcodeDefinition;
+
+const OpcodeDefinition opcode_definitions[] = {
+    {String("OpConstant"), 1, {2}},
+    {String("OpAdd"), 0, {0}},
+    {String("OpPop"), 0, {0}},
+    {String("OpSub"), 0, {0}},
+    {String("OpMul"), 0, {0}},
+    {String("OpDiv"), 0, {0}},
+    {String("OpTrue"), 0, {0}},
+    {String("OpFalse"), 0, {0}},
+    {String("OpEqual"), 0, {0}},
+    {String("OpNotEqual"), 0, {0}},
+    {String("OpGreaterThan"), 0, {0}},
+    {String("OpMinus"), 0, {0}},
+    {String("OpBang"), 0, {0}},
+    {String("OpJumpNotTruthy"), 1, {2}},
+    {String("OpJump"), 1, {2}},
+    {String("OpNull"), 0, {0}},
+    {String("OpGetGlobal"), 1, {2}},
+    {String("OpSetGlobal"), 1, {2}},
+    {String("OpReturnValue"), 0, {0}},
+    {String("OpLessThan"), 0, {0}},
+    {String("OpJumpIfReturn"), 1, {2}},
+};
+
+typedef struct Instructions {
+  uint8_t *items;
+  size_t length;
+  size_t capacity;
+} Instructions;
+
+void instructions_init(Instructions *ins, Arena *arena) {
+  ins->capacity = 64;
+  ins->length = 0;
+  ins->items = arena_alloc(arena, ins->capacity);
+}
+
+void instructions_append(Instructions *ins, Arena *arena,
+                         const uint8_t *instruction, size_t length) {
+  if (ins->length + length > ins->capacity) {
+    size_t new_capacity = ins->capacity * 2;
+    while (ins->length + length > new_capacity) {
+      new_capacity *= 2;
+    }
+    uint8_t *new_items = arena_alloc(arena, new_capacity);
+    memcpy(new_items, ins->items, ins->length);
+    ins->items = new_items;
+    ins->capacity = new_capacity;
+  }
+
+  memcpy(ins->items + ins->length, instruction, length);
+  ins->length += length;
+}
+
+uint16_t code_read_uint16(const uint8_t *ins) {
+  return (uint16_t)((ins[0] << 8) | ins[1]);
+}
+
+void code_write_uint16(uint8_t *ins, uint16_t value) {
+  ins[0] = (uint8_t)(value >> 8);
+  ins[1] = (uint8_t)(value & 0xFF);
+}
+
+/**
+ * Encodes `op` and its operands into `instruction`, which must have room for
+ * at least `INSTRUCTION_MAX_LENGTH` bytes. Operands are passed as `int`s and
+ * stored big-endian, matching `code.Make` in the Go implementation; the
+ * caller must check that they fit.
+ * Returns the number of bytes written.
+ */
+size_t code_make(uint8_t *instruction, Opcode op, ...) {
+  const OpcodeDefinition *def = &opcode_definitions[op];
+  instruction[0] = (uint8_t)op;
+
+  va_list args;
+  va_start(args, op);
+  size_t offset = 1;
+  for (size_t i = 0; i < def->operand_count; ++i) {
+    int operand = va_arg(args, int);
+    switch (def->operand_widths[i]) {
+    case 2:
+      assert(operand >= 0 && operand <= UINT16_MAX && "operand out of range");
+      code_write_uint16(&instruction[offset], (uint16_t)operand);
+      break;
+    }
+    offset += def->operand_widths[i];
+  }
+  va_end(args);
+
+  return offset;
+}
+
+/**
+ * Decodes the operands of the instruction starting at `ins` (just past the
+ * opcode byte) into `operands`. Returns the number of bytes read.
+ */
+size_t code_read_operands(const OpcodeDefinition *def, const uint8_t *ins,
+                          int *operands) {
+  size_t offset = 0;
+  for (size_t i = 0; i < def->operand_count; ++i) {
+    switch (def->operand_widths[i]) {
+    case 2:
+      operands[i] = code_read_uint16(&ins[offset]);
+      break;
+    }
+    offset += def->operand_widths[i];
+  }
+  return offset;
+}
+
+void instructions_write(const Instructions *ins, Writer *writer) {
+  size_t i = 0;
+  while (i < ins->length) {
+    const OpcodeDefinition *def = &opcode_definitions[ins->items[i]];
+    int operands[OPCODE_MAX_OPERANDS] = {0};
+    size_t read = code_read_operands(def, &ins->items[i + 1], operands);
+
+    switch (def->operand_count) {
+    case 0:
+      writer_fmt(writer, "%04zu %.*s\n", i, (int)def->name.length,
+                 def->name.buffer);
+      break;
+    case 1:
+      writer_fmt(writer, "%04zu %.*s %d\n", i, (int)def->name.length,
+                 def->name.buffer, operands[0]);
+      break;
+    }
+
+    i += 1 + read;
+  }
+}
+
+String instructions_to_string(const Instructions *ins, Arena *arena) {
+  Writer writer = {0};
+  writer_init_arena(&writer, arena);
+  instructions_write(ins, &writer);
+  return writer_string(&writer);
+}
@@ -0,0 +1,378 @@
+#pragma once
+
+#include "ast.c"
+#include "code.c"
+#include "mem.c"
+#include "object.c"
+#include "string.c"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define GLOBALS_SIZE 65536
+
+typedef struct Symbol {
+  const InternedString *name;
+  uint16_t index;
+} Symbol;
+
+/**
+ * Maps global names to their slot in the VM's globals array. The table
+ * outlives a single compilation (each REPL line gets a fresh `Compiler`), so
+ * every program compiled against it must be parsed with the same string
+ * table; names are compared by identity.
+ */
+typedef struct SymbolTable {
+  Symbol *symbols;
+  size_t capacity;
+  size_t count;
+  Arena *arena;
+} SymbolTable;
+
+void symbol_table_init(SymbolTable *table, Arena *arena) {
+  table->capacity = 16;
+  table->count = 0;
+  table->arena = arena;
+  table->symbols = arena_alloc(arena, table->capacity * sizeof(Symbol));
+}
+
+Symbol *symbol_table_resolve(SymbolTable *table,
+                             const InternedString *name) {
+  for (size_t i = 0; i < table->count; ++i) {
+    if (table->symbols[i].name == name) {
+      return &table->symbols[i];
+    }
+  }
+  return NULL;
+}
+
+Symbol *symbol_table_define(SymbolTable *table, const InternedString *name) {
+  Symbol *existing = symbol_table_resolve(table, name);
+  if (existing) {
+    return existing;
+  }
+
+  if (table->count == table->capacity) {
+    size_t new_capacity = table->capacity * 2;
+    Symbol *new_symbols =
+        arena_alloc(table->arena, new_capacity * sizeof(Symbol));
+    memcpy(new_symbols, table->symbols, table->count * sizeof(Symbol));
+    table->symbols = new_symbols;
+    table->capacity = new_capacity;
+  }
+
+  Symbol *symbol = &table->symbols[table->count];
+  symbol->name = name;
+  symbol->index = (uint16_t)table->count;
+  ++table->count;
+  return symbol;
+}
+
+typedef struct ConstantList {
+  Object *items;
+  size_t length;
+  size_t capacity;
+} ConstantList;
+
+typedef struct Compiler {
+  Arena *arena;
+  Instructions instructions;
+  ConstantList constants;
+  SymbolTable *symbols;
+  String error;
+} Compiler;
+
+typedef struct Bytecode {
+  Instructions instructions;
+  Object *constants;
+  size_t constants_len;
+  const SymbolTable *symbols; // names the globals in error messages
+} Bytecode;
+
+bool compiler_compile_statement(Compiler *compiler, const Ast *ast,
+                                NodeIndex statement);
+bool compiler_compile_expression(Compiler *compiler, const Ast *ast,
+                                 NodeIndex expression);
+
+void compiler_init(Compiler *compiler, Arena *arena, SymbolTable *symbols) {
+  compiler->arena = arena;
+  instructions_init(&compiler->instructions, arena);
+  compiler->constants.capacity = 16;
+  compiler->constants.length = 0;
+  compiler->constants.items =
+      arena_alloc(arena, compiler->constants.capacity * sizeof(Object));
+  compiler->symbols = symbols;
+  compiler->error = (String){0};
+}
+
+Bytecode compiler_bytecode(const Compiler *compiler) {
+  return (Bytecode){
+      .instructions = compiler->instructions,
+      .constants = compiler->constants.items,
+      .constants_len = compiler->constants.length,
+      .symbols = compiler->symbols,
+  };
+}
+
+size_t compiler_add_constant(Compiler *compiler, Object object) {
+  ConstantList *list = &compiler->constants;
+  if (list->length == list->capacity) {
+    size_t new_capacity = list->capacity * 2;
+    Object *new_items =
+        arena_alloc(compiler->arena, new_capacity * sizeof(Object));
+    memcpy(new_items, list->items, list->length * sizeof(Object));
+    list->items = new_items;
+    list->capacity = new_capacity;
+  }
+  list->items[list->length] = object;
+  return list->length++;
+}
+
+size_t compiler_emit(Compiler *compiler, Opcode op, int operand) {
+  uint8_t instruction[INSTRUCTION_MAX_LENGTH];
+  size_t length = code_make(instruction, op, operand);
+
+  size_t position = compiler->instructions.length;
+  instructions_append(&compiler->instructions, compiler->arena, instruction,
+                      length);
+  return position;
+}
+
+void compiler_change_operand(Compiler *compiler, size_t position,
+                             int operand) {
+  code_write_uint16(&compiler->instructions.items[position + 1],
+                    (uint16_t)operand);
+}
+
+/**
+ * Points the jump at `position` to the next instruction. Fails if that lies
+ * beyond what a 16-bit operand can address.
+ */
+bool compiler_patch_jump(Compiler *compiler, size_t position) {
+  if (compiler->instructions.length > UINT16_MAX) {
+    compiler->error = String("program too large: jump target out of range");
+    return false;
+  }
+  compiler_change_operand(compiler, position,
+                          (int)compiler->instructions.length);
+  return true;
+}
+
+bool compiler_compile_program(Compiler *compiler, Program *program) {
+  for (uint32_t i = 0; i < program->statements_len; ++i) {
+    if (!compiler_compile_statement(compiler, &program->ast,
+                                    program->statements[i])) {
+      return false;
+    }
+    compiler_emit(compiler, OP_POP, 0);
+  }
+  return true;
+}
+
+/**
+ * Compiles a statement so that it leaves its value on the stack, as
+ * `eval_statement` produces one: a `let` leaves the bound value and a
+ * `return` leaves a return value wrapping its operand.
+ */
+bool compiler_compile_statement(Compiler *compiler, const Ast *ast,
+                                NodeIndex statement) {
+  const Node *node = ast_node(ast, statement);
+  switch (node->type) {
+  case NODE_EXPRESSION_STATEMENT:
+    if (!compiler_compile_expression(compiler, ast, node->lhs)) {
+      return false;
+    }
+    break;
+  case NODE_RETURN:
+    if (!compiler_compile_expression(compiler, ast, node->lhs)) {
+      return false;
+    }
+    compiler_emit(compiler, OP_RETURN_VALUE, 0);
+    break;
+  case NODE_LET: {
+    if (!compiler_compile_expression(compiler, ast, node->rhs)) {
+      return false;
+    }
+    if (compiler->symbols->count == GLOBALS_SIZE) {
+      compiler->error = String("too many global bindings");
+      return false;
+    }
+    Symbol *symbol = symbol_table_define(
+        compiler->symbols,
+        ast_identifier_symbol(ast, ast_node(ast, node->lhs)));
+    compiler_emit(compiler, OP_SET_GLOBAL, symbol->index);
+  } break;
+  default: {
+    String type_str = node_type_strings[node->type];
+    compiler->error =
+        string_fmt(compiler->arena, "compiler: unhandled statement type %.*s",
+                   (int)type_str.length, type_str.buffer);
+    return false;
+  }
+  }
+  return true;
+}
+
+/**
+ * Compiles one arm of an `if` so that it leaves exactly one value on the
+ * stack, that of its last statement or null if it has none. As in
+ * `eval_block_statement`, a return value skips the statements after it and
+ * becomes the value of the arm.
+ */
+bool compiler_compile_if_arm(Compiler *compiler, const Ast *ast,
+                             NodeIndex block) {
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(ast, ast_node(ast, block)->lhs, &length);
+  if (length == 0) {
+    compiler_emit(compiler, OP_NULL, 0);
+    return true;
+  }
+
+  size_t *return_jumps = arena_alloc(compiler->arena, length * sizeof(size_t));
+  for (uint32_t i = 0; i < length; ++i) {
+    if (!compiler_compile_statement(compiler, ast, statements[i])) {
+      return false;
+    }
+    if (i + 1 < length) {
+      return_jumps[i] = compiler_emit(compiler, OP_JUMP_IF_RETURN, 9999);
+      compiler_emit(compiler, OP_POP, 0);
+    }
+  }
+  for (uint32_t i = 0; i + 1 < length; ++i) {
+    if (!compiler_patch_jump(compiler, return_jumps[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool compiler_compile_expression(Compiler *compiler, const Ast *ast,
+                                 NodeIndex expression) {
+  const Node *node = ast_node(ast, expression);
+  switch (node->type) {
+  case NODE_INTEGER: {
+    if (compiler->constants.length > UINT16_MAX) {
+      compiler->error = String("program too large: too many constants");
+      return false;
+    }
+    Object integer = {0};
+    integer_object(&integer, compiler->arena, ast_integer_value(node));
+    compiler_emit(compiler, OP_CONSTANT,
+                  (int)compiler_add_constant(compiler, integer));
+  } break;
+  case NODE_BOOLEAN:
+    compiler_emit(compiler, node->lhs ? OP_TRUE : OP_FALSE, 0);
+    break;
+  case NODE_PREFIX: {
+    if (!compiler_compile_expression(compiler, ast, node->lhs)) {
+      return false;
+    }
+    switch (node->operator) {
+    case OPERATOR_BANG:
+      compiler_emit(compiler, OP_BANG, 0);
+      break;
+    case OPERATOR_MINUS:
+      compiler_emit(compiler, OP_MINUS, 0);
+      break;
+    default: {
+      String op = operator_strings[node->operator];
+      compiler->error = string_fmt(compiler->arena, "unknown operator %.*s",
+                                   (int)op.length, op.buffer);
+      return false;
+    }
+    }
+  } break;
+  case NODE_INFIX: {
+    if (!compiler_compile_expression(compiler, ast, node->lhs) ||
+        !compiler_compile_expression(compiler, ast, node->rhs)) {
+      return false;
+    }
+
+    switch (node->operator) {
+    case OPERATOR_PLUS:
+      compiler_emit(compiler, OP_ADD, 0);
+      break;
+    case OPERATOR_MINUS:
+      compiler_emit(compiler, OP_SUB, 0);
+      break;
+    case OPERATOR_ASTERISK:
+      compiler_emit(compiler, OP_MUL, 0);
+      break;
+    case OPERATOR_SLASH:
+      compiler_emit(compiler, OP_DIV, 0);
+      break;
+    case OPERATOR_LT:
+      compiler_emit(compiler, OP_LESS_THAN, 0);
+      break;
+    case OPERATOR_GT:
+      compiler_emit(compiler, OP_GREATER_THAN, 0);
+      break;
+    case OPERATOR_EQ:
+      compiler_emit(compiler, OP_EQUAL, 0);
+      break;
+    case OPERATOR_NOT_EQ:
+      compiler_emit(compiler, OP_NOT_EQUAL, 0);
+      break;
+    default: {
+      String op = operator_strings[node->operator];
+      compiler->error = string_fmt(compiler->arena, "unknown operator %.*s",
+                                   (int)op.length, op.buffer);
+      return false;
+    }
+    }
+  } break;
+  case NODE_IF: {
+    if (!compiler_compile_expression(compiler, ast, node->lhs)) {
+      return false;
+    }
+
+    // bogus offsets, patched once the arms have been emitted
+    size_t jump_not_truthy_pos =
+        compiler_emit(compiler, OP_JUMP_NOT_TRUTHY, 9999);
+    if (!compiler_compile_if_arm(compiler, ast,
+                                 ast_if_consequence(ast, node))) {
+      return false;
+    }
+
+    size_t jump_pos = compiler_emit(compiler, OP_JUMP, 9999);
+    if (!compiler_patch_jump(compiler, jump_not_truthy_pos)) {
+      return false;
+    }
+
+    NodeIndex alternative = ast_if_alternative(ast, node);
+    if (alternative != NODE_NONE) {
+      if (!compiler_compile_if_arm(compiler, ast, alternative)) {
+        return false;
+      }
+    } else {
+      compiler_emit(compiler, OP_NULL, 0);
+    }
+
+    if (!compiler_patch_jump(compiler, jump_pos)) {
+      return false;
+    }
+  } break;
+  case NODE_IDENTIFIER: {
+    Symbol *symbol = symbol_table_resolve(compiler->symbols,
+                                          ast_identifier_symbol(ast, node));
+    if (!symbol) {
+      String name = ast_identifier_name(ast, node);
+      compiler->error =
+          string_fmt(compiler->arena, "identifier not found: %.*s",
+                     (int)name.length, name.buffer);
+      return false;
+    }
+    compiler_emit(compiler, OP_GET_GLOBAL, symbol->index);
+  } break;
+  default: {
+    String type_str = node_type_strings[node->type];
+    compiler->error =
+        string_fmt(compiler->arena, "compiler: unhandled expression type %.*s",
+                   (int)type_str.length, type_str.buffer);
+    return false;
+  }
+  }
+  return true;
+}
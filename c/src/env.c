@@ -1,55 +1,161 @@
 #pragma once
 
+#include "gc.c"
 #include "mem.c"
 #include "object.c"
 #include "string.c"
-#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-typedef struct EnvironmentItem {
-  String key;
-  Object *value;
-} EnvironmentItem;
+typedef struct Environment Environment;
 
-typedef struct Environment {
-  EnvironmentItem *items;
+/**
+ * A declared name and the value bound to it. The value is stored in the
+ * binding itself, so rebinding a name overwrites it in place; only heap
+ * payloads of values are allocated, in a `Gc` heap.
+ */
+typedef struct Binding {
+  const InternedString *name;
+  bool bound; // false until the first `environment_set`
+  Object value;
+} Binding;
+
+/**
+ * Bindings are addressed by slot rather than by name. The resolver assigns
+ * every name a slot when it is declared (`environment_define`) and tags each
+ * identifier node with a (depth, slot) pair, so evaluation never compares
+ * names. Resolving a name goes through `index`, which maps names to slots by
+ * their interned hash, so it costs the same however many names a long
+ * session has declared.
+ */
+struct Environment {
+  Binding *bindings; // by slot, in declaration order
   size_t capacity;
   size_t count;
-} Environment;
+  // slot + 1 of each binding, or 0; open addressing with linear probing,
+  // kept at most half full
+  uint32_t *index;
+  size_t index_capacity; // always a power of two
+  Environment *outer;
+};
 
 void environment_init(Environment *env, Arena *arena) {
-  env->items = arena_alloc(arena, 16 * sizeof(EnvironmentItem));
   env->capacity = 16;
   env->count = 0;
+  env->bindings = arena_alloc(arena, env->capacity * sizeof(Binding));
+  env->index_capacity = 2 * env->capacity;
+  env->index = arena_alloc(arena, env->index_capacity * sizeof(uint32_t));
+  env->outer = NULL;
 }
 
-Object *environment_get(Environment *env, String key) {
-  Object *result = NULL;
-  for (size_t i = 0; i < env->count; ++i) {
-    if (string_cmp(env->items[i].key, key)) {
-      result = env->items[i].value;
-      break;
-    }
+void environment_init_enclosed(Environment *env, Arena *arena,
+                               Environment *outer) {
+  environment_init(env, arena);
+  env->outer = outer;
+}
+
+/**
+ * Returns the entry of `index` for `name`: the one holding its slot if it is
+ * declared in `env`, or the empty one where it would go.
+ */
+uint32_t *environment_lookup(const Environment *env,
+                             const InternedString *name) {
+  size_t mask = env->index_capacity - 1;
+  size_t i = name->hash & mask;
+  // compared by identity; see `InternedString`
+  while (env->index[i] && env->bindings[env->index[i] - 1].name != name) {
+    i = (i + 1) & mask;
   }
-  return result;
+  return &env->index[i];
 }
 
-void environment_set(Environment *env, Arena *arena, String key,
-                     Object *value) {
-  for (size_t i = 0; i < env->count; ++i) {
-    if (string_cmp(env->items[i].key, key)) {
-      env->items[i].value = value;
-      return;
-    }
+void environment_grow(Environment *env, Arena *arena) {
+  size_t new_capacity = env->capacity * 2;
+  env->bindings =
+      arena_resize(arena, env->bindings, env->capacity * sizeof(Binding),
+                   new_capacity * sizeof(Binding));
+  env->capacity = new_capacity;
+
+  env->index_capacity = 2 * new_capacity;
+  env->index = arena_alloc(arena, env->index_capacity * sizeof(uint32_t));
+  for (size_t slot = 0; slot < env->count; ++slot) {
+    *environment_lookup(env, env->bindings[slot].name) = (uint32_t)slot + 1;
+  }
+}
+
+/**
+ * Returns the slot for `name` in `env`, declaring it if this is the first
+ * time it has been seen. Names are interned, so they are never copied.
+ */
+size_t environment_define(Environment *env, Arena *arena,
+                          const InternedString *name) {
+  uint32_t *entry = environment_lookup(env, name);
+  if (*entry) {
+    return *entry - 1;
   }
 
   if (env->count == env->capacity) {
-    arena_resize(arena, env->items, env->capacity * sizeof(EnvironmentItem),
-                 env->capacity * 2 * sizeof(EnvironmentItem));
-    env->capacity *= 2;
+    environment_grow(env, arena);
+    entry = environment_lookup(env, name);
+  }
+
+  env->bindings[env->count] = (Binding){.name = name};
+  *entry = (uint32_t)env->count + 1;
+  return env->count++;
+}
+
+/**
+ * Finds the nearest declaration of `name`, walking outwards through enclosing
+ * environments. Only used while resolving; evaluation goes through
+ * `environment_get`.
+ */
+bool environment_resolve(const Environment *env, const InternedString *name,
+                         size_t *depth, size_t *slot) {
+  for (size_t d = 0; env; env = env->outer, ++d) {
+    uint32_t entry = *environment_lookup(env, name);
+    if (entry) {
+      *depth = d;
+      *slot = entry - 1;
+      return true;
+    }
+  }
+  return false;
+}
+
+Environment *environment_ancestor(Environment *env, size_t depth) {
+  for (size_t i = 0; i < depth; ++i) {
+    env = env->outer;
   }
+  return env;
+}
 
-  env->items[env->count].key = arena_strdup(arena, key);
-  env->items[env->count].value = arena_alloc(arena, sizeof(Object));
-  memcpy(env->items[env->count].value, value, sizeof(Object));
-  ++env->count;
+/**
+ * Returns the value bound in `slot`, or NULL if it has only been declared.
+ * The value is only valid until the next `environment_define`.
+ */
+Object *environment_get(Environment *env, size_t depth, size_t slot) {
+  Binding *binding = &environment_ancestor(env, depth)->bindings[slot];
+  return binding->bound ? &binding->value : NULL;
+}
+
+void environment_set(Environment *env, Gc *gc, size_t depth, size_t slot,
+                     const Object *value) {
+  Binding *binding = &environment_ancestor(env, depth)->bindings[slot];
+  // a collection may run first, and the old value is still marked by it
+  gc_object_copy(gc, &binding->value, value);
+  binding->bound = true;
+}
+
+/**
+ * A `GcMarkRoots` callback for an environment and everything enclosing it.
+ */
+void environment_mark(Gc *gc, void *context) {
+  for (Environment *env = context; env; env = env->outer) {
+    for (size_t i = 0; i < env->count; ++i) {
+      if (env->bindings[i].bound) {
+        gc_mark_object(gc, &env->bindings[i].value);
+      }
+    }
+  }
 }
@@ -2,330 +2,471 @@
 
 #include "ast.c"
 #include "env.c"
+#include "gc.c"
 #include "mem.c"
 #include "object.c"
 #include "string.c"
+#include <assert.h>
+#include <setjmp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-void eval_statement(Arena *arena, Arena *env_arena, Environment *env,
-                    Object *result, Statement *statement);
-void eval_expression(Arena *arena, Arena *env_arena, Environment *env,
-                     Object *result, Expression *expression);
-void eval_prefix_expression(Arena *arena, Object *result, String op);
-void eval_bang_operator_expression(Object *result);
-void eval_minus_prefix_operator_expression(Arena *arena, Object *result);
-void eval_infix_expression(Arena *arena, Object *result, String op, Object left,
-                           Object right);
-void eval_integer_infix_expression(Arena *arena, Object *result, String op,
-                                   Object left, Object right);
-void eval_boolean_infix_expression(Arena *arena, Object *result, String op,
-                                   Object left, Object right);
-void eval_null_infix_expression(Arena *arena, Object *result, String op);
-void eval_block_statement(Arena *arena, Arena *env_arena, Environment *env,
-                          Object *result, BlockStatement *block);
-void error_object(Object *result, String message);
-
-bool object_is_truthy(Object o);
-
-void eval_program(Program *program, Arena *arena, Arena *env_arena,
-                  Environment *env, Object *result) {
-  StatementIterator iter = {0};
-  statement_iterator_init(&iter, program->first_chunk);
-
-  Statement *s;
-  while ((s = statement_iterator_next(&iter))) {
-    eval_statement(arena, env_arena, env, result, s);
-    if (result->type == OBJECT_RETURN) {
-      memcpy(result, result->data.return_object.value, sizeof(Object));
+void eval_statement(Arena *arena, Gc *gc, Environment *env, Object *result,
+                    Ast *ast, NodeIndex statement);
+void eval_expression(Arena *arena, Gc *gc, Environment *env, Object *result,
+                     Ast *ast, NodeIndex expression);
+void eval_prefix_expression(Arena *arena, Object *result, Operator op);
+void eval_infix_expression(Arena *arena, Object *result, Operator op,
+                           const Object *left, const Object *right);
+void eval_block_statement(Arena *arena, Gc *gc, Environment *env,
+                          Object *result, Ast *ast, NodeIndex block);
+void eval_end_scope(TempArenaMemory temp, Object *result);
+
+// operator handlers
+//
+// Operators are resolved to an `Operator` at parse time, so evaluation is a
+// single table lookup keyed on the operand types and the operator. A missing
+// entry means the combination is unsupported and produces an error object.
+
+typedef void (*PrefixHandler)(Arena *arena, Object *result);
+typedef void (*InfixHandler)(Arena *arena, Object *result, const Object *left,
+                             const Object *right);
+
+void prefix_bang(Arena *arena, Object *result) {
+  (void)arena;
+  boolean_object(result, !object_is_truthy(result));
+}
+
+void prefix_integer_minus(Arena *arena, Object *result) {
+  integer_object(result, arena, integer_neg(object_integer(result)));
+}
+
+#define INTEGER_INFIX_HANDLER(name, expr)                                      \
+  void name(Arena *arena, Object *result, const Object *left,                  \
+            const Object *right) {                                             \
+    int64_t l = object_integer(left);                                          \
+    int64_t r = object_integer(right);                                         \
+    integer_object(result, arena, (expr));                                     \
+  }
+
+#define INTEGER_COMPARISON_HANDLER(name, expr)                                 \
+  void name(Arena *arena, Object *result, const Object *left,                  \
+            const Object *right) {                                             \
+    (void)arena;                                                               \
+    int64_t l = object_integer(left);                                          \
+    int64_t r = object_integer(right);                                         \
+    boolean_object(result, (expr));                                            \
+  }
+
+INTEGER_INFIX_HANDLER(infix_integer_add, integer_add(l, r))
+INTEGER_INFIX_HANDLER(infix_integer_sub, integer_sub(l, r))
+INTEGER_INFIX_HANDLER(infix_integer_mul, integer_mul(l, r))
+INTEGER_INFIX_HANDLER(infix_integer_div, l / r)
+INTEGER_COMPARISON_HANDLER(infix_integer_lt, l < r)
+INTEGER_COMPARISON_HANDLER(infix_integer_gt, l > r)
+INTEGER_COMPARISON_HANDLER(infix_integer_eq, l == r)
+INTEGER_COMPARISON_HANDLER(infix_integer_not_eq, l != r)
+
+void infix_boolean_eq(Arena *arena, Object *result, const Object *left,
+                      const Object *right) {
+  (void)arena;
+  boolean_object(result, object_boolean(left) == object_boolean(right));
+}
+
+void infix_boolean_not_eq(Arena *arena, Object *result, const Object *left,
+                          const Object *right) {
+  (void)arena;
+  boolean_object(result, object_boolean(left) != object_boolean(right));
+}
+
+void infix_null_eq(Arena *arena, Object *result, const Object *left,
+                   const Object *right) {
+  (void)arena;
+  (void)left;
+  (void)right;
+  boolean_object(result, true);
+}
+
+void infix_null_not_eq(Arena *arena, Object *result, const Object *left,
+                       const Object *right) {
+  (void)arena;
+  (void)left;
+  (void)right;
+  boolean_object(result, false);
+}
+
+const PrefixHandler prefix_handlers[OPERATOR_COUNT][OBJECT_TYPE_COUNT] = {
+    [OPERATOR_BANG][OBJECT_INTEGER] = prefix_bang,
+    [OPERATOR_BANG][OBJECT_BOOLEAN] = prefix_bang,
+    [OPERATOR_BANG][OBJECT_NULL] = prefix_bang,
+    [OPERATOR_MINUS][OBJECT_INTEGER] = prefix_integer_minus,
+};
+
+const InfixHandler
+    infix_handlers[OBJECT_TYPE_COUNT][OBJECT_TYPE_COUNT][OPERATOR_COUNT] = {
+        [OBJECT_INTEGER][OBJECT_INTEGER] =
+            {
+                [OPERATOR_PLUS] = infix_integer_add,
+                [OPERATOR_MINUS] = infix_integer_sub,
+                [OPERATOR_ASTERISK] = infix_integer_mul,
+                [OPERATOR_SLASH] = infix_integer_div,
+                [OPERATOR_LT] = infix_integer_lt,
+                [OPERATOR_GT] = infix_integer_gt,
+                [OPERATOR_EQ] = infix_integer_eq,
+                [OPERATOR_NOT_EQ] = infix_integer_not_eq,
+            },
+        [OBJECT_BOOLEAN][OBJECT_BOOLEAN] =
+            {
+                [OPERATOR_EQ] = infix_boolean_eq,
+                [OPERATOR_NOT_EQ] = infix_boolean_not_eq,
+            },
+        [OBJECT_NULL][OBJECT_NULL] =
+            {
+                [OPERATOR_EQ] = infix_null_eq,
+                [OPERATOR_NOT_EQ] = infix_null_not_eq,
+            },
+};
+
+// quickening
+//
+// A prefix or infix node specializes itself to the operand type it first
+// sees, when the tables have a handler for it. From then on its operands are
+// only checked against that type and the result computed in place, with no
+// table lookup. A node whose guard misses goes back to the tables for good.
+
+// what a node first run on operands of type `type` specializes to, if the
+// tables have a handler for its operator and operands
+Quickening eval_quickening(ObjectType type, bool supported) {
+  if (!supported) {
+    return QUICKENING_GENERIC;
+  }
+  switch (type) {
+  case OBJECT_INTEGER:
+    return QUICKENING_INTEGER;
+  case OBJECT_BOOLEAN:
+    return QUICKENING_BOOLEAN;
+  default:
+    return QUICKENING_GENERIC;
+  }
+}
+
+void eval_quick_prefix(Arena *arena, Node *node, Object *result) {
+  ObjectType type = object_type(result);
+  switch (ast_node_quickening(node)) {
+  case QUICKENING_NONE: {
+    bool supported = prefix_handlers[node->operator][type] != NULL;
+    ast_node_set_quickening(node, eval_quickening(type, supported));
+  } break;
+  case QUICKENING_GENERIC:
+    break;
+  case QUICKENING_INTEGER:
+    if (type != OBJECT_INTEGER) {
+      ast_node_set_quickening(node, QUICKENING_GENERIC);
+    } else if (node->operator == OPERATOR_MINUS) {
+      integer_object(result, arena,
+                     integer_neg(object_integer(result)));
+      return;
+    } else {
+      boolean_object(result, false); // see `object_is_truthy`
+      return;
+    }
+    break;
+  case QUICKENING_BOOLEAN:
+    if (type != OBJECT_BOOLEAN) {
+      ast_node_set_quickening(node, QUICKENING_GENERIC);
+    } else {
+      boolean_object(result, !object_boolean(result));
+      return;
+    }
+    break;
+  }
+  eval_prefix_expression(arena, result, node->operator);
+}
+
+void eval_quick_infix(Arena *arena, Node *node, Object *result,
+                      const Object *left, const Object *right) {
+  ObjectType l = object_type(left);
+  ObjectType r = object_type(right);
+  switch (ast_node_quickening(node)) {
+  case QUICKENING_NONE: {
+    bool supported = l == r && infix_handlers[l][r][node->operator] != NULL;
+    ast_node_set_quickening(node, eval_quickening(l, supported));
+  } break;
+  case QUICKENING_GENERIC:
+    break;
+  case QUICKENING_INTEGER: {
+    if (l != OBJECT_INTEGER || r != OBJECT_INTEGER) {
+      ast_node_set_quickening(node, QUICKENING_GENERIC);
+      break;
+    }
+    int64_t a = object_integer(left);
+    int64_t b = object_integer(right);
+    switch ((Operator)node->operator) {
+    case OPERATOR_PLUS:
+      integer_object(result, arena, integer_add(a, b));
+      return;
+    case OPERATOR_MINUS:
+      integer_object(result, arena, integer_sub(a, b));
+      return;
+    case OPERATOR_ASTERISK:
+      integer_object(result, arena, integer_mul(a, b));
+      return;
+    case OPERATOR_SLASH:
+      integer_object(result, arena, a / b);
+      return;
+    case OPERATOR_LT:
+      boolean_object(result, a < b);
+      return;
+    case OPERATOR_GT:
+      boolean_object(result, a > b);
+      return;
+    case OPERATOR_EQ:
+      boolean_object(result, a == b);
+      return;
+    case OPERATOR_NOT_EQ:
+      boolean_object(result, a != b);
+      return;
+    default:
       break;
-    } else if (result->type == OBJECT_ERROR) {
+    }
+  } break;
+  case QUICKENING_BOOLEAN:
+    if (l != OBJECT_BOOLEAN || r != OBJECT_BOOLEAN) {
+      ast_node_set_quickening(node, QUICKENING_GENERIC);
       break;
     }
+    // only `==` and `!=` specialize to booleans
+    boolean_object(result,
+                   (object_boolean(left) == object_boolean(right)) ==
+                       (node->operator == OPERATOR_EQ));
+    return;
   }
+  eval_infix_expression(arena, result, node->operator, left, right);
 }
 
-void eval_statement(Arena *arena, Arena *env_arena, Environment *env,
-                    Object *result, Statement *statement) {
-  switch (statement->type) {
-  case STATEMENT_EXPRESSION:
-    eval_expression(arena, env_arena, env, result,
-                    statement->data.expression_statement.expression);
+/**
+ * Evaluates `program`. If either arena runs out of memory, evaluation is
+ * abandoned and `result` is set to an "out of memory" error.
+ *
+ * Temporaries are allocated in `arena` and released after each statement.
+ * Values bound by `let` are copied into `gc`, and `env` should be one of its
+ * roots.
+ */
+void eval_program(Program *program, Arena *arena, Gc *gc, Environment *env,
+                  Object *result) {
+  jmp_buf out_of_memory;
+  jmp_buf *prev_arena_handler = arena->out_of_memory;
+  jmp_buf *prev_gc_handler = gc->out_of_memory;
+  if (setjmp(out_of_memory)) {
+    arena->out_of_memory = prev_arena_handler;
+    gc->out_of_memory = prev_gc_handler;
+    out_of_memory_object(result);
+    return;
+  }
+  arena->out_of_memory = &out_of_memory;
+  gc->out_of_memory = &out_of_memory;
+
+  // every statement starts from the same point, so earlier statements'
+  // temporaries are overwritten rather than accumulated
+  TempArenaMemory temp = temp_arena_memory_begin(arena);
+  for (uint32_t i = 0; i < program->statements_len; ++i) {
+    eval_statement(arena, gc, env, result, &program->ast,
+                   program->statements[i]);
+    eval_end_scope(temp, result);
+    ObjectType type = object_type(result);
+    if (type == OBJECT_RETURN) {
+      memcpy(result, object_return_value(result), sizeof(Object));
+      break;
+    } else if (type == OBJECT_ERROR) {
+      break;
+    }
+  }
+
+  arena->out_of_memory = prev_arena_handler;
+  gc->out_of_memory = prev_gc_handler;
+}
+
+void eval_statement(Arena *arena, Gc *gc, Environment *env, Object *result,
+                    Ast *ast, NodeIndex statement) {
+  const Node *node = ast_node(ast, statement);
+  switch (node->type) {
+  case NODE_EXPRESSION_STATEMENT:
+    eval_expression(arena, gc, env, result, ast, node->lhs);
     break;
-  case STATEMENT_RETURN: {
+  case NODE_RETURN: {
     Object *value = arena_alloc(arena, sizeof(Object));
-    eval_expression(arena, env_arena, env, value,
-                    statement->data.return_statement.return_value);
-    if (value->type == OBJECT_ERROR) {
+    eval_expression(arena, gc, env, value, ast, node->lhs);
+    if (object_type(value) == OBJECT_ERROR) {
       memcpy(result, value, sizeof(Object));
     } else {
-      result->type = OBJECT_RETURN;
-      result->data.return_object.value = value;
+      return_object(result, arena, value);
     }
   } break;
-  case STATEMENT_LET: {
-    eval_expression(arena, env_arena, env, result,
-                    statement->data.let_statement.value);
-    if (result->type == OBJECT_ERROR) {
+  case NODE_LET: {
+    eval_expression(arena, gc, env, result, ast, node->rhs);
+    if (object_type(result) == OBJECT_ERROR) {
       break;
     }
-    environment_set(env, env_arena, statement->data.let_statement.name->value,
-                    result);
+    const Node *name = ast_node(ast, node->lhs);
+    assert(name->resolved && "program must be resolved before evaluation");
+    environment_set(env, gc, name->depth, name->rhs, result);
   } break;
   default:
-    fprintf(stderr, "eval_statement: unhandled statement type %.*s\n",
-            (int)statement_type_strings[statement->type].length,
-            statement_type_strings[statement->type].buffer);
+    fprintf(stderr, "eval_statement: unhandled node type %.*s\n",
+            (int)node_type_strings[node->type].length,
+            node_type_strings[node->type].buffer);
     break;
   }
 }
 
-void eval_expression(Arena *arena, Arena *env_arena, Environment *env,
-                     Object *result, Expression *expression) {
-  switch (expression->type) {
-  case EXPRESSION_INTEGER: {
-    result->type = OBJECT_INTEGER;
-    result->data.integer_object.value = expression->data.integer.value;
-  } break;
-  case EXPRESSION_BOOLEAN: {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = expression->data.boolean.value;
-  } break;
-  case EXPRESSION_PREFIX: {
-    eval_expression(arena, env_arena, env, result,
-                    expression->data.prefix.right);
-    if (result->type == OBJECT_ERROR) {
+void eval_expression(Arena *arena, Gc *gc, Environment *env, Object *result,
+                     Ast *ast, NodeIndex expression) {
+  Node *node = ast_node_mut(ast, expression);
+  switch (node->type) {
+  case NODE_INTEGER:
+    integer_object(result, arena, ast_integer_value(node));
+    break;
+  case NODE_BOOLEAN:
+    boolean_object(result, node->lhs);
+    break;
+  case NODE_PREFIX: {
+    eval_expression(arena, gc, env, result, ast, node->lhs);
+    if (object_type(result) == OBJECT_ERROR) {
       break;
     }
-    eval_prefix_expression(arena, result, expression->data.prefix.op);
+    eval_quick_prefix(arena, node, result);
   } break;
-  case EXPRESSION_INFIX: {
+  case NODE_INFIX: {
     Object left = {0};
-    eval_expression(arena, env_arena, env, &left, expression->data.infix.left);
-    if (left.type == OBJECT_ERROR) {
+    eval_expression(arena, gc, env, &left, ast, node->lhs);
+    if (object_type(&left) == OBJECT_ERROR) {
       memcpy(result, &left, sizeof(Object));
       break;
     }
 
     Object right = {0};
-    eval_expression(arena, env_arena, env, &right,
-                    expression->data.infix.right);
-    if (right.type == OBJECT_ERROR) {
+    eval_expression(arena, gc, env, &right, ast, node->rhs);
+    if (object_type(&right) == OBJECT_ERROR) {
       memcpy(result, &right, sizeof(Object));
       break;
     }
 
-    eval_infix_expression(arena, result, expression->data.infix.op, left,
-                          right);
+    eval_quick_infix(arena, node, result, &left, &right);
   } break;
-  case EXPRESSION_IF: {
-    IfExpression ie = expression->data.if_expression;
+  case NODE_IF: {
     Object condition = {0};
-    eval_expression(arena, env_arena, env, &condition, ie.condition);
-    if (condition.type == OBJECT_ERROR) {
+    eval_expression(arena, gc, env, &condition, ast, node->lhs);
+    if (object_type(&condition) == OBJECT_ERROR) {
       memcpy(result, &condition, sizeof(Object));
       break;
     }
 
-    if (object_is_truthy(condition)) {
-      eval_block_statement(arena, env_arena, env, result, ie.consequence);
-    } else if (ie.alternative) {
-      eval_block_statement(arena, env_arena, env, result, ie.alternative);
+    NodeIndex alternative = ast_if_alternative(ast, node);
+    if (object_is_truthy(&condition)) {
+      eval_block_statement(arena, gc, env, result, ast,
+                           ast_if_consequence(ast, node));
+    } else if (alternative != NODE_NONE) {
+      eval_block_statement(arena, gc, env, result, ast, alternative);
     } else {
       null_object(result);
     }
   } break;
-  case EXPRESSION_IDENTIFIER: {
-    Object *value = environment_get(env, expression->data.identifier.value);
+  case NODE_IDENTIFIER: {
+    Object *value =
+        node->resolved ? environment_get(env, node->depth, node->rhs) : NULL;
     if (value) {
-      memcpy(result, value, sizeof(Object));
+      // temporaries never point into the GC heap, so a collection can run
+      // whenever a value is bound
+      object_copy(result, arena, value);
     } else {
-      error_object(result,
+      String name = ast_identifier_name(ast, node);
+      error_object(result, arena,
                    string_fmt(arena, "identifier not found: %.*s",
-                              expression->data.identifier.value.length,
-                              expression->data.identifier.value.buffer));
+                              name.length, name.buffer));
     }
   } break;
   default:
-    fprintf(stderr, "eval_expression: unhandled expression type %.*s\n",
-            (int)expression_type_strings[expression->type].length,
-            expression_type_strings[expression->type].buffer);
+    fprintf(stderr, "eval_expression: unhandled node type %.*s\n",
+            (int)node_type_strings[node->type].length,
+            node_type_strings[node->type].buffer);
     break;
   }
 }
 
-void eval_prefix_expression(Arena *arena, Object *result, String op) {
-  if (string_cmp(op, String("!"))) {
-    eval_bang_operator_expression(result);
-  } else if (string_cmp(op, String("-"))) {
-    eval_minus_prefix_operator_expression(arena, result);
-  } else {
-    String right_type = object_type_strings[result->type];
-    error_object(result,
-                 string_fmt(arena, "unknown operator: %.*s%.*s", op.length,
-                            op.buffer, right_type.length, right_type.length));
+void eval_prefix_expression(Arena *arena, Object *result, Operator op) {
+  ObjectType right = object_type(result);
+  PrefixHandler handler = prefix_handlers[op][right];
+  if (handler) {
+    handler(arena, result);
+    return;
   }
-}
 
-void eval_bang_operator_expression(Object *result) {
-  switch (result->type) {
-  case OBJECT_BOOLEAN:
-    result->data.boolean_object.value = !result->data.boolean_object.value;
-    break;
-  case OBJECT_NULL:
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = true;
-    break;
-  default:
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = false;
-    break;
-  }
+  String op_str = operator_strings[op];
+  String right_type = object_type_strings[right];
+  error_object(result, arena,
+               string_fmt(arena, "unknown operator: %.*s%.*s", op_str.length,
+                          op_str.buffer, right_type.length, right_type.buffer));
 }
 
-void eval_minus_prefix_operator_expression(Arena *arena, Object *result) {
-  if (result->type != OBJECT_INTEGER) {
-    String type_str = object_type_strings[result->type];
-    error_object(result, string_fmt(arena, "unknown operator: -%.*s",
-                                    type_str.length, type_str.buffer));
-  } else {
-    result->data.integer_object.value = -result->data.integer_object.value;
+void eval_infix_expression(Arena *arena, Object *result, Operator op,
+                           const Object *left, const Object *right) {
+  ObjectType l = object_type(left);
+  ObjectType r = object_type(right);
+  InfixHandler handler = infix_handlers[l][r][op];
+  if (handler) {
+    handler(arena, result, left, right);
+    return;
   }
-}
 
-void eval_infix_expression(Arena *arena, Object *result, String op, Object left,
-                           Object right) {
-  if (left.type == right.type) {
-    // exhaustive switch covers all object types
-    switch (left.type) {
-    case OBJECT_INTEGER:
-      eval_integer_infix_expression(arena, result, op, left, right);
-      break;
-    case OBJECT_BOOLEAN:
-      eval_boolean_infix_expression(arena, result, op, left, right);
-      break;
-    case OBJECT_NULL:
-      eval_null_infix_expression(arena, result, op);
-      break;
-    default: {
-      String left_type = object_type_strings[left.type];
-      String right_type = object_type_strings[right.type];
-      error_object(result,
-                   string_fmt(arena, "unknown operator: %.*s %.*s %.*s",
-                              left_type.length, left_type.buffer, op.length,
-                              op.buffer, right_type.length, right_type.buffer));
-    } break;
-    }
-  } else {
-    String left_type = object_type_strings[left.type];
-    String right_type = object_type_strings[right.type];
-    error_object(result,
-                 string_fmt(arena, "type mismatch: %.*s %.*s %.*s",
-                            left_type.length, left_type.buffer, op.length,
-                            op.buffer, right_type.length, right_type.buffer));
-  }
-}
-
-void eval_integer_infix_expression(Arena *arena, Object *result, String op,
-                                   Object left, Object right) {
-  int64_t left_value = left.data.integer_object.value;
-  int64_t right_value = right.data.integer_object.value;
-
-  if (string_cmp(op, String("+"))) {
-    result->type = OBJECT_INTEGER;
-    result->data.integer_object.value = left_value + right_value;
-  } else if (string_cmp(op, String("-"))) {
-    result->type = OBJECT_INTEGER;
-    result->data.integer_object.value = left_value - right_value;
-  } else if (string_cmp(op, String("*"))) {
-    result->type = OBJECT_INTEGER;
-    result->data.integer_object.value = left_value * right_value;
-  } else if (string_cmp(op, String("/"))) {
-    result->type = OBJECT_INTEGER;
-    result->data.integer_object.value = left_value / right_value;
-  } else if (string_cmp(op, String("<"))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = left_value < right_value;
-  } else if (string_cmp(op, String(">"))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = left_value > right_value;
-  } else if (string_cmp(op, String("=="))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = left_value == right_value;
-  } else if (string_cmp(op, String("!="))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = left_value != right_value;
-  } else {
-    String left_type = object_type_strings[left.type];
-    String right_type = object_type_strings[right.type];
-    error_object(result,
-                 string_fmt(arena, "unknown operator: %.*s %.*s %.*s",
-                            left_type.length, left_type.buffer, op.length,
-                            op.buffer, right_type.length, right_type.buffer));
-  }
-}
-
-void eval_boolean_infix_expression(Arena *arena, Object *result, String op,
-                                   Object left, Object right) {
-  bool left_value = left.data.boolean_object.value;
-  bool right_value = right.data.boolean_object.value;
-
-  if (string_cmp(op, String("=="))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = left_value == right_value;
-  } else if (string_cmp(op, String("!="))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = left_value != right_value;
-  } else {
-    String left_type = object_type_strings[left.type];
-    String right_type = object_type_strings[right.type];
-    error_object(result,
-                 string_fmt(arena, "unknown operator: %.*s %.*s %.*s",
-                            left_type.length, left_type.buffer, op.length,
-                            op.buffer, right_type.length, right_type.buffer));
-  }
+  String op_str = operator_strings[op];
+  String left_type = object_type_strings[l];
+  String right_type = object_type_strings[r];
+  error_object(result, arena,
+               string_fmt(arena,
+                          l == r
+                              ? "unknown operator: %.*s %.*s %.*s"
+                              : "type mismatch: %.*s %.*s %.*s",
+                          left_type.length, left_type.buffer, op_str.length,
+                          op_str.buffer, right_type.length, right_type.buffer));
 }
 
-void eval_null_infix_expression(Arena *arena, Object *result, String op) {
-  if (string_cmp(op, String("=="))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = true;
-  } else if (string_cmp(op, String("!="))) {
-    result->type = OBJECT_BOOLEAN;
-    result->data.boolean_object.value = false;
-  } else {
-    error_object(result, string_fmt(arena, "unknown operator: null %.*s null",
-                                    op.length, op.buffer));
-  }
-}
-
-void eval_block_statement(Arena *arena, Arena *env_arena, Environment *env,
-                          Object *result, BlockStatement *block) {
-  StatementIterator iter = {0};
-  statement_iterator_init(&iter, block->first_chunk);
+void eval_block_statement(Arena *arena, Gc *gc, Environment *env,
+                          Object *result, Ast *ast, NodeIndex block) {
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(ast, ast_node(ast, block)->lhs, &length);
 
-  Statement *s;
-  while ((s = statement_iterator_next(&iter))) {
-    eval_statement(arena, env_arena, env, result, s);
-    if (result->type == OBJECT_RETURN || result->type == OBJECT_ERROR) {
+  TempArenaMemory temp = temp_arena_memory_begin(arena);
+  for (uint32_t i = 0; i < length; ++i) {
+    eval_statement(arena, gc, env, result, ast, statements[i]);
+    eval_end_scope(temp, result);
+    ObjectType type = object_type(result);
+    if (type == OBJECT_RETURN || type == OBJECT_ERROR) {
       break;
     }
   }
 }
 
-bool object_is_truthy(Object o) {
-  switch (o.type) {
-  case OBJECT_NULL:
-    return false;
+/**
+ * Releases everything allocated in `temp`'s arena since it began, keeping
+ * `result` valid. Errors and return values may point into that memory, but
+ * they also stop evaluation of the enclosing block, so they are simply kept.
+ */
+void eval_end_scope(TempArenaMemory temp, Object *result) {
+  switch (object_type(result)) {
+  case OBJECT_INTEGER: {
+    // may be boxed in the memory being released
+    int64_t value = object_integer(result);
+    temp_arena_memory_end(temp);
+    integer_object(result, temp.arena, value);
+  } break;
   case OBJECT_BOOLEAN:
-    return o.data.boolean_object.value;
-  default:
-    return true;
+  case OBJECT_NULL:
+    temp_arena_memory_end(temp);
+    break;
+  case OBJECT_RETURN:
+  case OBJECT_ERROR:
+    break;
   }
 }
-
-void error_object(Object *result, String message) {
-  result->type = OBJECT_ERROR;
-  result->data.error_object.message = message;
-}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include "object.c"
+#include <assert.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * A mark-and-sweep heap for values that outlive a single evaluation: the
+ * values bound in an `Environment` or in the VM's globals. Everything else
+ * stays in the per-line arena, which the collector never scans, so a value
+ * moves into the heap only through `gc_object_copy`. Heap values reference
+ * nothing but other heap memory.
+ *
+ * The collector is precise. Owners register a root callback once
+ * (`gc_add_root`), and each collection calls it to mark what is live. A
+ * collection runs before an allocation once `bytes_allocated` reaches
+ * `next_collection`. After a collection, the next one is scheduled at
+ * `GC_HEAP_GROW_FACTOR` times the surviving bytes, and never below
+ * `threshold`.
+ */
+typedef struct Gc Gc;
+
+typedef void (*GcMarkRoots)(Gc *gc, void *context);
+
+typedef struct GcRoot {
+  GcMarkRoots mark;
+  void *context;
+} GcRoot;
+
+typedef struct GcHeader {
+  struct GcHeader *next;
+  size_t size;
+  bool marked;
+} GcHeader;
+
+typedef struct GcStats {
+  size_t collections;
+  size_t objects_allocated; // currently in the heap, garbage included
+  size_t bytes_allocated;
+  size_t objects_freed; // over the lifetime of the heap
+  size_t bytes_freed;
+} GcStats;
+
+#define GC_MAX_ROOTS 8
+#define GC_DEFAULT_THRESHOLD (1024 * 1024)
+#define GC_HEAP_GROW_FACTOR 2
+
+struct Gc {
+  GcHeader *objects;
+  size_t threshold;
+  size_t next_collection;
+  GcStats stats;
+  GcRoot roots[GC_MAX_ROOTS];
+  size_t roots_len;
+  jmp_buf *out_of_memory; // as for `Arena`
+};
+
+void gc_mark_object(Gc *gc, const Object *object);
+void gc_object_copy_uncollected(Gc *gc, Object *dst, const Object *src);
+
+void gc_init(Gc *gc, size_t threshold) {
+  gc->objects = NULL;
+  gc->threshold = threshold;
+  gc->next_collection = threshold;
+  gc->stats = (GcStats){0};
+  gc->roots_len = 0;
+  gc->out_of_memory = NULL;
+}
+
+void gc_add_root(Gc *gc, GcMarkRoots mark, void *context) {
+  assert(gc->roots_len < GC_MAX_ROOTS && "too many GC roots");
+  gc->roots[gc->roots_len++] = (GcRoot){.mark = mark, .context = context};
+}
+
+GcHeader *gc_header(const void *ptr) { return (GcHeader *)ptr - 1; }
+
+/**
+ * Marks an allocation made with `gc_alloc` as live. Returns false if it
+ * already was, so that callers can stop tracing.
+ */
+bool gc_mark(const void *ptr) {
+  GcHeader *header = gc_header(ptr);
+  if (header->marked) {
+    return false;
+  }
+  header->marked = true;
+  return true;
+}
+
+/**
+ * Marks what an error or return value owns. Both representations keep their
+ * payload in `ObjectData`; only where that lives differs.
+ */
+void gc_mark_data(Gc *gc, ObjectType type, const ObjectData *data) {
+  switch (type) {
+  case OBJECT_ERROR:
+    if (data->error_object.message.length > 0) {
+      gc_mark(data->error_object.message.buffer);
+    }
+    break;
+  case OBJECT_RETURN:
+    if (gc_mark(data->return_object.value)) {
+      gc_mark_object(gc, data->return_object.value);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void gc_mark_object(Gc *gc, const Object *object) {
+#ifdef OBJECT_COMPACT
+  if (!object_is_heap(object) || !object_heap(object)->gc_owned) {
+    return;
+  }
+  HeapObject *heap = object_heap(object);
+  if (gc_mark(heap)) {
+    gc_mark_data(gc, heap->type, &heap->data);
+  }
+#else
+  if (object->gc_owned) {
+    gc_mark_data(gc, object->type, &object->data);
+  }
+#endif
+}
+
+void gc_sweep(Gc *gc) {
+  GcHeader **link = &gc->objects;
+  while (*link) {
+    GcHeader *header = *link;
+    if (header->marked) {
+      header->marked = false;
+      link = &header->next;
+      continue;
+    }
+
+    *link = header->next;
+    gc->stats.objects_allocated--;
+    gc->stats.bytes_allocated -= header->size;
+    gc->stats.objects_freed++;
+    gc->stats.bytes_freed += header->size;
+    free(header);
+  }
+}
+
+void gc_collect(Gc *gc) {
+  for (size_t i = 0; i < gc->roots_len; ++i) {
+    gc->roots[i].mark(gc, gc->roots[i].context);
+  }
+  gc_sweep(gc);
+
+  gc->stats.collections++;
+  gc->next_collection = gc->stats.bytes_allocated * GC_HEAP_GROW_FACTOR;
+  if (gc->next_collection < gc->threshold) {
+    gc->next_collection = gc->threshold;
+  }
+}
+
+/**
+ * Collects if the heap has grown past `next_collection`. Anything that is
+ * only reachable from outside the roots must not be used afterwards.
+ */
+void gc_collect_if_needed(Gc *gc, size_t size) {
+  if (gc->stats.bytes_allocated + size >= gc->next_collection) {
+    gc_collect(gc);
+  }
+}
+
+/**
+ * Allocates without collecting, for use while a value is being built and
+ * is not yet reachable from a root.
+ */
+void *gc_alloc_uncollected(Gc *gc, size_t size) {
+  GcHeader *header = calloc(1, sizeof(GcHeader) + size);
+  if (!header) {
+    if (gc->out_of_memory) {
+      longjmp(*gc->out_of_memory, 1);
+    }
+    fprintf(stderr, "ERROR: failed to allocate %zu bytes of GC heap\n",
+            size);
+    return NULL;
+  }
+
+  header->size = size;
+  header->next = gc->objects;
+  gc->objects = header;
+  gc->stats.objects_allocated++;
+  gc->stats.bytes_allocated += size;
+  return header + 1;
+}
+
+/**
+ * Returns `size` zeroed bytes owned by the heap, collecting first if needed.
+ */
+void *gc_alloc(Gc *gc, size_t size) {
+  gc_collect_if_needed(gc, size);
+  return gc_alloc_uncollected(gc, size);
+}
+
+/**
+ * Frees every allocation, reachable or not.
+ */
+void gc_release(Gc *gc) {
+  GcHeader *header = gc->objects;
+  while (header) {
+    GcHeader *next = header->next;
+    free(header);
+    header = next;
+  }
+  gc_init(gc, gc->threshold);
+}
+
+/**
+ * Replaces the payload of an error or return value with a copy in `gc`.
+ */
+void gc_data_copy_uncollected(Gc *gc, ObjectType type, ObjectData *data) {
+  switch (type) {
+  case OBJECT_ERROR: {
+    String message = data->error_object.message;
+    if (message.length > 0) {
+      char *buffer = gc_alloc_uncollected(gc, message.length);
+      memcpy(buffer, message.buffer, message.length);
+      data->error_object.message.buffer = buffer;
+    }
+  } break;
+  case OBJECT_RETURN: {
+    Object *value = gc_alloc_uncollected(gc, sizeof(Object));
+    gc_object_copy_uncollected(gc, value, data->return_object.value);
+    data->return_object.value = value;
+  } break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Like `object_copy`, but moves any heap payload of `src` into `gc`. May
+ * collect first; `src` must survive that, i.e. be rooted or live outside the
+ * heap. `dst` is only overwritten once the copy is complete.
+ */
+void gc_object_copy(Gc *gc, Object *dst, const Object *src) {
+#ifdef OBJECT_COMPACT
+  if (!object_is_heap(src)) {
+    dst->bits = src->bits;
+    return;
+  }
+
+  gc_collect_if_needed(gc, sizeof(HeapObject));
+#else
+  if (src->type == OBJECT_ERROR || src->type == OBJECT_RETURN) {
+    gc_collect_if_needed(gc, sizeof(Object));
+  }
+#endif
+  gc_object_copy_uncollected(gc, dst, src);
+}
+
+void gc_object_copy_uncollected(Gc *gc, Object *dst, const Object *src) {
+#ifdef OBJECT_COMPACT
+  if (!object_is_heap(src)) {
+    dst->bits = src->bits;
+    return;
+  }
+
+  HeapObject *heap = gc_alloc_uncollected(gc, sizeof(HeapObject));
+  memcpy(heap, object_heap(src), sizeof(HeapObject));
+  heap->gc_owned = true;
+  gc_data_copy_uncollected(gc, heap->type, &heap->data);
+  dst->bits = (uint64_t)(uintptr_t)heap | OBJECT_TAG_HEAP;
+#else
+  Object copy = *src;
+  copy.gc_owned = true;
+  gc_data_copy_uncollected(gc, copy.type, &copy.data);
+  *dst = copy;
+#endif
+}
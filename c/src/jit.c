@@ -0,0 +1,468 @@
+#pragma once
+
+#include "ast.c"
+#include "mem.c"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// a template JIT for integer expressions
+//
+// Expressions made only of integer and boolean literals, global names,
+// prefix and infix operators and `if`s whose branches are such expressions
+// are translated, node by node, into x86-64 machine code. The code works on
+// plain 64-bit integers, with booleans as 0 or 1; names are read from an
+// array of arguments that the caller fills in after checking that each name
+// is bound to an integer. Whatever the code cannot handle itself, such as a
+// division by zero, makes it bail out, and the caller then evaluates the
+// expression the ordinary way. Elsewhere, `jit_compile` always fails.
+
+#define JIT_CODE_SIZE ((size_t)16 << 20)
+#define JIT_MAX_ARGUMENTS 16
+#define JIT_MAX_NODES 256
+
+/**
+ * Runs compiled code. Returns 0 after storing the value in `*result`, or
+ * nonzero if it bailed out.
+ */
+typedef int (*JitFn)(const int64_t *arguments, int64_t *result);
+
+/** Compiled code for one expression. */
+typedef struct JitCode {
+  JitFn run;
+  const uint32_t *slots; // the global slot read into each argument
+  uint32_t slots_len;
+  bool boolean; // whether the result is a boolean rather than an integer
+} JitCode;
+
+/**
+ * Executable memory shared by everything compiled for one program. Each
+ * piece of code is listed in `/tmp/perf-<pid>.map` so that `perf` can name
+ * it in profiles.
+ */
+typedef struct Jit {
+  uint8_t *code;
+  size_t capacity;
+  size_t length;
+  uint32_t compiled; // pieces of code so far, to name them
+  FILE *perf_map;
+} Jit;
+
+typedef enum JitType {
+  JIT_NONE, // not compilable
+  JIT_INTEGER,
+  JIT_BOOLEAN,
+} JitType;
+
+/** Reserves the code memory. Returns false if there is no JIT here. */
+bool jit_init(Jit *jit) {
+  *jit = (Jit){0};
+#ifdef JIT_X86_64
+  void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    return false;
+  }
+  jit->code = code;
+  jit->capacity = JIT_CODE_SIZE;
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+  jit->perf_map = fopen(path, "a"); // profiling is optional
+  return true;
+#else
+  return false;
+#endif
+}
+
+void jit_release(Jit *jit) {
+#ifdef JIT_X86_64
+  if (jit->code) {
+    munmap(jit->code, jit->capacity);
+  }
+  if (jit->perf_map) {
+    fclose(jit->perf_map);
+  }
+#endif
+  *jit = (Jit){0};
+}
+
+/**
+ * Frees all compiled code for reuse. Nothing compiled before may run again.
+ */
+void jit_reset(Jit *jit) { jit->length = 0; }
+
+/**
+ * Makes the code memory writable, for a batch of `jit_compile`s. No code may
+ * run until `jit_end`.
+ */
+bool jit_begin(Jit *jit) {
+#ifdef JIT_X86_64
+  return jit->code &&
+         mprotect(jit->code, jit->capacity, PROT_READ | PROT_WRITE) == 0;
+#else
+  (void)jit;
+  return false;
+#endif
+}
+
+/** Makes the code memory executable again. */
+void jit_end(Jit *jit) {
+#ifdef JIT_X86_64
+  if (jit->code &&
+      mprotect(jit->code, jit->capacity, PROT_READ | PROT_EXEC) != 0) {
+    // nothing compiled in the batch can run; drop all of it
+    munmap(jit->code, jit->capacity);
+    jit->code = NULL;
+  }
+#else
+  (void)jit;
+#endif
+}
+
+// `jit_type`, giving up after `*budget` nodes
+JitType jit_type_within(const Ast *ast, NodeIndex expression,
+                        uint32_t *budget) {
+  if (*budget == 0) {
+    return JIT_NONE;
+  }
+  --*budget;
+  const Node *node = ast_node(ast, expression);
+  switch (node->type) {
+  case NODE_INTEGER:
+    return JIT_INTEGER;
+  case NODE_BOOLEAN:
+    return JIT_BOOLEAN;
+  case NODE_IDENTIFIER:
+    return node->resolved && node->depth == 0 ? JIT_INTEGER : JIT_NONE;
+  case NODE_PREFIX: {
+    JitType operand = jit_type_within(ast, node->lhs, budget);
+    if (node->operator == OPERATOR_MINUS) {
+      return operand == JIT_INTEGER ? JIT_INTEGER : JIT_NONE;
+    }
+    return operand == JIT_NONE ? JIT_NONE : JIT_BOOLEAN;
+  }
+  case NODE_INFIX: {
+    JitType left = jit_type_within(ast, node->lhs, budget);
+    if (left == JIT_NONE) {
+      return JIT_NONE;
+    }
+    JitType right = jit_type_within(ast, node->rhs, budget);
+    bool equality =
+        node->operator == OPERATOR_EQ || node->operator == OPERATOR_NOT_EQ;
+    if (left == JIT_BOOLEAN && right == JIT_BOOLEAN) {
+      return equality ? JIT_BOOLEAN : JIT_NONE;
+    }
+    if (left != JIT_INTEGER || right != JIT_INTEGER) {
+      return JIT_NONE;
+    }
+    return equality || node->operator == OPERATOR_LT ||
+                   node->operator == OPERATOR_GT
+               ? JIT_BOOLEAN
+               : JIT_INTEGER;
+  }
+  case NODE_IF: {
+    // without both branches the value may be null
+    NodeIndex blocks[] = {ast_if_consequence(ast, node),
+                          ast_if_alternative(ast, node)};
+    if (blocks[1] == NODE_NONE ||
+        jit_type_within(ast, node->lhs, budget) == JIT_NONE) {
+      return JIT_NONE;
+    }
+    JitType types[2];
+    for (size_t i = 0; i < 2; ++i) {
+      uint32_t length;
+      const NodeIndex *statements =
+          ast_list(ast, ast_node(ast, blocks[i])->lhs, &length);
+      types[i] = length > 0 ? JIT_INTEGER : JIT_NONE;
+      for (uint32_t j = 0; j < length && types[i] != JIT_NONE; ++j) {
+        const Node *statement = ast_node(ast, statements[j]);
+        types[i] = statement->type == NODE_EXPRESSION_STATEMENT
+                       ? jit_type_within(ast, statement->lhs, budget)
+                       : JIT_NONE;
+      }
+    }
+    return types[0] == types[1] ? types[0] : JIT_NONE;
+  }
+  default:
+    return JIT_NONE;
+  }
+}
+
+/**
+ * The type of value `expression` produces if it can be compiled, assuming
+ * that every name it reads is bound to an integer. Combinations that would
+ * be errors at run time are left to the evaluator, and expressions of more
+ * than `JIT_MAX_NODES` nodes are not compiled, so that trying every subtree
+ * of a deep expression stays linear.
+ */
+JitType jit_type(const Ast *ast, NodeIndex expression) {
+  uint32_t budget = JIT_MAX_NODES;
+  return jit_type_within(ast, expression, &budget);
+}
+
+#ifdef JIT_X86_64
+
+/** Where code for one expression is being written. */
+typedef struct JitEmitter {
+  Jit *jit;
+  size_t bail; // offset of the code that bails out
+  bool full;
+  uint32_t *slots;
+  uint32_t slots_len;
+} JitEmitter;
+
+void jit_emit(JitEmitter *e, const uint8_t *bytes, size_t length) {
+  Jit *jit = e->jit;
+  if (jit->capacity - jit->length < length) {
+    e->full = true;
+    return;
+  }
+  memcpy(jit->code + jit->length, bytes, length);
+  jit->length += length;
+}
+
+#define JIT_EMIT(e, ...)                                                       \
+  jit_emit((e), (const uint8_t[]){__VA_ARGS__},                                \
+           sizeof((const uint8_t[]){__VA_ARGS__}))
+
+void jit_emit_u32(JitEmitter *e, uint32_t value) {
+  uint8_t bytes[4];
+  memcpy(bytes, &value, sizeof(bytes));
+  jit_emit(e, bytes, sizeof(bytes));
+}
+
+void jit_emit_u64(JitEmitter *e, uint64_t value) {
+  uint8_t bytes[8];
+  memcpy(bytes, &value, sizeof(bytes));
+  jit_emit(e, bytes, sizeof(bytes));
+}
+
+// the offset of the 32-bit displacement of a jump just emitted
+size_t jit_jump_site(const JitEmitter *e) { return e->jit->length - 4; }
+
+// points the jump at `site` to `target`
+void jit_patch(JitEmitter *e, size_t site, size_t target) {
+  if (e->full) {
+    return;
+  }
+  int32_t displacement = (int32_t)((int64_t)target - (int64_t)(site + 4));
+  memcpy(e->jit->code + site, &displacement, sizeof(displacement));
+}
+
+// jumps to the bail-out code if the last comparison was equal
+void jit_emit_bail_if_equal(JitEmitter *e) {
+  JIT_EMIT(e, 0x0f, 0x84); // je rel32
+  jit_emit_u32(e, 0);
+  jit_patch(e, jit_jump_site(e), e->bail);
+}
+
+// the argument index for a global slot, adding it if it is new
+bool jit_argument(JitEmitter *e, uint32_t slot, uint32_t *index) {
+  for (*index = 0; *index < e->slots_len; ++*index) {
+    if (e->slots[*index] == slot) {
+      return true;
+    }
+  }
+  if (e->slots_len == JIT_MAX_ARGUMENTS) {
+    return false;
+  }
+  e->slots[e->slots_len++] = slot;
+  return true;
+}
+
+/**
+ * Emits code that leaves the value of `expression` in rax, using rcx and
+ * rdx as scratch and the stack for pending left operands. rdi points to the
+ * arguments.
+ */
+bool jit_emit_expression(JitEmitter *e, const Ast *ast, NodeIndex expression);
+
+bool jit_emit_block(JitEmitter *e, const Ast *ast, NodeIndex block) {
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(ast, ast_node(ast, block)->lhs, &length);
+  for (uint32_t i = 0; i < length; ++i) {
+    // earlier values are dropped, but may still bail out
+    if (!jit_emit_expression(e, ast, ast_node(ast, statements[i])->lhs)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool jit_emit_expression(JitEmitter *e, const Ast *ast, NodeIndex expression) {
+  const Node *node = ast_node(ast, expression);
+  switch (node->type) {
+  case NODE_INTEGER:
+    JIT_EMIT(e, 0x48, 0xb8); // mov rax, imm64
+    jit_emit_u64(e, (uint64_t)ast_integer_value(node));
+    return true;
+  case NODE_BOOLEAN:
+    JIT_EMIT(e, 0xb8); // mov eax, imm32
+    jit_emit_u32(e, node->lhs ? 1 : 0);
+    return true;
+  case NODE_IDENTIFIER: {
+    uint32_t index;
+    if (!jit_argument(e, node->rhs, &index)) {
+      return false;
+    }
+    JIT_EMIT(e, 0x48, 0x8b, 0x87); // mov rax, [rdi + disp32]
+    jit_emit_u32(e, index * sizeof(int64_t));
+    return true;
+  }
+  case NODE_PREFIX:
+    if (!jit_emit_expression(e, ast, node->lhs)) {
+      return false;
+    }
+    if (node->operator == OPERATOR_MINUS) {
+      JIT_EMIT(e, 0x48, 0xf7, 0xd8); // neg rax
+    } else if (jit_type(ast, node->lhs) == JIT_BOOLEAN) {
+      JIT_EMIT(e, 0x83, 0xf0, 0x01); // xor eax, 1
+    } else {
+      JIT_EMIT(e, 0x31, 0xc0); // xor eax, eax; see `object_is_truthy`
+    }
+    return true;
+  case NODE_INFIX:
+    if (!jit_emit_expression(e, ast, node->lhs)) {
+      return false;
+    }
+    JIT_EMIT(e, 0x50); // push rax
+    if (!jit_emit_expression(e, ast, node->rhs)) {
+      return false;
+    }
+    JIT_EMIT(e, 0x48, 0x89, 0xc1, // mov rcx, rax
+             0x58);               // pop rax
+    switch ((Operator)node->operator) {
+    case OPERATOR_PLUS:
+      JIT_EMIT(e, 0x48, 0x01, 0xc8); // add rax, rcx
+      break;
+    case OPERATOR_MINUS:
+      JIT_EMIT(e, 0x48, 0x29, 0xc8); // sub rax, rcx
+      break;
+    case OPERATOR_ASTERISK:
+      JIT_EMIT(e, 0x48, 0x0f, 0xaf, 0xc1); // imul rax, rcx
+      break;
+    case OPERATOR_SLASH:
+      // dividing by 0, or -1 which can overflow, is left to the evaluator
+      JIT_EMIT(e, 0x48, 0x85, 0xc9); // test rcx, rcx
+      jit_emit_bail_if_equal(e);
+      JIT_EMIT(e, 0x48, 0x83, 0xf9, 0xff); // cmp rcx, -1
+      jit_emit_bail_if_equal(e);
+      JIT_EMIT(e, 0x48, 0x99,        // cqo
+               0x48, 0xf7, 0xf9);    // idiv rcx
+      break;
+    case OPERATOR_LT:
+    case OPERATOR_GT:
+    case OPERATOR_EQ:
+    case OPERATOR_NOT_EQ: {
+      static const uint8_t setcc[OPERATOR_COUNT] = {
+          [OPERATOR_LT] = 0x9c,
+          [OPERATOR_GT] = 0x9f,
+          [OPERATOR_EQ] = 0x94,
+          [OPERATOR_NOT_EQ] = 0x95,
+      };
+      JIT_EMIT(e, 0x48, 0x39, 0xc8,                  // cmp rax, rcx
+               0x0f, setcc[node->operator], 0xc0,   // setcc al
+               0x0f, 0xb6, 0xc0);                    // movzx eax, al
+    } break;
+    default:
+      return false;
+    }
+    return true;
+  case NODE_IF: {
+    if (!jit_emit_expression(e, ast, node->lhs)) {
+      return false;
+    }
+    if (jit_type(ast, node->lhs) == JIT_INTEGER) {
+      // the consequence always runs; see `object_is_truthy`
+      return jit_emit_block(e, ast, ast_if_consequence(ast, node));
+    }
+    JIT_EMIT(e, 0x48, 0x85, 0xc0, // test rax, rax
+             0x0f, 0x84);         // jz rel32
+    jit_emit_u32(e, 0);
+    size_t to_alternative = jit_jump_site(e);
+    if (!jit_emit_block(e, ast, ast_if_consequence(ast, node))) {
+      return false;
+    }
+    JIT_EMIT(e, 0xe9); // jmp rel32
+    jit_emit_u32(e, 0);
+    size_t to_end = jit_jump_site(e);
+    jit_patch(e, to_alternative, e->jit->length);
+    if (!jit_emit_block(e, ast, ast_if_alternative(ast, node))) {
+      return false;
+    }
+    jit_patch(e, to_end, e->jit->length);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+#endif
+
+/**
+ * Compiles `expression`, whose names must have been resolved, into `code`,
+ * allocating the list of arguments in `arena`. Must be called between
+ * `jit_begin` and `jit_end`. Fails if `expression` is not made only of what
+ * `jit_type` accepts, reads too many names, or does not fit.
+ */
+bool jit_compile(Jit *jit, Arena *arena, const Ast *ast, NodeIndex expression,
+                 JitCode *code) {
+  JitType type = jit_type(ast, expression);
+  if (type == JIT_NONE || !jit->code) {
+    return false;
+  }
+#ifdef JIT_X86_64
+  size_t start = jit->length;
+  JitEmitter e = {
+      .jit = jit,
+      .slots = arena_alloc(arena, JIT_MAX_ARGUMENTS * sizeof(uint32_t)),
+  };
+  // bailing out drops any pending operands
+  e.bail = jit->length;
+  JIT_EMIT(&e, 0x48, 0x89, 0xdc,              // mov rsp, rbx
+           0x5b,                              // pop rbx
+           0xb8, 0x01, 0x00, 0x00, 0x00,      // mov eax, 1
+           0xc3);                             // ret
+  size_t entry = jit->length;
+  JIT_EMIT(&e, 0x53,                          // push rbx
+           0x48, 0x89, 0xe3);                 // mov rbx, rsp
+  bool ok = jit_emit_expression(&e, ast, expression);
+  JIT_EMIT(&e, 0x48, 0x89, 0x06,              // mov [rsi], rax
+           0x31, 0xc0,                        // xor eax, eax
+           0x5b,                              // pop rbx
+           0xc3);                             // ret
+  if (!ok || e.full) {
+    jit->length = start;
+    return false;
+  }
+  // ISO C has no conversion from object to function pointers; POSIX does
+  void *address = jit->code + entry;
+  memcpy(&code->run, &address, sizeof(code->run));
+  code->slots = e.slots;
+  code->slots_len = e.slots_len;
+  code->boolean = type == JIT_BOOLEAN;
+
+  if (jit->perf_map) {
+    fprintf(jit->perf_map, "%" PRIxPTR " %zx monkey_jit_%" PRIu32 "\n",
+            (uintptr_t)(jit->code + start), jit->length - start,
+            jit->compiled);
+    fflush(jit->perf_map);
+  }
+  ++jit->compiled;
+  return true;
+#else
+  (void)arena;
+  (void)code;
+  return false;
+#endif
+}
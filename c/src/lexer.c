@@ -1,13 +1,33 @@
 #pragma once
 
+#include "mem.c"
+#include "strconv.c"
 #include "string.c"
 #include "token.c"
+#include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+/**
+ * If `strings` is set, identifiers and keywords are interned in it and the
+ * token's `symbol` is filled in. A keyword is then recognised by comparing
+ * strings only the first time the table sees it.
+ *
+ * A lexer made with `lexer_init_chunked` owns `buffer` and is fed input with
+ * `lexer_feed`. Until `lexer_finish` is called, a token that might continue
+ * in the next chunk is not returned; TOKEN_NEED_INPUT is returned instead and
+ * the lexer stays where that token starts.
+ */
 typedef struct Lexer {
   String buffer;
   size_t pos;
+  StringTable *strings;
+  size_t capacity; // of `buffer`, if owned
+  size_t mark;     // `lexer_feed` keeps everything from here on
+  bool finished;   // no input will follow what is in `buffer`
 } Lexer;
 
 Token lexer_next_token(Lexer *lexer);
@@ -18,88 +38,206 @@ char lexer_peek_char(const Lexer *lexer);
 void lexer_advance(Lexer *lexer);
 void lexer_skip_whitespace(Lexer *lexer);
 
+typedef enum CharClass {
+  CHAR_INVALID,
+  CHAR_END, // the NUL terminator
+  CHAR_WHITESPACE,
+  CHAR_LETTER,
+  CHAR_DIGIT,
+  CHAR_PUNCTUATION, // a token on its own, see `punctuation_tokens`
+  CHAR_OPERATOR,    // may start a two-character token: `=` and `!`
+} CharClass;
+
+// clang-format off
+#define E CHAR_END
+#define W CHAR_WHITESPACE
+#define L CHAR_LETTER
+#define D CHAR_DIGIT
+#define P CHAR_PUNCTUATION
+#define O CHAR_OPERATOR
+#define _ CHAR_INVALID
+const uint8_t char_classes[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    E, _, _, _, _, _, _, _, _, W, W, _, _, W, _, _, // 0x00
+    _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, _, // 0x10
+    W, O, _, _, _, _, _, _, P, P, P, P, P, P, _, P, // 0x20  !()*+,-/
+    D, D, D, D, D, D, D, D, D, D, _, P, P, O, P, _, // 0x30  0-9;<=>
+    _, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, // 0x40  A-O
+    L, L, L, L, L, L, L, L, L, L, L, _, _, _, _, L, // 0x50  P-Z_
+    _, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, // 0x60  a-o
+    L, L, L, L, L, L, L, L, L, L, L, P, _, P, _, _, // 0x70  p-z{}
+    // 0x80-0xFF: invalid
+};
+#undef E
+#undef W
+#undef L
+#undef D
+#undef P
+#undef O
+#undef _
+// clang-format on
+
+const TokenType punctuation_tokens[256] = {
+    ['+'] = TOKEN_PLUS,      ['-'] = TOKEN_MINUS,     ['*'] = TOKEN_ASTERISK,
+    ['/'] = TOKEN_SLASH,     ['<'] = TOKEN_LT,        ['>'] = TOKEN_GT,
+    [','] = TOKEN_COMMA,     [';'] = TOKEN_SEMICOLON, ['('] = TOKEN_LPAREN,
+    [')'] = TOKEN_RPAREN,    ['{'] = TOKEN_LBRACE,    ['}'] = TOKEN_RBRACE,
+};
+
+CharClass char_class(char c) { return char_classes[(unsigned char)c]; }
+
+/**
+ * `input` must be NUL-terminated. The terminator is the sentinel that ends
+ * every scanning loop, so the lexer never checks positions against the
+ * length.
+ */
 void lexer_init(Lexer *lexer, char *input) {
   lexer->buffer = String(input);
   lexer->pos = 0;
+  lexer->strings = NULL;
+  lexer->capacity = 0;
+  lexer->mark = 0;
+  lexer->finished = true;
+}
+
+/**
+ * Initializes a lexer whose input arrives through `lexer_feed`. Release it
+ * with `lexer_release`.
+ */
+void lexer_init_chunked(Lexer *lexer) {
+  lexer_init(lexer, "");
+  lexer->finished = false;
+}
+
+/**
+ * Appends `length` bytes of input, which must not contain NUL. Input before
+ * `mark` is discarded first, so tokens lexed before it are invalidated;
+ * parsers move `mark` to the start of the statement they are working on.
+ * Returns false if the buffer could not grow.
+ */
+bool lexer_feed(Lexer *lexer, const char *chunk, size_t length) {
+  assert(!lexer->finished && "lexer_feed after lexer_finish");
+
+  size_t kept = lexer->buffer.length - lexer->mark;
+  if (kept + length + 1 > lexer->capacity) {
+    size_t capacity = lexer->capacity ? lexer->capacity : 4096;
+    while (capacity < kept + length + 1) {
+      capacity *= 2;
+    }
+    char *buffer = malloc(capacity);
+    if (!buffer) {
+      return false;
+    }
+    memcpy(buffer, lexer->buffer.buffer + lexer->mark, kept);
+    if (lexer->capacity) {
+      free(lexer->buffer.buffer);
+    }
+    lexer->buffer.buffer = buffer;
+    lexer->capacity = capacity;
+  } else {
+    memmove(lexer->buffer.buffer, lexer->buffer.buffer + lexer->mark, kept);
+  }
+
+  memcpy(lexer->buffer.buffer + kept, chunk, length);
+  lexer->buffer.buffer[kept + length] = '\0';
+  lexer->buffer.length = kept + length;
+  lexer->pos -= lexer->mark;
+  lexer->mark = 0;
+  return true;
+}
+
+/**
+ * Marks the end of the input: tokens at the end of the buffer are complete,
+ * and the terminator after them is TOKEN_EOF.
+ */
+void lexer_finish(Lexer *lexer) { lexer->finished = true; }
+
+void lexer_release(Lexer *lexer) {
+  if (lexer->capacity) {
+    free(lexer->buffer.buffer);
+  }
+  lexer_init(lexer, "");
+}
+
+/**
+ * Rewinds to `pos` and returns TOKEN_NEED_INPUT, with an empty literal there.
+ */
+Token lexer_need_input(Lexer *lexer, size_t pos) {
+  lexer->pos = pos;
+  return (Token){
+      .type = TOKEN_NEED_INPUT,
+      .literal = {.buffer = lexer->buffer.buffer + pos, .length = 0},
+  };
+}
+
+// whether a scan stopped at the end of the input fed so far, rather than at
+// the end of the token
+bool lexer_at_chunk_end(const Lexer *lexer) {
+  return !lexer->finished && lexer->pos == lexer->buffer.length;
 }
 
 Token lexer_next_token(Lexer *lexer) {
   lexer_skip_whitespace(lexer);
 
+  size_t pos = lexer->pos;
+  char *start = lexer->buffer.buffer + pos;
   Token token = {.type = TOKEN_ILLEGAL,
-                 .literal =
-                     string_slice(lexer->buffer, lexer->pos, lexer->pos + 1)};
-
-  char current = lexer_current_char(lexer);
-  switch (current) {
-  case '=':
-    if (lexer_peek_char(lexer) == '=') {
-      token.type = TOKEN_EQ;
-      token.literal = string_slice(lexer->buffer, lexer->pos, lexer->pos + 2);
-      lexer_advance(lexer);
-    } else {
-      token.type = TOKEN_ASSIGN;
-    }
-    break;
-  case '+':
-    token.type = TOKEN_PLUS;
-    break;
-  case '-':
-    token.type = TOKEN_MINUS;
-    break;
-  case '!':
-    if (lexer_peek_char(lexer) == '=') {
-      token.type = TOKEN_NOT_EQ;
-      token.literal = string_slice(lexer->buffer, lexer->pos, lexer->pos + 2);
-      lexer_advance(lexer);
-    } else {
-      token.type = TOKEN_BANG;
+                 .literal = (String){.buffer = start, .length = 1}};
+
+  switch (char_class(*start)) {
+  case CHAR_END:
+    if (!lexer->finished) {
+      return lexer_need_input(lexer, pos);
     }
-    break;
-  case '/':
-    token.type = TOKEN_SLASH;
-    break;
-  case '*':
-    token.type = TOKEN_ASTERISK;
-    break;
-  case '<':
-    token.type = TOKEN_LT;
-    break;
-  case '>':
-    token.type = TOKEN_GT;
-    break;
-  case ';':
-    token.type = TOKEN_SEMICOLON;
-    break;
-  case '(':
-    token.type = TOKEN_LPAREN;
-    break;
-  case ')':
-    token.type = TOKEN_RPAREN;
-    break;
-  case ',':
-    token.type = TOKEN_COMMA;
-    break;
-  case '{':
-    token.type = TOKEN_LBRACE;
-    break;
-  case '}':
-    token.type = TOKEN_RBRACE;
-    break;
-  case 0:
+    // stay on the terminator so that later calls keep returning EOF
     token.type = TOKEN_EOF;
     token.literal = String("");
+    return token;
+  case CHAR_PUNCTUATION:
+    token.type = punctuation_tokens[(unsigned char)*start];
     break;
-  default:
-    if (is_letter(current)) {
-      token.literal = lexer_read_identifier(lexer);
+  case CHAR_OPERATOR: {
+    if (start[1] == '\0' && !lexer->finished) {
+      return lexer_need_input(lexer, pos);
+    }
+    bool followed_by_equals = start[1] == '=';
+    if (*start == '=') {
+      token.type = followed_by_equals ? TOKEN_EQ : TOKEN_ASSIGN;
+    } else {
+      token.type = followed_by_equals ? TOKEN_NOT_EQ : TOKEN_BANG;
+    }
+    if (followed_by_equals) {
+      token.literal.length = 2;
+      lexer_advance(lexer);
+    }
+  } break;
+  case CHAR_LETTER: {
+    token.literal = lexer_read_identifier(lexer);
+    if (lexer_at_chunk_end(lexer)) {
+      return lexer_need_input(lexer, pos);
+    }
+    if (!lexer->strings) {
       token.type = token_type_from_ident(token.literal);
       return token;
-    } else if (is_digit(current)) {
-      token.type = TOKEN_INT;
-      token.literal = lexer_read_number(lexer);
-      return token;
     }
+    InternedString *symbol =
+        string_table_intern(lexer->strings, token.literal);
+    if (!symbol->kind) {
+      symbol->kind = token_type_from_ident(symbol->string);
+    }
+    token.type = symbol->kind;
+    token.symbol = symbol;
+    return token;
+  }
+  case CHAR_DIGIT:
+    token.type = TOKEN_INT;
+    token.literal = lexer_read_number(lexer);
+    if (lexer_at_chunk_end(lexer)) {
+      return lexer_need_input(lexer, pos);
+    }
+    return token;
+  case CHAR_WHITESPACE:
+  case CHAR_INVALID:
     break;
   }
 
@@ -107,43 +245,187 @@ Token lexer_next_token(Lexer *lexer) {
   return token;
 }
 
+// `string_span`'s classes match `char_classes`
+
 String lexer_read_identifier(Lexer *lexer) {
   size_t pos = lexer->pos;
-  while (is_letter(lexer_current_char(lexer))) {
-    lexer_advance(lexer);
-  }
+  lexer->pos += string_span(lexer->buffer.buffer + pos, CHAR_SPAN_LETTERS);
   return string_slice(lexer->buffer, pos, lexer->pos);
 }
 
 String lexer_read_number(Lexer *lexer) {
   size_t pos = lexer->pos;
-  while (is_digit(lexer_current_char(lexer))) {
-    lexer_advance(lexer);
-  }
+  lexer->pos += string_span(lexer->buffer.buffer + pos, CHAR_SPAN_DIGITS);
   return string_slice(lexer->buffer, pos, lexer->pos);
 }
 
-char lexer_char_at_pos(const Lexer *lexer, size_t pos) {
-  if (pos >= lexer->buffer.length) {
-    return 0;
-  }
-  return lexer->buffer.buffer[pos];
-}
-
 char lexer_current_char(const Lexer *lexer) {
-  return lexer_char_at_pos(lexer, lexer->pos);
+  return lexer->buffer.buffer[lexer->pos];
 }
 
+// never reads past the terminator, since the current char is not it
 char lexer_peek_char(const Lexer *lexer) {
-  return lexer_char_at_pos(lexer, lexer->pos + 1);
+  return lexer->buffer.buffer[lexer->pos + 1];
 }
 
 void lexer_advance(Lexer *lexer) { ++lexer->pos; }
 
 void lexer_skip_whitespace(Lexer *lexer) {
-  for (char c = lexer_current_char(lexer);
-       c == ' ' || c == '\t' || c == '\n' || c == '\r';
-       c = lexer_current_char(lexer)) {
-    lexer_advance(lexer);
+  lexer->pos +=
+      string_span(lexer->buffer.buffer + lexer->pos, CHAR_SPAN_WHITESPACE);
+}
+
+/**
+ * A whole input lexed in one pass, as parallel arrays indexed by token. A
+ * token's literal is `lengths[i]` bytes at `input + offsets[i]`. Integers
+ * and identifiers carry a value in a side array, in token order:
+ * `integers` holds the parsed value of every TOKEN_INT and `symbols` the
+ * interned name of every TOKEN_IDENT (keywords keep none). The last token is
+ * TOKEN_EOF, or TOKEN_NEED_INPUT for a chunk-fed lexer that is not finished.
+ */
+typedef struct TokenStream {
+  char *input;
+  uint8_t *types;
+  uint32_t *offsets;
+  uint32_t *lengths;
+  size_t length;
+  size_t capacity;
+  int64_t *integers;
+  size_t integers_length;
+  size_t integers_capacity;
+  const InternedString **symbols;
+  size_t symbols_length;
+  size_t symbols_capacity;
+} TokenStream;
+
+/**
+ * A position in a `TokenStream`, with the side arrays' positions kept in
+ * step as tokens are read in order.
+ */
+typedef struct TokenCursor {
+  size_t token;
+  size_t integer;
+  size_t symbol;
+} TokenCursor;
+
+void token_stream_grow(TokenStream *stream, Arena *arena) {
+  size_t capacity = stream->capacity * 2;
+  stream->types = arena_resize(arena, stream->types,
+                               stream->capacity * sizeof(uint8_t),
+                               capacity * sizeof(uint8_t));
+  stream->offsets = arena_resize(arena, stream->offsets,
+                                 stream->capacity * sizeof(uint32_t),
+                                 capacity * sizeof(uint32_t));
+  stream->lengths = arena_resize(arena, stream->lengths,
+                                 stream->capacity * sizeof(uint32_t),
+                                 capacity * sizeof(uint32_t));
+  stream->capacity = capacity;
+}
+
+void token_stream_append_integer(TokenStream *stream, Arena *arena,
+                                 int64_t value) {
+  if (stream->integers_length == stream->integers_capacity) {
+    size_t capacity = stream->integers_capacity * 2;
+    stream->integers =
+        arena_resize(arena, stream->integers,
+                     stream->integers_capacity * sizeof(int64_t),
+                     capacity * sizeof(int64_t));
+    stream->integers_capacity = capacity;
   }
+  stream->integers[stream->integers_length++] = value;
+}
+
+void token_stream_append_symbol(TokenStream *stream, Arena *arena,
+                                const InternedString *symbol) {
+  if (stream->symbols_length == stream->symbols_capacity) {
+    size_t capacity = stream->symbols_capacity * 2;
+    stream->symbols =
+        arena_resize(arena, stream->symbols,
+                     stream->symbols_capacity * sizeof(InternedString *),
+                     capacity * sizeof(InternedString *));
+    stream->symbols_capacity = capacity;
+  }
+  stream->symbols[stream->symbols_length++] = symbol;
+}
+
+/**
+ * Lexes everything left in `lexer` into `stream`, allocating the arrays in
+ * `arena`. Integer literals are parsed here, so the parser never looks at
+ * their text again.
+ */
+void lexer_tokenize(Lexer *lexer, Arena *arena, TokenStream *stream) {
+  assert(lexer->buffer.length < UINT32_MAX && "input too large to tokenize");
+
+  // most tokens are followed by a space or are longer than one character
+  size_t capacity = (lexer->buffer.length - lexer->pos) / 2 + 16;
+  *stream = (TokenStream){
+      .input = lexer->buffer.buffer,
+      .types = arena_alloc(arena, capacity * sizeof(uint8_t)),
+      .offsets = arena_alloc(arena, capacity * sizeof(uint32_t)),
+      .lengths = arena_alloc(arena, capacity * sizeof(uint32_t)),
+      .capacity = capacity,
+      .integers = arena_alloc(arena, 16 * sizeof(int64_t)),
+      .integers_capacity = 16,
+      .symbols = arena_alloc(arena, 16 * sizeof(InternedString *)),
+      .symbols_capacity = 16,
+  };
+
+  while (true) {
+    Token token = lexer_next_token(lexer);
+    if (stream->length == stream->capacity) {
+      token_stream_grow(stream, arena);
+    }
+    size_t i = stream->length++;
+    stream->types[i] = (uint8_t)token.type;
+    stream->offsets[i] = (uint32_t)(token.literal.buffer - stream->input);
+    stream->lengths[i] = (uint32_t)token.literal.length;
+
+    switch (token.type) {
+    case TOKEN_INT: {
+      // a run of digits always parses completely
+      size_t end;
+      token_stream_append_integer(stream, arena,
+                                  string_to_int64(token.literal, &end));
+    } break;
+    case TOKEN_IDENT:
+      token_stream_append_symbol(stream, arena, token.symbol);
+      break;
+    case TOKEN_EOF:
+    case TOKEN_NEED_INPUT:
+      return;
+    default:
+      break;
+    }
+  }
+}
+
+/**
+ * Returns the token at `cursor` and moves past it. Once at the last token
+ * the cursor stays there. For TOKEN_INT, `*integer` is set to its value.
+ */
+Token token_stream_next(const TokenStream *stream, TokenCursor *cursor,
+                        int64_t *integer) {
+  size_t i = cursor->token;
+  Token token = {
+      .type = stream->types[i],
+      .literal = {.buffer = stream->input + stream->offsets[i],
+                  .length = stream->lengths[i]},
+  };
+
+  switch (token.type) {
+  case TOKEN_INT:
+    *integer = stream->integers[cursor->integer++];
+    break;
+  case TOKEN_IDENT:
+    token.symbol = stream->symbols[cursor->symbol++];
+    break;
+  case TOKEN_EOF:
+  case TOKEN_NEED_INPUT:
+    return token;
+  default:
+    break;
+  }
+
+  cursor->token++;
+  return token;
 }
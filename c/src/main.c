@@ -1,27 +1,113 @@
+#include "aot.c"
+#include "closure.c"
+#include "compiler.c"
 #include "env.c"
 #include "eval.c"
+#include "gc.c"
 #include "lexer.c"
 #include "mem.c"
 #include "object.c"
+#include "optimize.c"
 #include "parser.c"
+#include "resolver.c"
+#include "vm.c"
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <readline/history.h>
 #include <readline/readline.h>
 
-int main(void) {
-  unsigned char buf[32 * 1024];
-  Arena arena = {0};
-  arena_init(&arena, buf, 32 * 1024);
+#define REPL_ARENA_RESERVE ((size_t)1 << 30)
+#define SCRIPT_CHUNK_SIZE (64 * 1024)
 
-  unsigned char env_buf[16 * 1024];
-  Arena env_arena = {0};
-  arena_init(&env_arena, env_buf, 16 * 1024);
-  Environment env = {0};
-  environment_init(&env, &env_arena);
+// kept off the C stack; see `GLOBALS_SIZE`
+static Globals globals;
+static VM vm;
 
+typedef enum Engine {
+  ENGINE_EVAL,     // walks the tree (`eval.c`)
+  ENGINE_CLOSURES, // compiles the tree to closures first (`closure.c`)
+  ENGINE_JIT,      // closures, with integer code compiled to x86-64 (`jit.c`)
+  ENGINE_VM,       // compiles to bytecode (`compiler.c`, `vm.c`)
+} Engine;
+
+/**
+ * State shared by everything evaluated in one run, whether REPL lines or
+ * batches of script statements.
+ */
+typedef struct Interpreter {
+  Engine engine;
+  Arena arena; // reset after each line or batch
+  Arena env_arena;
+  Environment env;
+  // shared by every line, so that names compare by identity across lines
+  StringTable strings;
+  SymbolTable symbols;
+  // bound values live here rather than in `env_arena`, so that rebinding
+  // names does not grow the REPL's memory without bound
+  Gc gc;
+  Jit jit; // for `ENGINE_JIT`; its code is reused for each line or batch
+  bool optimize; // run `optimize_program` on everything first
+  OptimizeStats optimize_stats;
+} Interpreter;
+
+void print_parser_errors(const Parser *parser) {
+  for (size_t i = 0; i < parser->errors.length; ++i) {
+    fprintf(stderr, "ERROR: %.*s\n",
+            (int)parser->errors.errors[i].message.length,
+            parser->errors.errors[i].message.buffer);
+  }
+}
+
+/**
+ * Evaluates `program` with the chosen engine. Returns false, after printing
+ * why, if it could not be run at all.
+ */
+bool interpreter_run(Interpreter *in, Program *program, Object *evaluated) {
+  if (in->optimize) {
+    optimize_program(program, &in->arena, &in->optimize_stats);
+  }
+  switch (in->engine) {
+  case ENGINE_VM: {
+    Compiler compiler = {0};
+    compiler_init(&compiler, &in->arena, &in->symbols);
+    if (!compiler_compile_program(&compiler, program)) {
+      fprintf(stderr, "ERROR: %.*s\n", (int)compiler.error.length,
+              compiler.error.buffer);
+      return false;
+    }
+    vm_init(&vm, &in->arena, &in->gc, compiler_bytecode(&compiler), &globals);
+    vm_run(&vm, evaluated);
+  } break;
+  case ENGINE_CLOSURES:
+  case ENGINE_JIT: {
+    resolve_program(program, &in->arena, &in->env_arena, &in->env);
+    Jit *jit = NULL;
+    if (in->engine == ENGINE_JIT) {
+      jit = &in->jit;
+      jit_reset(jit);
+    }
+    closure_run_program(closure_compile_program(&in->arena, jit, program),
+                        &in->arena, &in->gc, &in->env, evaluated);
+  } break;
+  case ENGINE_EVAL:
+    resolve_program(program, &in->arena, &in->env_arena, &in->env);
+    eval_program(program, &in->arena, &in->gc, &in->env, evaluated);
+    break;
+  }
+  return true;
+}
+
+void interpreter_set_out_of_memory(Interpreter *in, jmp_buf *out_of_memory) {
+  in->arena.out_of_memory = out_of_memory;
+  in->env_arena.out_of_memory = out_of_memory;
+  in->gc.out_of_memory = out_of_memory;
+}
+
+void repl(Interpreter *in, Writer *out) {
   while (true) {
     char *line = readline(">> ");
     if (!line) {
@@ -30,31 +116,369 @@ int main(void) {
 
     add_history(line);
 
+    // anything evaluation doesn't turn into an error object ends up here
+    jmp_buf out_of_memory;
+    if (setjmp(out_of_memory)) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      goto cleanup;
+    }
+    interpreter_set_out_of_memory(in, &out_of_memory);
+
     Lexer lexer = {0};
     lexer_init(&lexer, line);
+    lexer.strings = &in->strings;
     Parser parser = {0};
-    parser_init(&parser, &arena, &lexer);
+    parser_init_token_stream(&parser, &in->arena, &lexer);
 
-    Program *program = parser_parse_program(&parser, &arena);
+    Program *program = parser_parse_program(&parser, &in->arena);
     if (parser.errors.length > 0) {
-      for (size_t i = 0; i < parser.errors.length; ++i) {
-        fprintf(stderr, "ERROR: %.*s\n",
-                (int)parser.errors.errors[i].message.length,
-                parser.errors.errors[i].message.buffer);
-      }
+      print_parser_errors(&parser);
       goto cleanup;
     }
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    if (!interpreter_run(in, program, &evaluated)) {
+      goto cleanup;
+    }
 
-    String str = object_to_string(&evaluated, &arena);
-    printf("%.*s\n", (int)str.length, str.buffer);
+    object_write(&evaluated, out);
+    writer_write_char(out, '\n');
+    writer_flush(out);
 
   cleanup:
+    interpreter_set_out_of_memory(in, NULL);
     free(line);
-    arena_reset(&arena);
+    arena_reset(&in->arena);
   }
+}
+
+void object_mark_root(Gc *gc, void *object) { gc_mark_object(gc, object); }
+
+/**
+ * Runs a script read from `file` in chunks. Each batch of complete
+ * statements is evaluated before more input is read, so only the unfinished
+ * statement and one chunk are held at a time. Evaluation stops at the first
+ * error; otherwise the value of the last statement is printed.
+ */
+bool run_script(Interpreter *in, FILE *file, Writer *out) {
+  static char chunk[SCRIPT_CHUNK_SIZE];
+
+  // the last value has to outlive each batch's arena
+  static Object result;
+  null_object(&result);
+  gc_add_root(&in->gc, object_mark_root, &result);
+
+  static Lexer lexer;
+  lexer_init_chunked(&lexer);
+  lexer.strings = &in->strings;
+  static Parser parser;
+  parser_init(&parser, &in->env_arena, &lexer);
+
+  jmp_buf out_of_memory;
+  if (setjmp(out_of_memory)) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    goto fail;
+  }
+  interpreter_set_out_of_memory(in, &out_of_memory);
+
+  while (true) {
+    Program *program = program_create(&in->arena);
+    ParseStatus status;
+    while ((status = parser_next_statement(&parser, program)) == PARSE_OK) {
+    }
+    if (parser.errors.length > 0) {
+      print_parser_errors(&parser);
+      goto fail;
+    }
+
+    if (program->statements_len > 0) {
+      Object evaluated = {0};
+      if (!interpreter_run(in, program, &evaluated)) {
+        goto fail;
+      }
+      if (object_type(&evaluated) == OBJECT_ERROR) {
+        object_write(&evaluated, out);
+        writer_write_char(out, '\n');
+        writer_flush(out);
+        goto fail;
+      }
+      gc_object_copy(&in->gc, &result, &evaluated);
+    }
+    arena_reset(&in->arena);
+
+    if (status == PARSE_EOF) {
+      break;
+    }
+    size_t length = fread(chunk, 1, sizeof(chunk), file);
+    if (length == 0) {
+      if (ferror(file)) {
+        perror("failed to read script");
+        goto fail;
+      }
+      lexer_finish(&lexer);
+    } else if (memchr(chunk, '\0', length)) {
+      fprintf(stderr, "ERROR: script contains a NUL byte\n");
+      goto fail;
+    } else if (!lexer_feed(&lexer, chunk, length)) {
+      fprintf(stderr, "ERROR: out of memory\n");
+      goto fail;
+    }
+  }
+
+  object_write(&result, out);
+  writer_write_char(out, '\n');
+  writer_flush(out);
+  interpreter_set_out_of_memory(in, NULL);
+  lexer_release(&lexer);
+  return true;
+
+fail:
+  interpreter_set_out_of_memory(in, NULL);
+  arena_reset(&in->arena);
+  lexer_release(&lexer);
+  return false;
+}
+
+/**
+ * Reads all of `file` into a NUL-terminated buffer that the caller frees.
+ * Returns NULL, after printing why, if it could not.
+ */
+char *read_script(FILE *file) {
+  size_t capacity = SCRIPT_CHUNK_SIZE, length = 0;
+  char *buffer = malloc(capacity);
+  while (buffer) {
+    length += fread(buffer + length, 1, capacity - length - 1, file);
+    if (length < capacity - 1) {
+      break;
+    }
+    capacity *= 2;
+    char *grown = realloc(buffer, capacity);
+    if (!grown) {
+      free(buffer);
+    }
+    buffer = grown;
+  }
+  if (!buffer) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    return NULL;
+  }
+  if (ferror(file)) {
+    perror("failed to read script");
+    free(buffer);
+    return NULL;
+  }
+  if (memchr(buffer, '\0', length)) {
+    fprintf(stderr, "ERROR: script contains a NUL byte\n");
+    free(buffer);
+    return NULL;
+  }
+  buffer[length] = '\0';
+  return buffer;
+}
+
+/**
+ * Runs a script read from `file` as a whole, parsing it on up to `jobs`
+ * threads (see `parser_parse_program_parallel`). Unlike `run_script`, this
+ * holds the entire source and tree at once, and nothing is evaluated if any
+ * of it fails to parse.
+ */
+bool run_script_parallel(Interpreter *in, FILE *file, size_t jobs,
+                         Writer *out) {
+  char *source = read_script(file);
+  if (!source) {
+    return false;
+  }
+
+  bool ok = false;
+  jmp_buf out_of_memory;
+  if (setjmp(out_of_memory)) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    goto cleanup;
+  }
+  interpreter_set_out_of_memory(in, &out_of_memory);
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, source);
+  lexer.strings = &in->strings;
+  Parser parser = {0};
+  parser_init(&parser, &in->arena, &lexer);
+  Program *program = parser_parse_program_parallel(&parser, &in->arena, jobs);
+  if (parser.errors.length > 0) {
+    print_parser_errors(&parser);
+    goto cleanup;
+  }
+
+  Object evaluated = {0};
+  if (!interpreter_run(in, program, &evaluated)) {
+    goto cleanup;
+  }
+  object_write(&evaluated, out);
+  writer_write_char(out, '\n');
+  writer_flush(out);
+  ok = object_type(&evaluated) != OBJECT_ERROR;
+
+cleanup:
+  interpreter_set_out_of_memory(in, NULL);
+  arena_reset(&in->arena);
+  free(source);
+  return ok;
+}
+
+/**
+ * Compiles a script read from `file` to an executable at `output` (see
+ * `aot_build`) instead of running it.
+ */
+bool build_script(Interpreter *in, FILE *file, const char *output) {
+  char *source = read_script(file);
+  if (!source) {
+    return false;
+  }
+
+  bool ok = false;
+  jmp_buf out_of_memory;
+  if (setjmp(out_of_memory)) {
+    fprintf(stderr, "ERROR: out of memory\n");
+    goto cleanup;
+  }
+  interpreter_set_out_of_memory(in, &out_of_memory);
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, source);
+  lexer.strings = &in->strings;
+  Parser parser = {0};
+  parser_init(&parser, &in->arena, &lexer);
+  Program *program = parser_parse_program(&parser, &in->arena);
+  if (parser.errors.length > 0) {
+    print_parser_errors(&parser);
+    goto cleanup;
+  }
+  if (in->optimize) {
+    optimize_program(program, &in->arena, &in->optimize_stats);
+  }
+  resolve_program(program, &in->arena, &in->env_arena, &in->env);
+  ok = aot_build(program, &in->env, &in->arena, output);
+
+cleanup:
+  interpreter_set_out_of_memory(in, NULL);
+  arena_reset(&in->arena);
+  free(source);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  Engine engine = ENGINE_EVAL;
+  bool gc_stats = false;
+  bool optimize = false;
+  bool optimize_stats = false;
+  long jobs = 1;
+  const char *script = NULL;
+  bool build = argc > 1 && strcmp(argv[1], "build") == 0;
+  const char *output = NULL;
+  bool usage = false;
+  for (int i = build ? 2 : 1; i < argc; ++i) {
+    if (build && strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      output = argv[++i];
+    } else if (strcmp(argv[i], "--vm") == 0) {
+      engine = ENGINE_VM;
+    } else if (strcmp(argv[i], "--closures") == 0) {
+      engine = ENGINE_CLOSURES;
+    } else if (strcmp(argv[i], "--jit") == 0) {
+      engine = ENGINE_JIT;
+    } else if (strcmp(argv[i], "--gc-stats") == 0) {
+      gc_stats = true;
+    } else if (strcmp(argv[i], "--optimize") == 0) {
+      optimize = true;
+    } else if (strcmp(argv[i], "--optimize-stats") == 0) {
+      optimize = optimize_stats = true;
+    } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc &&
+               (jobs = strtol(argv[i + 1], NULL, 10)) > 0) {
+      ++i;
+    } else if (!script && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0)) {
+      script = argv[i];
+    } else {
+      usage = true;
+    }
+  }
+  if (usage || (build && (!script || !output))) {
+    fprintf(stderr,
+            "usage: %s [--vm | --closures | --jit] [--optimize] "
+            "[--optimize-stats] [--gc-stats] [--jobs N] [script | -]\n"
+            "       %s build [--optimize] [script | -] -o output\n",
+            argv[0], argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  FILE *script_file = NULL;
+  if (script) {
+    script_file = strcmp(script, "-") == 0 ? stdin : fopen(script, "rb");
+    if (!script_file) {
+      perror(script);
+      return EXIT_FAILURE;
+    }
+  }
+
+  static Interpreter in;
+  in.engine = engine;
+  in.optimize = optimize;
+  // address space only; pages are committed as each arena grows
+  if (!arena_init_virtual(&in.arena, REPL_ARENA_RESERVE, true) ||
+      !arena_init_virtual(&in.env_arena, REPL_ARENA_RESERVE, true)) {
+    perror("failed to reserve memory");
+    return EXIT_FAILURE;
+  }
+  environment_init(&in.env, &in.env_arena);
+  string_table_init(&in.strings, &in.env_arena);
+  symbol_table_init(&in.symbols, &in.env_arena);
+
+  gc_init(&in.gc, GC_DEFAULT_THRESHOLD);
+  gc_add_root(&in.gc, environment_mark, &in.env);
+  gc_add_root(&in.gc, vm_mark, &vm);
+  if (engine == ENGINE_JIT && !jit_init(&in.jit)) {
+    // closures alone still run everything
+    fprintf(stderr, "warning: no JIT on this platform\n");
+  }
+
+  char out_buffer[4096];
+  Writer out = {0};
+  writer_init_file(&out, stdout, out_buffer, sizeof(out_buffer));
+
+  bool ok = true;
+  if (build) {
+    ok = build_script(&in, script_file, output);
+    if (script_file != stdin) {
+      fclose(script_file);
+    }
+  } else if (script_file) {
+    ok = jobs > 1 ? run_script_parallel(&in, script_file, (size_t)jobs, &out)
+                  : run_script(&in, script_file, &out);
+    if (script_file != stdin) {
+      fclose(script_file);
+    }
+  } else {
+    repl(&in, &out);
+  }
+
+  if (gc_stats) {
+    fprintf(stderr,
+            "gc: %zu collections, %zu objects (%zu bytes) live, "
+            "%zu objects (%zu bytes) freed\n",
+            in.gc.stats.collections, in.gc.stats.objects_allocated,
+            in.gc.stats.bytes_allocated, in.gc.stats.objects_freed,
+            in.gc.stats.bytes_freed);
+  }
+
+  if (optimize_stats) {
+    fprintf(stderr,
+            "optimize: %zu operators folded, %zu names propagated, "
+            "%zu ifs pruned, %zu statements dropped\n",
+            in.optimize_stats.folded, in.optimize_stats.propagated,
+            in.optimize_stats.pruned, in.optimize_stats.dropped);
+  }
+
+  jit_release(&in.jit);
+  gc_release(&in.gc);
+  arena_release(&in.arena);
+  arena_release(&in.env_arena);
 
-  return EXIT_SUCCESS;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
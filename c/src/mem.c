@@ -1,24 +1,89 @@
 #pragma once
 
+// mmap/madvise flags such as MAP_ANONYMOUS are extensions to -std=c99
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE
+#endif
+#ifndef _DARWIN_C_SOURCE
+#define _DARWIN_C_SOURCE
+#endif
+
 #include <assert.h>
+#include <setjmp.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
+#include <sys/mman.h>
+
+/**
+ * A bump allocator over either a caller-provided buffer (`arena_init`) or a
+ * reserved range of virtual memory that is committed on demand
+ * (`arena_init_virtual`).
+ *
+ * When the arena is exhausted, allocation longjmps to `out_of_memory` if it
+ * is set, and returns NULL otherwise. Callers that cannot check every
+ * allocation (the parser, the evaluator) install a handler so that running
+ * out of memory becomes an error rather than a NULL dereference.
+ */
 typedef struct Arena {
   unsigned char *buffer;
-  size_t buffer_size;
+  size_t buffer_size; // usable bytes; for virtual arenas, the committed bytes
   size_t prev_offset;
   size_t offset;
+  size_t reserved; // 0 for arenas backed by a fixed buffer
+  bool huge_pages;
+  jmp_buf *out_of_memory;
 } Arena;
 
+// commit in large steps so that mprotect stays off the allocation fast path
+#define ARENA_COMMIT_GRANULARITY (256 * 1024)
+
 void arena_init(Arena *arena, void *buffer, size_t buffer_size) {
   arena->buffer = (unsigned char *)buffer;
   arena->buffer_size = buffer_size;
   arena->prev_offset = 0;
   arena->offset = 0;
+  arena->reserved = 0;
+  arena->huge_pages = false;
+  arena->out_of_memory = NULL;
+}
+
+/**
+ * Reserves `reserve_size` bytes of address space without committing any of
+ * it. Pages are made accessible as the arena grows, so the reservation can be
+ * generous. With `huge_pages`, committed ranges are advised for transparent
+ * huge pages where the platform supports it.
+ * Returns false if the reservation failed.
+ */
+bool arena_init_virtual(Arena *arena, size_t reserve_size, bool huge_pages) {
+  arena_init(arena, NULL, 0);
+
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+  flags |= MAP_NORESERVE;
+#endif
+  void *buffer = mmap(NULL, reserve_size, PROT_NONE, flags, -1, 0);
+  if (buffer == MAP_FAILED) {
+    return false;
+  }
+
+  arena->buffer = buffer;
+  arena->reserved = reserve_size;
+  arena->huge_pages = huge_pages;
+  return true;
+}
+
+/**
+ * Returns a virtual arena's address space to the system. Arenas backed by a
+ * caller-provided buffer are left untouched.
+ */
+void arena_release(Arena *arena) {
+  if (arena->reserved > 0) {
+    munmap(arena->buffer, arena->reserved);
+  }
+  arena_init(arena, NULL, 0);
 }
 
 void arena_reset(Arena *arena) { arena->offset = 0; }
@@ -36,17 +101,57 @@ uintptr_t align_forward(uintptr_t ptr, size_t align) {
   return p;
 }
 
+/**
+ * Makes sure at least `size` bytes from the start of the arena are usable,
+ * committing more of a virtual arena's reservation if needed.
+ */
+bool arena_ensure(Arena *arena, size_t size) {
+  if (size <= arena->buffer_size) {
+    return true;
+  }
+  if (size > arena->reserved) {
+    return false;
+  }
+
+  size_t new_size = align_forward(size, ARENA_COMMIT_GRANULARITY);
+  if (new_size > arena->reserved) {
+    new_size = arena->reserved;
+  }
+
+  unsigned char *start = arena->buffer + arena->buffer_size;
+  size_t length = new_size - arena->buffer_size;
+  if (mprotect(start, length, PROT_READ | PROT_WRITE) != 0) {
+    return false;
+  }
+#ifdef MADV_HUGEPAGE
+  if (arena->huge_pages) {
+    madvise(start, length, MADV_HUGEPAGE);
+  }
+#endif
+
+  arena->buffer_size = new_size;
+  return true;
+}
+
+void *arena_out_of_memory(Arena *arena, size_t want) {
+  if (arena->out_of_memory) {
+    longjmp(*arena->out_of_memory, 1);
+  }
+  fprintf(stderr,
+          "ERROR: arena attempted to allocate more memory than is available: "
+          "want=%zu, got=%zu\n",
+          want, arena->reserved > 0 ? arena->reserved : arena->buffer_size);
+  return NULL;
+}
+
 void *arena_alloc_align(Arena *arena, size_t size, size_t align) {
   uintptr_t current_ptr = (uintptr_t)arena->buffer + (uintptr_t)arena->offset;
   uintptr_t offset = align_forward(current_ptr, align);
   offset -= (uintptr_t)arena->buffer;
 
-  if (offset + size > arena->buffer_size) {
-    fprintf(stderr,
-            "ERROR: arena attempted to allocate more memory than is available: "
-            "want=%lu, got=%zu\n",
-            offset + size, arena->buffer_size);
-    return NULL;
+  if (offset + size > arena->buffer_size &&
+      !arena_ensure(arena, offset + size)) {
+    return arena_out_of_memory(arena, offset + size);
   }
 
   void *ptr = &arena->buffer[offset];
@@ -75,13 +180,21 @@ void *arena_resize_align(Arena *arena, void *old_memory, size_t old_size,
   } else if (arena->buffer <= old_mem &&
              old_mem < arena->buffer + arena->buffer_size) {
     if (arena->buffer + arena->prev_offset == old_mem) {
-      arena->offset = arena->prev_offset + new_size;
+      size_t end = arena->prev_offset + new_size;
+      if (end > arena->buffer_size && !arena_ensure(arena, end)) {
+        return arena_out_of_memory(arena, end);
+      }
+      arena->offset = end;
       if (new_size > old_size) {
-        memset(&arena->buffer[arena->offset], 0, new_size - old_size);
+        memset(&arena->buffer[arena->prev_offset + old_size], 0,
+               new_size - old_size);
       }
       return old_memory;
     } else {
       void *new_memory = arena_alloc_align(arena, new_size, align);
+      if (!new_memory) {
+        return NULL;
+      }
       size_t copy_size = old_size < new_size ? old_size : new_size;
       memmove(new_memory, old_memory, copy_size);
       return new_memory;
@@ -93,6 +206,32 @@ void *arena_resize_align(Arena *arena, void *old_memory, size_t old_size,
   }
 }
 
+/**
+ * A saved position in an arena. Everything allocated after
+ * `temp_arena_memory_begin` is released by the matching
+ * `temp_arena_memory_end`. Scopes must be ended in reverse order.
+ */
+typedef struct TempArenaMemory {
+  Arena *arena;
+  size_t prev_offset;
+  size_t offset;
+} TempArenaMemory;
+
+TempArenaMemory temp_arena_memory_begin(Arena *arena) {
+  return (TempArenaMemory){
+      .arena = arena,
+      .prev_offset = arena->prev_offset,
+      .offset = arena->offset,
+  };
+}
+
+void temp_arena_memory_end(TempArenaMemory temp) {
+  assert(temp.offset <= temp.arena->offset &&
+         "temporary arena scopes must be ended in reverse order");
+  temp.arena->prev_offset = temp.prev_offset;
+  temp.arena->offset = temp.offset;
+}
+
 void *arena_resize(Arena *a, void *old_memory, size_t old_size,
                    size_t new_size) {
   return arena_resize_align(a, old_memory, old_size, new_size,
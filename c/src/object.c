@@ -1,8 +1,11 @@
 #pragma once
 
+#include "mem.c"
 #include "strconv.c"
 #include "string.c"
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 typedef enum ObjectType {
   OBJECT_INTEGER,
@@ -12,10 +15,14 @@ typedef enum ObjectType {
   OBJECT_ERROR,
 } ObjectType;
 
+#define OBJECT_TYPE_COUNT (OBJECT_ERROR + 1)
+
 const String object_type_strings[] = {
     String("INTEGER"),
     String("BOOLEAN"),
     String("NULL"),
+    String("RETURN_VALUE"),
+    String("ERROR"),
 };
 
 typedef struct Object Object;
@@ -55,29 +62,263 @@ typedef union ObjectData {
   ErrorObject error_object;
 } ObjectData;
 
+// Everything outside this file goes through the accessors below rather than
+// touching an `Object`'s fields, so that the representation can be switched
+// at build time. Either way a zeroed `Object` is the integer 0.
+
+#ifdef OBJECT_COMPACT
+
+/**
+ * Compact representation: an `Object` is one 64-bit word.
+ *
+ *   ...xxx0   integer, shifted left by one (63-bit range)
+ *   ...pp01   pointer to a `HeapObject`: errors, returns and integers that
+ *             do not fit in 63 bits
+ *   0b0011    null
+ *   0b0111    false
+ *   0b1011    true
+ *
+ * Heap objects are allocated in the arena passed to the constructor, so a
+ * value that must outlive that arena has to be copied with `object_copy`.
+ */
 struct Object {
+  uint64_t bits;
+};
+
+typedef struct HeapObject {
   ObjectType type;
+  bool gc_owned; // allocated by `gc.c` rather than in an arena
   ObjectData data;
+} HeapObject;
+
+#define OBJECT_TAG_MASK 3
+#define OBJECT_TAG_HEAP 1
+#define OBJECT_BITS_NULL 3
+#define OBJECT_BITS_FALSE 7
+#define OBJECT_BITS_TRUE 11
+
+bool object_is_heap(const Object *object) {
+  return (object->bits & OBJECT_TAG_MASK) == OBJECT_TAG_HEAP;
+}
+
+HeapObject *object_heap(const Object *object) {
+  return (HeapObject *)(uintptr_t)(object->bits & ~(uint64_t)OBJECT_TAG_MASK);
+}
+
+HeapObject *heap_object_create(Object *object, Arena *arena, ObjectType type) {
+  HeapObject *heap = arena_alloc(arena, sizeof(HeapObject));
+  heap->type = type;
+  object->bits = (uint64_t)(uintptr_t)heap | OBJECT_TAG_HEAP;
+  return heap;
+}
+
+ObjectType object_type(const Object *object) {
+  if ((object->bits & 1) == 0) {
+    return OBJECT_INTEGER;
+  } else if (object_is_heap(object)) {
+    return object_heap(object)->type;
+  } else if (object->bits == OBJECT_BITS_NULL) {
+    return OBJECT_NULL;
+  }
+  return OBJECT_BOOLEAN;
+}
+
+int64_t object_integer(const Object *object) {
+  if (object_is_heap(object)) {
+    return object_heap(object)->data.integer_object.value;
+  }
+  return (int64_t)object->bits >> 1;
+}
+
+bool object_boolean(const Object *object) {
+  return object->bits == OBJECT_BITS_TRUE;
+}
+
+String object_error_message(const Object *object) {
+  return object_heap(object)->data.error_object.message;
+}
+
+Object *object_return_value(const Object *object) {
+  return object_heap(object)->data.return_object.value;
+}
+
+void integer_object(Object *object, Arena *arena, int64_t value) {
+  uint64_t shifted = (uint64_t)value << 1;
+  if ((int64_t)shifted >> 1 == value) {
+    object->bits = shifted;
+  } else {
+    heap_object_create(object, arena, OBJECT_INTEGER)
+        ->data.integer_object.value = value;
+  }
+}
+
+void boolean_object(Object *object, bool value) {
+  object->bits = value ? OBJECT_BITS_TRUE : OBJECT_BITS_FALSE;
+}
+
+void null_object(Object *object) { object->bits = OBJECT_BITS_NULL; }
+
+void error_object(Object *object, Arena *arena, String message) {
+  heap_object_create(object, arena, OBJECT_ERROR)->data.error_object.message =
+      message;
+}
+
+void return_object(Object *object, Arena *arena, Object *value) {
+  heap_object_create(object, arena, OBJECT_RETURN)->data.return_object.value =
+      value;
+}
+
+// shared so that reporting exhaustion never needs to allocate
+HeapObject out_of_memory_heap_object = {
+    .type = OBJECT_ERROR,
+    .data.error_object.message = String("out of memory"),
 };
 
-String object_to_string(const Object *object, Arena *arena) {
-  switch (object->type) {
-  case OBJECT_INTEGER:
-    return integer_object_to_string(object->data.integer_object, arena);
+void out_of_memory_object(Object *object) {
+  object->bits = (uint64_t)(uintptr_t)&out_of_memory_heap_object |
+                 OBJECT_TAG_HEAP;
+}
+
+/**
+ * Copies `src` into `dst`, moving any heap payload into `arena`.
+ */
+void object_copy(Object *dst, Arena *arena, const Object *src) {
+  if (object_is_heap(src)) {
+    HeapObject *heap = heap_object_create(dst, arena, object_type(src));
+    memcpy(heap, object_heap(src), sizeof(HeapObject));
+    heap->gc_owned = false;
+  } else {
+    dst->bits = src->bits;
+  }
+}
+
+#else
+
+struct Object {
+  ObjectType type;
+  bool gc_owned; // payload allocated by `gc.c` rather than in an arena
+  ObjectData data;
+};
+
+ObjectType object_type(const Object *object) { return object->type; }
+
+int64_t object_integer(const Object *object) {
+  return object->data.integer_object.value;
+}
+
+bool object_boolean(const Object *object) {
+  return object->data.boolean_object.value;
+}
+
+String object_error_message(const Object *object) {
+  return object->data.error_object.message;
+}
+
+Object *object_return_value(const Object *object) {
+  return object->data.return_object.value;
+}
+
+void integer_object(Object *object, Arena *arena, int64_t value) {
+  (void)arena;
+  object->type = OBJECT_INTEGER;
+  object->data.integer_object.value = value;
+}
+
+void boolean_object(Object *object, bool value) {
+  object->type = OBJECT_BOOLEAN;
+  object->data.boolean_object.value = value;
+}
+
+void null_object(Object *object) {
+  object->type = OBJECT_NULL;
+  object->data = (ObjectData){0};
+}
+
+void error_object(Object *object, Arena *arena, String message) {
+  (void)arena;
+  object->type = OBJECT_ERROR;
+  object->gc_owned = false;
+  object->data.error_object.message = message;
+}
+
+void return_object(Object *object, Arena *arena, Object *value) {
+  (void)arena;
+  object->type = OBJECT_RETURN;
+  object->gc_owned = false;
+  object->data.return_object.value = value;
+}
+
+void out_of_memory_object(Object *object) {
+  error_object(object, NULL, String("out of memory"));
+}
+
+void object_copy(Object *dst, Arena *arena, const Object *src) {
+  (void)arena;
+  memcpy(dst, src, sizeof(Object));
+  dst->gc_owned = false;
+}
+
+#endif
+
+// Integer arithmetic wraps on overflow in every engine. It goes through
+// `uint64_t`, as signed overflow is undefined in C.
+
+int64_t integer_add(int64_t l, int64_t r) {
+  return (int64_t)((uint64_t)l + (uint64_t)r);
+}
+
+int64_t integer_sub(int64_t l, int64_t r) {
+  return (int64_t)((uint64_t)l - (uint64_t)r);
+}
+
+int64_t integer_mul(int64_t l, int64_t r) {
+  return (int64_t)((uint64_t)l * (uint64_t)r);
+}
+
+int64_t integer_neg(int64_t value) {
+  return (int64_t)(0 - (uint64_t)value);
+}
+
+/**
+ * Only null and false are falsy. Every integer, 0 included, is truthy, which
+ * the engines rely on to fold `!` and `if` on integers away.
+ */
+bool object_is_truthy(const Object *object) {
+  switch (object_type(object)) {
+  case OBJECT_NULL:
+    return false;
   case OBJECT_BOOLEAN:
-    return boolean_object_to_string(object->data.boolean_object);
+    return object_boolean(object);
+  default:
+    return true;
+  }
+}
+
+void object_write(const Object *object, Writer *writer) {
+  switch (object_type(object)) {
+  case OBJECT_INTEGER:
+    writer_write_int64(writer, object_integer(object));
+    break;
+  case OBJECT_BOOLEAN: {
+    BooleanObject boolean = {.value = object_boolean(object)};
+    writer_write_string(writer, boolean_object_to_string(boolean));
+  } break;
   case OBJECT_NULL:
-    return String("null");
+    writer_write_string(writer, String("null"));
+    break;
   case OBJECT_RETURN:
-    return object_to_string(object->data.return_object.value, arena);
+    object_write(object_return_value(object), writer);
+    break;
   case OBJECT_ERROR:
-    return string_fmt(arena, "ERROR: %.*s",
-                      object->data.error_object.message.length,
-                      object->data.error_object.message.buffer);
+    writer_write_string(writer, String("ERROR: "));
+    writer_write_string(writer, object_error_message(object));
+    break;
   }
 }
 
-void null_object(Object *object) {
-  object->type = OBJECT_NULL;
-  object->data = (ObjectData){0};
+String object_to_string(const Object *object, Arena *arena) {
+  Writer writer = {0};
+  writer_init_arena(&writer, arena);
+  object_write(object, &writer);
+  return writer_string(&writer);
 }
@@ -0,0 +1,363 @@
+#pragma once
+
+#include "ast.c"
+#include "mem.c"
+#include "object.c"
+#include "string.c"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// optimization
+//
+// An optional pass between `parser_parse_program` and resolution that
+// rewrites the tree in place, so every engine runs the smaller program:
+//
+// - prefix and infix operators on integer and boolean literals are computed,
+//   unless that would be an error or a division C cannot do
+// - a name bound once in the program, by a top-level `let` of a literal, is
+//   replaced by that literal in the statements after the `let`
+// - an `if` whose condition is a literal keeps only the arm it takes
+// - statements after a `return` in a block are dropped
+//
+// Names are only replaced outside function literals, whose bodies may run
+// after a later REPL line has rebound them. The `let`s themselves are kept,
+// since later lines may read what they bind.
+
+/** What `optimize_program` changed, added up over every program. */
+typedef struct OptimizeStats {
+  size_t folded;     // operators computed
+  size_t propagated; // names replaced by their value
+  size_t pruned;     // `if`s reduced to the arm they take
+  size_t dropped;    // unreachable statements
+} OptimizeStats;
+
+/** A name the program binds, keyed by its interned string. */
+typedef struct OptimizeName {
+  const InternedString *name;
+  uint32_t lets;   // how many `let`s bind it
+  NodeIndex value; // the literal it holds from here on, or NODE_NONE
+} OptimizeName;
+
+typedef struct Optimizer {
+  Ast *ast;
+  OptimizeStats *stats;
+  OptimizeName *names; // open addressing with linear probing
+  size_t names_capacity; // always a power of two, at least twice the names
+  bool propagate;        // false inside function literals
+} Optimizer;
+
+void optimize_expression(Optimizer *o, NodeIndex expression);
+void optimize_block(Optimizer *o, NodeIndex block);
+
+/** Returns the entry for `name`, empty if the program never binds it. */
+OptimizeName *optimize_lookup(Optimizer *o, const InternedString *name) {
+  size_t mask = o->names_capacity - 1;
+  size_t i = name->hash & mask;
+  // probes as `environment_lookup` does
+  while (o->names[i].name && o->names[i].name != name) {
+    i = (i + 1) & mask;
+  }
+  return &o->names[i];
+}
+
+// counts the `let`s of every name bound outside function literals
+void optimize_count_lets(Optimizer *o, NodeIndex index) {
+  const Node *node = ast_node(o->ast, index);
+  switch ((NodeType)node->type) {
+  case NODE_LET:
+    if (node->lhs != NODE_NONE) {
+      const InternedString *name =
+          ast_identifier_symbol(o->ast, ast_node(o->ast, node->lhs));
+      OptimizeName *entry = optimize_lookup(o, name);
+      entry->name = name;
+      ++entry->lets;
+    }
+    optimize_count_lets(o, node->rhs);
+    break;
+  case NODE_PREFIX:
+  case NODE_RETURN:
+  case NODE_EXPRESSION_STATEMENT:
+    optimize_count_lets(o, node->lhs);
+    break;
+  case NODE_INFIX:
+    optimize_count_lets(o, node->lhs);
+    optimize_count_lets(o, node->rhs);
+    break;
+  case NODE_IF:
+    // blocks share the enclosing environment
+    optimize_count_lets(o, node->lhs);
+    optimize_count_lets(o, ast_if_consequence(o->ast, node));
+    optimize_count_lets(o, ast_if_alternative(o->ast, node));
+    break;
+  case NODE_CALL:
+  case NODE_BLOCK: {
+    if (node->type == NODE_CALL) {
+      optimize_count_lets(o, node->lhs);
+    }
+    uint32_t length;
+    const NodeIndex *items =
+        ast_list(o->ast, node->type == NODE_CALL ? node->rhs : node->lhs,
+                 &length);
+    for (uint32_t i = 0; i < length; ++i) {
+      optimize_count_lets(o, items[i]);
+    }
+  } break;
+  case NODE_INVALID:
+  case NODE_IDENTIFIER:
+  case NODE_INTEGER:
+  case NODE_BOOLEAN:
+  case NODE_FUNCTION: // a scope of its own
+    break;
+  }
+}
+
+// literals
+
+bool optimize_is_literal(const Node *node) {
+  return node->type == NODE_INTEGER || node->type == NODE_BOOLEAN;
+}
+
+Node optimize_boolean(bool value) {
+  return (Node){.type = NODE_BOOLEAN, .lhs = value};
+}
+
+/**
+ * Computes `node`, whose operands are literals, into `*folded`. Returns
+ * false if evaluating it would fail, which is left to the engines.
+ */
+bool optimize_fold(const Ast *ast, const Node *node, Node *folded) {
+  const Node *left = ast_node(ast, node->lhs);
+  if (node->type == NODE_PREFIX) {
+    if (node->operator == OPERATOR_BANG) {
+      // see `object_is_truthy`
+      *folded = optimize_boolean(left->type == NODE_BOOLEAN && !left->lhs);
+      return true;
+    }
+    if (left->type != NODE_INTEGER) {
+      return false;
+    }
+    *folded = ast_integer_node(integer_neg(ast_integer_value(left)));
+    return true;
+  }
+
+  const Node *right = ast_node(ast, node->rhs);
+  if (left->type != right->type) {
+    return false;
+  }
+  if (left->type == NODE_BOOLEAN) {
+    if (node->operator != OPERATOR_EQ && node->operator != OPERATOR_NOT_EQ) {
+      return false;
+    }
+    *folded = optimize_boolean((left->lhs == right->lhs) ==
+                               (node->operator == OPERATOR_EQ));
+    return true;
+  }
+
+  int64_t l = ast_integer_value(left);
+  int64_t r = ast_integer_value(right);
+  switch ((Operator)node->operator) {
+  case OPERATOR_PLUS:
+    *folded = ast_integer_node(integer_add(l, r));
+    return true;
+  case OPERATOR_MINUS:
+    *folded = ast_integer_node(integer_sub(l, r));
+    return true;
+  case OPERATOR_ASTERISK:
+    *folded = ast_integer_node(integer_mul(l, r));
+    return true;
+  case OPERATOR_SLASH:
+    if (r == 0 || (r == -1 && l == INT64_MIN)) {
+      return false;
+    }
+    *folded = ast_integer_node(l / r);
+    return true;
+  case OPERATOR_LT:
+    *folded = optimize_boolean(l < r);
+    return true;
+  case OPERATOR_GT:
+    *folded = optimize_boolean(l > r);
+    return true;
+  case OPERATOR_EQ:
+    *folded = optimize_boolean(l == r);
+    return true;
+  case OPERATOR_NOT_EQ:
+    *folded = optimize_boolean(l != r);
+    return true;
+  default:
+    return false;
+  }
+}
+
+// `if`s
+
+/** Reduces the `if` at `index`, whose condition is a literal. */
+void optimize_prune(Optimizer *o, NodeIndex index) {
+  Node *node = ast_node_mut(o->ast, index);
+  const Node *condition = ast_node(o->ast, node->lhs);
+  bool truthy = condition->type == NODE_INTEGER || condition->lhs;
+  NodeIndex consequence = ast_if_consequence(o->ast, node);
+  NodeIndex alternative = ast_if_alternative(o->ast, node);
+  NodeIndex taken = truthy ? consequence : alternative;
+
+  if (taken == NODE_NONE) {
+    // the value is null, which has no literal, so an empty arm is kept
+    uint32_t length;
+    ast_list(o->ast, ast_node(o->ast, consequence)->lhs, &length);
+    if (length > 0) {
+      NodeIndex empty = ast_add_block(o->ast, NULL, 0);
+      o->ast->extra[ast_node(o->ast, index)->rhs] = empty;
+      ++o->stats->pruned;
+    }
+    return;
+  }
+
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(o->ast, ast_node(o->ast, taken)->lhs, &length);
+  if (length == 1 &&
+      ast_node(o->ast, statements[0])->type == NODE_EXPRESSION_STATEMENT) {
+    // a block of one expression has that expression's value
+    *node = *ast_node(o->ast, ast_node(o->ast, statements[0])->lhs);
+    ++o->stats->pruned;
+  } else if (alternative != NODE_NONE) {
+    *ast_node_mut(o->ast, node->lhs) = optimize_boolean(true);
+    NodeIndex arms[] = {taken, NODE_NONE};
+    uint32_t extra = ast_add_extra(o->ast, arms, 2);
+    ast_node_mut(o->ast, index)->rhs = extra;
+    ++o->stats->pruned;
+  }
+}
+
+// walking the tree
+
+void optimize_statement(Optimizer *o, NodeIndex statement) {
+  const Node *node = ast_node(o->ast, statement);
+  switch ((NodeType)node->type) {
+  case NODE_LET:
+    if (node->rhs != NODE_NONE) {
+      optimize_expression(o, node->rhs);
+    }
+    break;
+  case NODE_RETURN:
+  case NODE_EXPRESSION_STATEMENT:
+    if (node->lhs != NODE_NONE) {
+      optimize_expression(o, node->lhs);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void optimize_block(Optimizer *o, NodeIndex block) {
+  uint32_t list = ast_node(o->ast, block)->lhs;
+  uint32_t length = o->ast->extra[list];
+  for (uint32_t i = 0; i < length; ++i) {
+    NodeIndex statement = o->ast->extra[list + 1 + i];
+    optimize_statement(o, statement);
+    if (ast_node(o->ast, statement)->type == NODE_RETURN) {
+      o->stats->dropped += length - i - 1;
+      o->ast->extra[list] = i + 1;
+      break;
+    }
+  }
+}
+
+void optimize_expression(Optimizer *o, NodeIndex expression) {
+  Node *node = ast_node_mut(o->ast, expression);
+  switch ((NodeType)node->type) {
+  case NODE_IDENTIFIER: {
+    if (!o->propagate) {
+      break;
+    }
+    OptimizeName *entry =
+        optimize_lookup(o, ast_identifier_symbol(o->ast, node));
+    if (entry->value != NODE_NONE) {
+      *node = *ast_node(o->ast, entry->value);
+      ++o->stats->propagated;
+    }
+  } break;
+  case NODE_PREFIX:
+  case NODE_INFIX: {
+    optimize_expression(o, node->lhs);
+    if (node->type == NODE_INFIX) {
+      optimize_expression(o, node->rhs);
+    }
+    Node folded;
+    if (optimize_is_literal(ast_node(o->ast, node->lhs)) &&
+        (node->type == NODE_PREFIX ||
+         optimize_is_literal(ast_node(o->ast, node->rhs))) &&
+        optimize_fold(o->ast, node, &folded)) {
+      *node = folded;
+      ++o->stats->folded;
+    }
+  } break;
+  case NODE_IF: {
+    optimize_expression(o, node->lhs);
+    NodeIndex consequence = ast_if_consequence(o->ast, node);
+    NodeIndex alternative = ast_if_alternative(o->ast, node);
+    if (consequence != NODE_NONE) {
+      optimize_block(o, consequence);
+    }
+    if (alternative != NODE_NONE) {
+      optimize_block(o, alternative);
+    }
+    if (consequence != NODE_NONE &&
+        optimize_is_literal(ast_node(o->ast, node->lhs))) {
+      optimize_prune(o, expression);
+    }
+  } break;
+  case NODE_FUNCTION: {
+    bool propagate = o->propagate;
+    o->propagate = false;
+    if (node->lhs != NODE_NONE) {
+      optimize_block(o, node->lhs);
+    }
+    o->propagate = propagate;
+  } break;
+  case NODE_CALL: {
+    optimize_expression(o, node->lhs);
+    uint32_t list = node->rhs;
+    uint32_t length = o->ast->extra[list];
+    for (uint32_t i = 0; i < length; ++i) {
+      optimize_expression(o, o->ast->extra[list + 1 + i]);
+    }
+  } break;
+  default:
+    break;
+  }
+}
+
+/**
+ * Optimizes `program` in place, adding what was changed to `stats`. Must run
+ * before the program is resolved or compiled, and the program cannot be
+ * reparsed afterwards. The pass's own state is allocated in `arena`.
+ */
+void optimize_program(Program *program, Arena *arena, OptimizeStats *stats) {
+  Optimizer o = {.ast = &program->ast, .stats = stats, .propagate = true};
+  o.names_capacity = 16;
+  while (o.names_capacity < 2 * (size_t)program->ast.symbols_len) {
+    o.names_capacity *= 2;
+  }
+  o.names = arena_alloc(arena, o.names_capacity * sizeof(OptimizeName));
+  for (uint32_t i = 0; i < program->statements_len; ++i) {
+    optimize_count_lets(&o, program->statements[i]);
+  }
+
+  for (uint32_t i = 0; i < program->statements_len; ++i) {
+    NodeIndex statement = program->statements[i];
+    optimize_statement(&o, statement);
+    const Node *node = ast_node(o.ast, statement);
+    if (node->type != NODE_LET || node->lhs == NODE_NONE ||
+        !optimize_is_literal(ast_node(o.ast, node->rhs))) {
+      continue;
+    }
+    const Node *name = ast_node(o.ast, node->lhs);
+    OptimizeName *entry =
+        optimize_lookup(&o, ast_identifier_symbol(o.ast, name));
+    if (entry->lets == 1) {
+      entry->value = node->rhs;
+    }
+  }
+}
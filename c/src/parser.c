@@ -5,6 +5,9 @@
 #include "mem.c"
 #include "strconv.c"
 #include "token.c"
+#include <assert.h>
+#include <pthread.h>
+#include <setjmp.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -44,23 +47,65 @@ void error_list_append(ErrorList *list, Arena *arena, String message) {
   };
 }
 
+/**
+ * An expression that is waiting for an operand to be parsed, kept on the
+ * parser's frame stack instead of the C stack. `precedence` is that of the
+ * expression it is itself an operand of, which resumes once it is complete.
+ */
+typedef enum FrameType {
+  FRAME_PREFIX, // `operator` applied to the operand
+  FRAME_INFIX,  // `node` `operator` the operand
+  FRAME_GROUP,  // `(` the operand `)`
+  FRAME_CALL,   // `node(` arguments so far, from `base` on the scratch stack
+} FrameType;
+
+typedef struct Frame {
+  uint8_t type;       // FrameType
+  uint8_t operator;   // Operator
+  uint8_t precedence; // Precedence
+  NodeIndex node;
+  uint32_t base;
+} Frame;
+
+/**
+ * Tokens come either one at a time from `lexer` or, after
+ * `parser_init_token_stream`, from a pre-lexed `tokens` stream, in which case
+ * integer literals arrive already parsed in `current_integer`.
+ */
 typedef struct Parser {
   Lexer *lexer;
+  TokenStream *tokens;
+  TokenCursor cursor;
   Token current_token;
   Token peek_token;
+  int64_t current_integer;
+  int64_t peek_integer;
+  bool need_input; // TOKEN_NEED_INPUT was reached in the current statement
+  // elements of the lists being parsed, innermost last; see `parser_push`
+  NodeIndex *scratch;
+  uint32_t scratch_len;
+  uint32_t scratch_capacity;
+  Arena *scratch_arena;
+  // expressions being parsed, innermost last; see `parser_parse_expression`
+  Frame *frames;
+  uint32_t frames_len;
+  uint32_t frames_capacity;
   ErrorList errors;
 } Parser;
 
+typedef enum ParseStatus {
+  PARSE_OK,
+  PARSE_NEED_INPUT,
+  PARSE_EOF,
+} ParseStatus;
+
 void parser_next_token(Parser *parser);
 bool parser_expect_peek(Parser *parser, Arena *arena, TokenType token_type);
 
-void parser_parse_statement(Parser *parser, Arena *arena, Statement *statement);
-void parser_parse_let_statement(Parser *parser, Arena *arena,
-                                Statement *statement);
-void parser_parse_return_statement(Parser *parser, Arena *arena,
-                                   Statement *statement);
-void parser_parse_expression_statement(Parser *parser, Arena *arena,
-                                       Statement *statement);
+NodeIndex parser_parse_statement(Parser *parser, Ast *ast);
+NodeIndex parser_parse_let_statement(Parser *parser, Ast *ast);
+NodeIndex parser_parse_return_statement(Parser *parser, Ast *ast);
+NodeIndex parser_parse_expression_statement(Parser *parser, Ast *ast);
 
 typedef enum Precedence {
   PRECEDENCE_LOWEST,
@@ -74,414 +119,938 @@ typedef enum Precedence {
 
 Precedence token_type_to_precedence(TokenType t);
 
-void parser_parse_expression(Parser *parser, Arena *arena,
-                             Expression *expression, Precedence precedence);
-void parser_parse_identifier(Parser *parser, Expression *expression);
-void parser_parse_integer_literal(Parser *parser, Arena *arena,
-                                  Expression *expression);
-void parser_parse_prefix_expression(Parser *parser, Arena *arena,
-                                    Expression *expression);
-void parser_parse_infix_expression(Parser *parser, Arena *arena,
-                                   Expression *expression);
-void parser_parse_boolean(Parser *parser, Expression *expression);
-void parser_parse_grouped_expression(Parser *parser, Arena *arena,
-                                     Expression *expression);
-void parser_parse_if_expression(Parser *parser, Arena *arena,
-                                Expression *expression);
-void parser_parse_function_literal(Parser *parser, Arena *arena,
-                                   Expression *expression);
-void parser_parse_call_expression(Parser *parser, Arena *arena,
-                                  Expression *function);
-
+NodeIndex parser_parse_expression(Parser *parser, Ast *ast,
+                                  Precedence precedence);
+NodeIndex parser_parse_identifier(Parser *parser, Ast *ast);
+NodeIndex parser_parse_integer_literal(Parser *parser, Ast *ast);
+NodeIndex parser_parse_boolean(Parser *parser, Ast *ast);
+NodeIndex parser_parse_if_expression(Parser *parser, Ast *ast);
+NodeIndex parser_parse_function_literal(Parser *parser, Ast *ast);
+
+/**
+ * Identifiers are interned in the lexer's string table, which is created in
+ * `arena` if the lexer does not have one. Programs whose names are compared
+ * with each other (e.g. resolved against the same environment) must be
+ * parsed with the same table.
+ */
 void parser_init(Parser *parser, Arena *arena, Lexer *lexer) {
+  if (!lexer->strings) {
+    lexer->strings = arena_alloc(arena, sizeof(StringTable));
+    string_table_init(lexer->strings, arena);
+  }
   parser->lexer = lexer;
+  parser->scratch_capacity = 64;
+  parser->scratch_len = 0;
+  parser->scratch =
+      arena_alloc(arena, parser->scratch_capacity * sizeof(NodeIndex));
+  parser->scratch_arena = arena;
+  parser->frames_capacity = 16;
+  parser->frames_len = 0;
+  parser->frames = arena_alloc(arena, parser->frames_capacity * sizeof(Frame));
   error_list_init(&parser->errors, arena);
   parser_next_token(parser);
   parser_next_token(parser);
 }
 
+/**
+ * Like `parser_init`, but lexes the whole input up front into a
+ * `TokenStream` in `arena` and parses from that.
+ */
+void parser_init_token_stream(Parser *parser, Arena *arena, Lexer *lexer) {
+  if (!lexer->strings) {
+    lexer->strings = arena_alloc(arena, sizeof(StringTable));
+    string_table_init(lexer->strings, arena);
+  }
+  parser->tokens = arena_alloc(arena, sizeof(TokenStream));
+  lexer_tokenize(lexer, arena, parser->tokens);
+  parser->cursor = (TokenCursor){0};
+  parser_init(parser, arena, lexer);
+}
+
 void parser_next_token(Parser *parser) {
   parser->current_token = parser->peek_token;
-  parser->peek_token = lexer_next_token(parser->lexer);
+  parser->current_integer = parser->peek_integer;
+  parser->need_input |= parser->current_token.type == TOKEN_NEED_INPUT;
+  if (parser->tokens) {
+    parser->peek_token = token_stream_next(parser->tokens, &parser->cursor,
+                                           &parser->peek_integer);
+  } else {
+    parser->peek_token = lexer_next_token(parser->lexer);
+  }
+}
+
+/**
+ * Pushes an element of the list being parsed onto the scratch stack. A list
+ * starts at the stack's length when parsing it begins, and is copied into
+ * the tree at its exact size once the closing token has been seen, so
+ * nested lists never interleave and the stack's memory is reused.
+ */
+void parser_push(Parser *parser, NodeIndex node) {
+  parser->scratch = ast_reserve(parser->scratch_arena, parser->scratch,
+                                &parser->scratch_capacity, sizeof(NodeIndex),
+                                parser->scratch_len + 1);
+  parser->scratch[parser->scratch_len++] = node;
+}
+
+bool parser_at_end(const Parser *parser) {
+  return parser->current_token.type == TOKEN_EOF ||
+         parser->current_token.type == TOKEN_NEED_INPUT;
+}
+
+size_t parser_token_offset(const Parser *parser, Token token) {
+  return (size_t)(token.literal.buffer - parser->lexer->buffer.buffer);
+}
+
+// where `token` ends in the input; EOF ends at the terminator
+size_t parser_token_end(const Parser *parser, Token token) {
+  if (token.type == TOKEN_EOF) {
+    return parser->lexer->buffer.length;
+  }
+  return parser_token_offset(parser, token) + token.literal.length;
+}
+
+/**
+ * Parses the top-level statement at the current token, leaving the parser on
+ * its last token, and returns where it came from.
+ */
+SourceSpan parser_parse_span(Parser *parser, Ast *ast) {
+  SourceSpan span = {0};
+  size_t errors_length = parser->errors.length;
+  span.start = (uint32_t)parser_token_offset(parser, parser->current_token);
+  span.statement = parser_parse_statement(parser, ast);
+  span.end = (uint32_t)parser_token_end(parser, parser->current_token);
+  span.errors = (uint32_t)(parser->errors.length - errors_length);
+  // only a statement that parsed up to its `;` did not look at the token
+  // after it, which the lexer looked one character past to see where it ends
+  span.depends = span.errors == 0 &&
+                         parser->current_token.type == TOKEN_SEMICOLON
+                     ? span.end
+                     : (uint32_t)parser_token_end(parser, parser->peek_token) +
+                           1;
+  return span;
 }
 
+/**
+ * Parses everything up to the end of the input into a new `Program`.
+ * Statements that fail to parse are left out; see `errors`.
+ */
 Program *parser_parse_program(Parser *parser, Arena *arena) {
   Program *program = program_create(arena);
 
-  while (parser->current_token.type != TOKEN_EOF) {
-    Statement s = {0};
-    parser_parse_statement(parser, arena, &s);
-    program_append_statement(program, arena, s);
+  while (!parser_at_end(parser)) {
+    SourceSpan span = parser_parse_span(parser, &program->ast);
+    program_append_span(program, span);
+    if (span.statement != NODE_NONE) {
+      program_append_statement(program, span.statement);
+    }
     parser_next_token(parser);
   }
 
   return program;
 }
 
-void parser_parse_statement(Parser *parser, Arena *arena,
-                            Statement *statement) {
+/**
+ * Parses the next top-level statement from a chunk-fed lexer (see
+ * `lexer_init_chunked`) and appends it to `program`. Returns PARSE_NEED_INPUT
+ * if the input fed so far ends before the statement does; feed more and call
+ * again, and the statement is parsed from its start.
+ */
+ParseStatus parser_next_statement(Parser *parser, Program *program) {
+  Lexer *lexer = parser->lexer;
+  if (parser->current_token.type == TOKEN_NEED_INPUT) {
+    lexer->pos = lexer->mark;
+    parser_next_token(parser);
+    parser_next_token(parser);
+  }
+  if (parser->current_token.type == TOKEN_EOF) {
+    return PARSE_EOF;
+  }
+
+  size_t start = parser_token_offset(parser, parser->current_token);
+  lexer->mark = start;
+  if (parser->current_token.type == TOKEN_NEED_INPUT) {
+    return PARSE_NEED_INPUT;
+  }
+
+  Ast *ast = &program->ast;
+  Ast before = *ast;
+  size_t errors_length = parser->errors.length;
+  parser->need_input = false;
+  NodeIndex statement = parser_parse_statement(parser, ast);
+
+  // anything but a `;` may be continued by the next chunk, as in `x` + `+ 1`
+  if (parser->need_input ||
+      (parser->peek_token.type == TOKEN_NEED_INPUT &&
+       parser->current_token.type != TOKEN_SEMICOLON)) {
+    // drop the partial statement's nodes, keeping any growth of the arrays
+    ast->nodes_len = before.nodes_len;
+    ast->extra_len = before.extra_len;
+    ast->symbols_len = before.symbols_len;
+    parser->errors.length = errors_length;
+    parser->scratch_len = 0;
+    parser->current_token = lexer_need_input(lexer, start);
+    return PARSE_NEED_INPUT;
+  }
+
+  if (statement != NODE_NONE) {
+    program_append_statement(program, statement);
+  }
+  parser_next_token(parser);
+  if (parser->current_token.type != TOKEN_EOF) {
+    lexer->mark = parser_token_offset(parser, parser->current_token);
+  }
+  return PARSE_OK;
+}
+
+// incremental parsing
+
+/**
+ * A change to a source: the `removed` bytes at `offset` were replaced with
+ * `inserted`.
+ */
+typedef struct TextEdit {
+  size_t offset;
+  size_t removed;
+  String inserted;
+} TextEdit;
+
+void array_reverse(void *items, size_t length, size_t item_size) {
+  if (length < 2) {
+    return;
+  }
+  char *low = items;
+  char *high = low + (length - 1) * item_size;
+  for (; low < high; low += item_size, high -= item_size) {
+    for (size_t i = 0; i < item_size; ++i) {
+      char c = low[i];
+      low[i] = high[i];
+      high[i] = c;
+    }
+  }
+}
+
+// moves the first `split` of `length` items after the rest, in place
+void array_rotate(void *items, size_t split, size_t length,
+                  size_t item_size) {
+  array_reverse(items, split, item_size);
+  array_reverse((char *)items + split * item_size, length - split, item_size);
+  array_reverse(items, length, item_size);
+}
+
+/**
+ * Updates `program`, which `parser` parsed with `parser_parse_program`, and
+ * the parser's errors to match `source`: its input with `edit` applied.
+ *
+ * Statements before the edit whose parse did not look at it are kept as they
+ * are. Parsing resumes after the last of them and stops as soon as a
+ * statement would start where an old statement after the edit started, moved
+ * by the edit's length; from there the old statements, and their errors, are
+ * kept too, since they are made of the same text. So an edit costs the
+ * statements it touches rather than the whole source, plus moving the spans
+ * that follow it. The nodes of replaced statements stay in the tree until it
+ * is next parsed from scratch.
+ */
+void parser_reparse(Parser *parser, Program *program, char *source,
+                    TextEdit edit) {
+  assert(!parser->tokens && "cannot reparse a token stream");
+  Lexer *lexer = parser->lexer;
+  uint32_t spans_len = program->spans_len;
+  size_t edit_end = edit.offset + edit.removed;
+  int64_t delta = (int64_t)edit.inserted.length - (int64_t)edit.removed;
+
+  // spans are ordered by `end`, but a span may depend on more than the next
+  uint32_t first = 0, high = spans_len;
+  while (first < high) {
+    uint32_t middle = first + (high - first) / 2;
+    if (program->spans[middle].end <= edit.offset) {
+      first = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  while (first > 0 && program->spans[first - 1].depends > edit.offset) {
+    --first;
+  }
+  size_t errors_kept = 0;
+  uint32_t statements_kept = 0;
+  for (uint32_t i = 0; i < first; ++i) {
+    errors_kept += program->spans[i].errors;
+    statements_kept += program->spans[i].statement != NODE_NONE;
+  }
+  size_t errors_len = parser->errors.length;
+
+  lexer->buffer = (String){.buffer = source,
+                           .length = lexer->buffer.length - edit.removed +
+                                     edit.inserted.length};
+  lexer->pos = first > 0 ? program->spans[first - 1].end : 0;
+  parser_next_token(parser);
+  parser_next_token(parser);
+
+  // the first old statement that may be resumed, and the errors before it
+  uint32_t resume = first;
+  size_t errors_dropped = 0;
+  while (true) {
+    size_t start = parser_at_end(parser)
+                       ? lexer->buffer.length + 1
+                       : parser_token_offset(parser, parser->current_token);
+    while (resume < spans_len &&
+           (program->spans[resume].start < edit_end ||
+            program->spans[resume].start + delta < (int64_t)start)) {
+      errors_dropped += program->spans[resume++].errors;
+    }
+    if (resume == spans_len && parser_at_end(parser)) {
+      break;
+    }
+    if (resume < spans_len &&
+        program->spans[resume].start + delta == (int64_t)start) {
+      break;
+    }
+    program_append_span(program, parser_parse_span(parser, &program->ast));
+    parser_next_token(parser);
+  }
+
+  // [first, resume) are replaced by the new spans after `spans_len`
+  SourceSpan *spans = program->spans;
+  for (uint32_t i = resume; i < spans_len; ++i) {
+    spans[i].start = (uint32_t)(spans[i].start + delta);
+    spans[i].end = (uint32_t)(spans[i].end + delta);
+    spans[i].depends = (uint32_t)(spans[i].depends + delta);
+  }
+  uint32_t added = program->spans_len - spans_len;
+  array_rotate(spans + first, spans_len - first, program->spans_len - first,
+               sizeof(SourceSpan));
+  memmove(spans + first + added, spans + first + added + (resume - first),
+          (spans_len - resume) * sizeof(SourceSpan));
+  program->spans_len = first + added + (spans_len - resume);
+
+  // and their errors by those reported since
+  Error *errors = parser->errors.errors;
+  size_t errors_added = parser->errors.length - errors_len;
+  size_t errors_after = errors_len - errors_kept - errors_dropped;
+  array_rotate(errors + errors_kept, errors_len - errors_kept,
+               parser->errors.length - errors_kept, sizeof(Error));
+  memmove(errors + errors_kept + errors_added,
+          errors + errors_kept + errors_added + errors_dropped,
+          errors_after * sizeof(Error));
+  parser->errors.length = errors_kept + errors_added + errors_after;
+
+  program->statements_len = statements_kept;
+  for (uint32_t i = first; i < program->spans_len; ++i) {
+    if (spans[i].statement != NODE_NONE) {
+      program_append_statement(program, spans[i].statement);
+    }
+  }
+
+  lexer->pos = lexer->buffer.length;
+  parser_next_token(parser);
+  parser_next_token(parser);
+}
+
+// parallel parsing
+
+// below this many bytes per worker, threads cost more than they save
+#ifndef PARSE_PARALLEL_MIN_BYTES
+#define PARSE_PARALLEL_MIN_BYTES (256 * 1024)
+#endif
+
+#define PARSE_JOB_ARENA_RESERVE ((size_t)1 << 30)
+
+/**
+ * Splits `input` into at most `parts` ranges of roughly equal size, each
+ * ending just after a `;` outside any braces or parentheses, which is where
+ * top-level statements end. Stores the end offset of each range in `ends`
+ * and returns how many there are.
+ */
+size_t parser_split_input(String input, size_t parts, size_t *ends) {
+  size_t count = 0;
+  size_t target = input.length / parts;
+  long depth = 0;
+  for (size_t i = 0; i < input.length && count + 1 < parts; ++i) {
+    switch (input.buffer[i]) {
+    case '{':
+    case '(':
+      ++depth;
+      break;
+    case '}':
+    case ')':
+      --depth;
+      break;
+    case ';':
+      if (depth == 0 && i + 1 >= target) {
+        ends[count++] = i + 1;
+        target = (count + 1) * (input.length / parts);
+      }
+      break;
+    }
+  }
+  ends[count++] = input.length;
+  return count;
+}
+
+/**
+ * One range of the input, parsed on its own thread into its own arena and
+ * string table, then copied into the joined program at the given offsets.
+ */
+typedef struct ParseJob {
+  String source;
+  Arena arena;
+  Program *program;
+  ErrorList errors;
+  bool out_of_memory;
+
+  Program *joined;
+  uint32_t nodes_offset;
+  uint32_t extra_offset;
+  uint32_t symbols_offset;
+  uint32_t statements_offset;
+  uint32_t spans_offset;
+  uint32_t source_offset;
+} ParseJob;
+
+void *parse_job_parse(void *arg) {
+  ParseJob *job = arg;
+  jmp_buf out_of_memory;
+  if (setjmp(out_of_memory)) {
+    job->out_of_memory = true;
+    job->program = NULL;
+    return NULL;
+  }
+  job->arena.out_of_memory = &out_of_memory;
+
+  // the lexer reads up to a NUL
+  String source = arena_strdup(&job->arena, job->source);
+  Lexer lexer = {0};
+  lexer_init(&lexer, source.buffer);
+  Parser parser = {0};
+  parser_init(&parser, &job->arena, &lexer);
+  job->program = parser_parse_program(&parser, &job->arena);
+  job->errors = parser.errors;
+
+  job->arena.out_of_memory = NULL;
+  return NULL;
+}
+
+void *parse_job_copy(void *arg) {
+  ParseJob *job = arg;
+  if (job->out_of_memory) {
+    return NULL;
+  }
+  Program *joined = job->joined;
+  ast_copy_into(&joined->ast, &job->program->ast, job->nodes_offset,
+                job->extra_offset, job->symbols_offset);
+  uint32_t shift = job->nodes_offset - 1;
+  for (uint32_t i = 0; i < job->program->statements_len; ++i) {
+    joined->statements[job->statements_offset + i] =
+        ast_shift(job->program->statements[i], shift);
+  }
+  for (uint32_t i = 0; i < job->program->spans_len; ++i) {
+    SourceSpan span = job->program->spans[i];
+    span.start += job->source_offset;
+    span.end += job->source_offset;
+    span.depends += job->source_offset;
+    span.statement = ast_shift(span.statement, shift);
+    joined->spans[job->spans_offset + i] = span;
+  }
+  return NULL;
+}
+
+/**
+ * Runs `run` on every job, each on its own thread where one can be started
+ * and otherwise on this one.
+ */
+void parse_jobs_run(ParseJob *jobs, size_t count, void *(*run)(void *),
+                    pthread_t *threads, bool *started) {
+  for (size_t i = 0; i < count; ++i) {
+    started[i] = pthread_create(&threads[i], NULL, run, &jobs[i]) == 0;
+    if (!started[i]) {
+      run(&jobs[i]);
+    }
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    }
+  }
+}
+
+/**
+ * Like `parser_parse_program`, but splits the rest of the input between up
+ * to `workers` threads at top-level statement boundaries and joins what they
+ * parse into one `Program` in `arena`, in source order. Identifiers are
+ * re-interned in the lexer's string table, so the result is
+ * indistinguishable from a sequential parse. Inputs too small to be worth
+ * splitting, and parsers reading a token stream, are parsed sequentially.
+ */
+Program *parser_parse_program_parallel(Parser *parser, Arena *arena,
+                                       size_t workers) {
+  Lexer *lexer = parser->lexer;
+  size_t start = parser_token_offset(parser, parser->current_token);
+  String input = {.buffer = lexer->buffer.buffer + start,
+                  .length = lexer->buffer.length - start};
+  size_t parts = input.length / PARSE_PARALLEL_MIN_BYTES;
+  parts = parts < workers ? parts : workers;
+  if (parser->tokens || parts < 2 || !lexer->finished ||
+      parser_at_end(parser)) {
+    return parser_parse_program(parser, arena);
+  }
+
+  size_t *ends = arena_alloc(arena, parts * sizeof(size_t));
+  size_t count = parser_split_input(input, parts, ends);
+  if (count < 2) {
+    return parser_parse_program(parser, arena);
+  }
+
+#ifdef STRING_SIMD_X86
+  string_has_avx2(); // caches the CPU check before the workers read it
+#endif
+
+  ParseJob *jobs = arena_alloc(arena, count * sizeof(ParseJob));
+  pthread_t *threads = arena_alloc(arena, count * sizeof(pthread_t));
+  bool *started = arena_alloc(arena, count * sizeof(bool));
+  size_t begin = 0;
+  for (size_t i = 0; i < count; ++i) {
+    jobs[i].source =
+        (String){.buffer = input.buffer + begin, .length = ends[i] - begin};
+    begin = ends[i];
+    if (!arena_init_virtual(&jobs[i].arena, PARSE_JOB_ARENA_RESERVE, false)) {
+      for (size_t j = 0; j < i; ++j) {
+        arena_release(&jobs[j].arena);
+      }
+      return parser_parse_program(parser, arena);
+    }
+  }
+  parse_jobs_run(jobs, count, parse_job_parse, threads, started);
+
+  // lay the jobs' trees out one after another
+  Program *program = program_create(arena);
+  Ast *ast = &program->ast;
+  uint32_t nodes_len = 1, extra_len = 0, symbols_len = 0, statements_len = 0;
+  uint32_t spans_len = 0;
+  bool complete = true;
+  for (size_t i = 0; i < count; ++i) {
+    ParseJob *job = &jobs[i];
+    if (job->out_of_memory) {
+      error_list_append(&parser->errors, arena,
+                        String("out of memory while parsing"));
+      complete = false;
+      continue;
+    }
+    for (size_t j = 0; j < job->errors.length; ++j) {
+      error_list_append(&parser->errors, arena,
+                        arena_strdup(arena, job->errors.errors[j].message));
+    }
+    const Ast *job_ast = &job->program->ast;
+    job->joined = program;
+    job->nodes_offset = nodes_len;
+    job->extra_offset = extra_len;
+    job->symbols_offset = symbols_len;
+    job->statements_offset = statements_len;
+    job->spans_offset = spans_len;
+    job->source_offset = (uint32_t)(job->source.buffer - lexer->buffer.buffer);
+    nodes_len += job_ast->nodes_len - 1;
+    extra_len += job_ast->extra_len;
+    symbols_len += job_ast->symbols_len;
+    statements_len += job->program->statements_len;
+    spans_len += job->program->spans_len;
+  }
+  ast->nodes = ast_reserve(arena, ast->nodes, &ast->nodes_capacity,
+                           sizeof(Node), nodes_len);
+  ast->extra = ast_reserve(arena, ast->extra, &ast->extra_capacity,
+                           sizeof(uint32_t), extra_len);
+  ast->symbols =
+      ast_reserve(arena, ast->symbols, &ast->symbols_capacity,
+                  sizeof(const InternedString *), symbols_len);
+  program->statements =
+      ast_reserve(arena, program->statements, &program->statements_capacity,
+                  sizeof(NodeIndex), statements_len);
+  program->spans = ast_reserve(arena, program->spans, &program->spans_capacity,
+                               sizeof(SourceSpan), spans_len);
+
+  // the string table is not thread-safe, so names are interned here
+  for (size_t i = 0; i < count; ++i) {
+    if (jobs[i].out_of_memory) {
+      continue;
+    }
+    const Ast *job_ast = &jobs[i].program->ast;
+    for (uint32_t j = 0; j < job_ast->symbols_len; ++j) {
+      ast->symbols[jobs[i].symbols_offset + j] =
+          string_table_intern(lexer->strings, job_ast->symbols[j]->string);
+    }
+  }
+
+  parse_jobs_run(jobs, count, parse_job_copy, threads, started);
+  ast->nodes_len = nodes_len;
+  ast->extra_len = extra_len;
+  ast->symbols_len = symbols_len;
+  program->statements_len = statements_len;
+  // with a range missing, the spans no longer cover the errors
+  program->spans_len = complete ? spans_len : 0;
+
+  for (size_t i = 0; i < count; ++i) {
+    arena_release(&jobs[i].arena);
+  }
+
+  lexer->pos = lexer->buffer.length;
+  parser_next_token(parser);
+  parser_next_token(parser);
+  return program;
+}
+
+NodeIndex parser_parse_statement(Parser *parser, Ast *ast) {
   switch (parser->current_token.type) {
   case TOKEN_LET:
-    parser_parse_let_statement(parser, arena, statement);
-    break;
+    return parser_parse_let_statement(parser, ast);
   case TOKEN_RETURN:
-    parser_parse_return_statement(parser, arena, statement);
-    break;
+    return parser_parse_return_statement(parser, ast);
   default:
-    parser_parse_expression_statement(parser, arena, statement);
-    break;
+    return parser_parse_expression_statement(parser, ast);
   }
 }
 
-void parser_parse_let_statement(Parser *parser, Arena *arena,
-                                Statement *statement) {
-  LetStatement let = {0};
-  let.token = parser->current_token;
-
-  if (!parser_expect_peek(parser, arena, TOKEN_IDENT)) {
-    return;
+NodeIndex parser_parse_let_statement(Parser *parser, Ast *ast) {
+  if (!parser_expect_peek(parser, ast->arena, TOKEN_IDENT)) {
+    return NODE_NONE;
   }
 
-  let.name = arena_alloc(arena, sizeof(Identifier));
-  let.name->token = parser->current_token;
-  let.name->value = parser->current_token.literal;
+  NodeIndex name = parser_parse_identifier(parser, ast);
 
-  if (!parser_expect_peek(parser, arena, TOKEN_ASSIGN)) {
-    return;
+  if (!parser_expect_peek(parser, ast->arena, TOKEN_ASSIGN)) {
+    return NODE_NONE;
   }
 
   parser_next_token(parser);
-  let.value = arena_alloc(arena, sizeof(Expression));
-  parser_parse_expression(parser, arena, let.value, PRECEDENCE_LOWEST);
+  NodeIndex value = parser_parse_expression(parser, ast, PRECEDENCE_LOWEST);
 
   if (parser->peek_token.type == TOKEN_SEMICOLON) {
     parser_next_token(parser);
   }
 
-  statement->type = STATEMENT_LET;
-  statement->data.let_statement = let;
+  return ast_add_let(ast, name, value);
 }
 
-void parser_parse_return_statement(Parser *parser, Arena *arena,
-                                   Statement *statement) {
-  ReturnStatement ret = {0};
-  ret.token = parser->current_token;
-
+NodeIndex parser_parse_return_statement(Parser *parser, Ast *ast) {
   parser_next_token(parser);
 
-  ret.return_value = arena_alloc(arena, sizeof(Expression));
-  parser_parse_expression(parser, arena, ret.return_value, PRECEDENCE_LOWEST);
+  NodeIndex value = parser_parse_expression(parser, ast, PRECEDENCE_LOWEST);
 
   if (parser->peek_token.type == TOKEN_SEMICOLON) {
     parser_next_token(parser);
   }
 
-  statement->type = STATEMENT_RETURN;
-  statement->data.return_statement = ret;
+  return ast_add_return(ast, value);
+}
+
+void parser_push_frame(Parser *parser, Frame frame) {
+  parser->frames = ast_reserve(parser->scratch_arena, parser->frames,
+                               &parser->frames_capacity, sizeof(Frame),
+                               parser->frames_len + 1);
+  parser->frames[parser->frames_len++] = frame;
 }
 
-void parser_parse_expression(Parser *parser, Arena *arena,
-                             Expression *expression, Precedence precedence) {
-  // parse prefix
+/** What `parser_parse_expression` does next. */
+typedef enum ExpressionStep {
+  STEP_OPERAND,  // parse an operand starting at the current token
+  STEP_OPERATOR, // apply any operators following `left`
+  STEP_REDUCE,   // `left` is complete; hand it to the innermost frame
+} ExpressionStep;
+
+/**
+ * Parses the operand starting at the current token into `*left`. Prefix
+ * operators and parentheses open a frame for the operand that follows.
+ */
+ExpressionStep parser_parse_operand(Parser *parser, Ast *ast,
+                                    Precedence *precedence, NodeIndex *left) {
   switch (parser->current_token.type) {
   case TOKEN_IDENT:
-    parser_parse_identifier(parser, expression);
-    break;
+    *left = parser_parse_identifier(parser, ast);
+    return STEP_OPERATOR;
   case TOKEN_INT:
-    parser_parse_integer_literal(parser, arena, expression);
-    break;
-  case TOKEN_BANG:
-  case TOKEN_MINUS:
-    parser_parse_prefix_expression(parser, arena, expression);
-    break;
+    *left = parser_parse_integer_literal(parser, ast);
+    return STEP_OPERATOR;
   case TOKEN_TRUE:
   case TOKEN_FALSE:
-    parser_parse_boolean(parser, expression);
-    break;
-  case TOKEN_LPAREN:
-    parser_parse_grouped_expression(parser, arena, expression);
-    break;
+    *left = parser_parse_boolean(parser, ast);
+    return STEP_OPERATOR;
   case TOKEN_IF:
-    parser_parse_if_expression(parser, arena, expression);
-    break;
+    *left = parser_parse_if_expression(parser, ast);
+    return STEP_OPERATOR;
   case TOKEN_FUNCTION:
-    parser_parse_function_literal(parser, arena, expression);
-    break;
+    *left = parser_parse_function_literal(parser, ast);
+    return STEP_OPERATOR;
+  case TOKEN_BANG:
+  case TOKEN_MINUS: {
+    Operator op = operator_from_token_type(parser->current_token.type);
+    parser_push_frame(parser, (Frame){.type = FRAME_PREFIX,
+                                      .operator = op,
+                                      .precedence = *precedence});
+    parser_next_token(parser);
+    *precedence = PRECEDENCE_PREFIX;
+    return STEP_OPERAND;
+  }
+  case TOKEN_LPAREN:
+    parser_push_frame(parser,
+                      (Frame){.type = FRAME_GROUP, .precedence = *precedence});
+    parser_next_token(parser);
+    *precedence = PRECEDENCE_LOWEST;
+    return STEP_OPERAND;
   default: {
-    String msg =
-        string_fmt(arena, "no prefix parse function found for token type %.*s",
-                   token_type_strings[parser->current_token.type].length,
-                   token_type_strings[parser->current_token.type].buffer);
-    error_list_append(&parser->errors, arena, msg);
-    return;
+    String msg = string_fmt(
+        ast->arena, "no prefix parse function found for token type %.*s",
+        token_type_strings[parser->current_token.type].length,
+        token_type_strings[parser->current_token.type].buffer);
+    error_list_append(&parser->errors, ast->arena, msg);
+    // nothing to apply operators to, so this operand's expression ends here
+    *left = NODE_NONE;
+    return STEP_REDUCE;
+  }
+  }
+}
+
+/**
+ * Applies the next operator after `*left` if it binds tighter than
+ * `precedence`. Binary operators and calls open a frame for their (first)
+ * right operand.
+ */
+ExpressionStep parser_parse_operator(Parser *parser, Ast *ast,
+                                     Precedence *precedence, NodeIndex *left) {
+  if (parser->peek_token.type == TOKEN_SEMICOLON ||
+      *precedence >= token_type_to_precedence(parser->peek_token.type)) {
+    return STEP_REDUCE;
+  }
+
+  switch (parser->peek_token.type) {
+  case TOKEN_PLUS:
+  case TOKEN_MINUS:
+  case TOKEN_SLASH:
+  case TOKEN_ASTERISK:
+  case TOKEN_EQ:
+  case TOKEN_NOT_EQ:
+  case TOKEN_LT:
+  case TOKEN_GT: {
+    parser_next_token(parser);
+    Operator op = operator_from_token_type(parser->current_token.type);
+    parser_push_frame(parser, (Frame){.type = FRAME_INFIX,
+                                      .operator = op,
+                                      .precedence = *precedence,
+                                      .node = *left});
+    *precedence = token_type_to_precedence(parser->current_token.type);
+    parser_next_token(parser);
+    return STEP_OPERAND;
   }
+  case TOKEN_LPAREN:
+    parser_next_token(parser);
+    if (parser->peek_token.type == TOKEN_RPAREN) {
+      parser_next_token(parser);
+      *left = ast_add_call(ast, *left, NULL, 0);
+      return STEP_OPERATOR;
+    }
+    parser_next_token(parser);
+    parser_push_frame(parser, (Frame){.type = FRAME_CALL,
+                                      .precedence = *precedence,
+                                      .node = *left,
+                                      .base = parser->scratch_len});
+    *precedence = PRECEDENCE_LOWEST;
+    return STEP_OPERAND;
+  default:
+    return STEP_REDUCE;
   }
+}
 
-  while (parser->peek_token.type != TOKEN_SEMICOLON &&
-         precedence < token_type_to_precedence(parser->peek_token.type)) {
-    // parse infix
-    switch (parser->peek_token.type) {
-    case TOKEN_PLUS:
-    case TOKEN_MINUS:
-    case TOKEN_SLASH:
-    case TOKEN_ASTERISK:
-    case TOKEN_EQ:
-    case TOKEN_NOT_EQ:
-    case TOKEN_LT:
-    case TOKEN_GT: {
+/**
+ * Completes the innermost frame with `*left` as its operand, leaving the
+ * result in `*left`, or moves a call on to its next argument.
+ */
+ExpressionStep parser_reduce(Parser *parser, Ast *ast, Precedence *precedence,
+                             NodeIndex *left) {
+  Frame frame = parser->frames[--parser->frames_len];
+  *precedence = frame.precedence;
+
+  switch (frame.type) {
+  case FRAME_PREFIX:
+    *left = ast_add_prefix(ast, frame.operator, *left);
+    break;
+  case FRAME_INFIX:
+    *left = ast_add_infix(ast, frame.operator, frame.node, *left);
+    break;
+  case FRAME_GROUP:
+    parser_expect_peek(parser, ast->arena, TOKEN_RPAREN);
+    break;
+  case FRAME_CALL:
+    parser_push(parser, *left);
+    if (parser->peek_token.type == TOKEN_COMMA) {
       parser_next_token(parser);
-      parser_parse_infix_expression(parser, arena, expression);
-    } break;
-    case TOKEN_LPAREN:
       parser_next_token(parser);
-      parser_parse_call_expression(parser, arena, expression);
+      ++parser->frames_len;
+      *precedence = PRECEDENCE_LOWEST;
+      return STEP_OPERAND;
+    }
+    if (parser_expect_peek(parser, ast->arena, TOKEN_RPAREN)) {
+      *left = ast_add_call(ast, frame.node, &parser->scratch[frame.base],
+                           parser->scratch_len - frame.base);
+    } else {
+      *left = NODE_NONE;
+    }
+    parser->scratch_len = frame.base;
+    break;
+  }
+  return STEP_OPERATOR;
+}
+
+/**
+ * Parses an expression by precedence climbing. Operators whose right operand
+ * is still being parsed wait on the parser's frame stack rather than in
+ * nested calls, so the depth of nesting costs heap, not C stack. Only `if`
+ * and function literals, whose blocks hold statements, recurse.
+ */
+NodeIndex parser_parse_expression(Parser *parser, Ast *ast,
+                                  Precedence precedence) {
+  uint32_t base = parser->frames_len;
+  NodeIndex left = NODE_NONE;
+  ExpressionStep step = STEP_OPERAND;
+  while (true) {
+    switch (step) {
+    case STEP_OPERAND:
+      step = parser_parse_operand(parser, ast, &precedence, &left);
+      break;
+    case STEP_OPERATOR:
+      step = parser_parse_operator(parser, ast, &precedence, &left);
+      break;
+    case STEP_REDUCE:
+      if (parser->frames_len == base) {
+        return left;
+      }
+      step = parser_reduce(parser, ast, &precedence, &left);
       break;
-    default:
-      return;
     }
   }
 }
 
-void parser_parse_expression_statement(Parser *parser, Arena *arena,
-                                       Statement *statement) {
-  statement->type = STATEMENT_EXPRESSION;
-  statement->data.expression_statement = (ExpressionStatement){
-      .token = parser->current_token,
-      .expression = arena_alloc(arena, sizeof(Expression)),
-  };
-  parser_parse_expression(parser, arena,
-                          statement->data.expression_statement.expression,
-                          PRECEDENCE_LOWEST);
+NodeIndex parser_parse_expression_statement(Parser *parser, Ast *ast) {
+  NodeIndex expression =
+      parser_parse_expression(parser, ast, PRECEDENCE_LOWEST);
 
   if (parser->peek_token.type == TOKEN_SEMICOLON) {
     parser_next_token(parser);
   }
+
+  return ast_add_expression_statement(ast, expression);
 }
 
-void parser_parse_identifier(Parser *parser, Expression *expression) {
-  expression->type = EXPRESSION_IDENTIFIER;
-  expression->data.identifier = (Identifier){
-      .token = parser->current_token,
-      .value = parser->current_token.literal,
-  };
+NodeIndex parser_parse_identifier(Parser *parser, Ast *ast) {
+  return ast_add_identifier(ast, parser->current_token.symbol);
 }
 
-void parser_parse_integer_literal(Parser *parser, Arena *arena,
-                                  Expression *expression) {
+NodeIndex parser_parse_integer_literal(Parser *parser, Ast *ast) {
+  if (parser->tokens) {
+    return ast_add_integer(ast, parser->current_integer);
+  }
+
   size_t end_ptr;
   int64_t value = string_to_int64(parser->current_token.literal, &end_ptr);
   if (end_ptr != parser->current_token.literal.length) {
-    String message = string_fmt(arena, "could not parse %.*s as integer",
+    String message = string_fmt(ast->arena, "could not parse %.*s as integer",
                                 parser->current_token.literal.length,
                                 parser->current_token.literal.buffer);
-    error_list_append(&parser->errors, arena, message);
-    return;
+    error_list_append(&parser->errors, ast->arena, message);
+    return NODE_NONE;
   }
 
-  expression->type = EXPRESSION_INTEGER;
-  expression->data.integer = (IntegerLiteral){
-      .token = parser->current_token,
-      .value = value,
-  };
+  return ast_add_integer(ast, value);
 }
 
-void parser_parse_prefix_expression(Parser *parser, Arena *arena,
-                                    Expression *expression) {
-  PrefixExpression prefix = {0};
-  prefix.token = parser->current_token;
-  prefix.op = parser->current_token.literal;
-
-  parser_next_token(parser);
-
-  prefix.right = arena_alloc(arena, sizeof(Expression));
-  parser_parse_expression(parser, arena, prefix.right, PRECEDENCE_PREFIX);
-
-  expression->type = EXPRESSION_PREFIX;
-  expression->data.prefix = prefix;
+NodeIndex parser_parse_boolean(Parser *parser, Ast *ast) {
+  return ast_add_boolean(ast, parser->current_token.type == TOKEN_TRUE);
 }
 
-void parser_parse_infix_expression(Parser *parser, Arena *arena,
-                                   Expression *expression) {
-  InfixExpression infix = {0};
-  infix.token = parser->current_token;
-  infix.op = parser->current_token.literal;
-
-  infix.left = arena_alloc(arena, sizeof(Expression));
-  memcpy(infix.left, expression, sizeof(Expression));
-
-  Precedence precedence = token_type_to_precedence(parser->current_token.type);
-  parser_next_token(parser);
-
-  infix.right = arena_alloc(arena, sizeof(Expression));
-  parser_parse_expression(parser, arena, infix.right, precedence);
-
-  expression->type = EXPRESSION_INFIX;
-  expression->data.infix = infix;
-}
-
-void parser_parse_boolean(Parser *parser, Expression *expression) {
-  expression->type = EXPRESSION_BOOLEAN;
-  expression->data.boolean = (Boolean){
-      .token = parser->current_token,
-      .value = parser->current_token.type == TOKEN_TRUE,
-  };
-}
-
-void parser_parse_grouped_expression(Parser *parser, Arena *arena,
-                                     Expression *expression) {
-  parser_next_token(parser);
-  parser_parse_expression(parser, arena, expression, PRECEDENCE_LOWEST);
-  if (!parser_expect_peek(parser, arena, TOKEN_RPAREN)) {
-    expression = NULL;
-  }
-}
-
-void parser_parse_block_statement(Parser *parser, Arena *arena,
-                                  BlockStatement *block) {
-  block->token = parser->current_token;
-
+NodeIndex parser_parse_block_statement(Parser *parser, Ast *ast) {
   parser_next_token(parser);
 
+  uint32_t base = parser->scratch_len;
   while (parser->current_token.type != TOKEN_RBRACE &&
-         parser->current_token.type != TOKEN_EOF) {
-    Statement s = {0};
-    parser_parse_statement(parser, arena, &s);
-    block_statement_append_statement(block, arena, s);
+         !parser_at_end(parser)) {
+    NodeIndex s = parser_parse_statement(parser, ast);
+    if (s != NODE_NONE) {
+      parser_push(parser, s);
+    }
     parser_next_token(parser);
   }
-}
 
-void parser_parse_if_expression(Parser *parser, Arena *arena,
-                                Expression *expression) {
-  IfExpression ie = {0};
-  ie.token = parser->current_token;
+  NodeIndex block = ast_add_block(ast, &parser->scratch[base],
+                                  parser->scratch_len - base);
+  parser->scratch_len = base;
+  return block;
+}
 
-  if (!parser_expect_peek(parser, arena, TOKEN_LPAREN)) {
-    return;
+NodeIndex parser_parse_if_expression(Parser *parser, Ast *ast) {
+  if (!parser_expect_peek(parser, ast->arena, TOKEN_LPAREN)) {
+    return NODE_NONE;
   }
 
   parser_next_token(parser);
 
-  ie.condition = arena_alloc(arena, sizeof(Expression));
-  parser_parse_expression(parser, arena, ie.condition, PRECEDENCE_LOWEST);
+  NodeIndex condition = parser_parse_expression(parser, ast, PRECEDENCE_LOWEST);
 
-  if (!parser_expect_peek(parser, arena, TOKEN_RPAREN)) {
-    return;
+  if (!parser_expect_peek(parser, ast->arena, TOKEN_RPAREN)) {
+    return NODE_NONE;
   }
 
-  if (!parser_expect_peek(parser, arena, TOKEN_LBRACE)) {
-    return;
+  if (!parser_expect_peek(parser, ast->arena, TOKEN_LBRACE)) {
+    return NODE_NONE;
   }
 
-  ie.consequence = block_statement_create(arena);
-  parser_parse_block_statement(parser, arena, ie.consequence);
+  NodeIndex consequence = parser_parse_block_statement(parser, ast);
+  NodeIndex alternative = NODE_NONE;
 
   if (parser->peek_token.type == TOKEN_ELSE) {
     parser_next_token(parser);
 
-    if (!parser_expect_peek(parser, arena, TOKEN_LBRACE)) {
-      return;
+    if (!parser_expect_peek(parser, ast->arena, TOKEN_LBRACE)) {
+      return NODE_NONE;
     }
 
-    ie.alternative = block_statement_create(arena);
-    parser_parse_block_statement(parser, arena, ie.alternative);
+    alternative = parser_parse_block_statement(parser, ast);
   }
 
-  expression->type = EXPRESSION_IF;
-  expression->data.if_expression = ie;
+  return ast_add_if(ast, condition, consequence, alternative);
 }
 
-void parser_parse_function_literal(Parser *parser, Arena *arena,
-                                   Expression *expression) {
-  FunctionLiteral fn = {0};
-  fn.token = parser->current_token;
-
-  if (!parser_expect_peek(parser, arena, TOKEN_LPAREN)) {
-    return;
+NodeIndex parser_parse_function_literal(Parser *parser, Ast *ast) {
+  if (!parser_expect_peek(parser, ast->arena, TOKEN_LPAREN)) {
+    return NODE_NONE;
   }
 
-  // FIXME: only supports up to 8 params
-  fn.parameters.items =
-      arena_alloc(arena, 8 * sizeof(Identifier)); // initial size of 8
-  fn.parameters.length = 0;
-  fn.parameters.capacity = 8;
-
+  uint32_t base = parser->scratch_len;
   if (parser->peek_token.type == TOKEN_RPAREN) {
     parser_next_token(parser);
   } else {
-    parser_next_token(parser);
-    Identifier ident = {
-        .token = parser->current_token,
-        .value = parser->current_token.literal,
-    };
-    fn.parameters.items[fn.parameters.length++] = ident;
-
-    while (parser->peek_token.type == TOKEN_COMMA) {
-      parser_next_token(parser);
-      parser_next_token(parser);
-      Identifier ident = {
-          .token = parser->current_token,
-          .value = parser->current_token.literal,
-      };
-      fn.parameters.items[fn.parameters.length++] = ident;
-    }
-
-    if (!parser_expect_peek(parser, arena, TOKEN_RPAREN)) {
-      return;
+    do {
+      if (parser->scratch_len > base) {
+        parser_next_token(parser);
+      }
+      if (!parser_expect_peek(parser, ast->arena, TOKEN_IDENT)) {
+        parser->scratch_len = base;
+        return NODE_NONE;
+      }
+      parser_push(parser, parser_parse_identifier(parser, ast));
+    } while (parser->peek_token.type == TOKEN_COMMA);
+
+    if (!parser_expect_peek(parser, ast->arena, TOKEN_RPAREN)) {
+      parser->scratch_len = base;
+      return NODE_NONE;
     }
   }
 
-  if (!parser_expect_peek(parser, arena, TOKEN_LBRACE)) {
-    return;
-  }
-
-  fn.body = block_statement_create(arena);
-  parser_parse_block_statement(parser, arena, fn.body);
-
-  expression->type = EXPRESSION_FUNCTION;
-  expression->data.function = fn;
-}
-
-void parser_parse_call_expression(Parser *parser, Arena *arena,
-                                  Expression *expression) {
-  CallExpression call = {0};
-  call.token = parser->current_token;
-
-  call.function = arena_alloc(arena, sizeof(Expression));
-  memcpy(call.function, expression, sizeof(Expression));
-
-  // parse call args
-  // FIXME: only supports 8 args
-  call.arguments.items = arena_alloc(arena, 8 * sizeof(Expression));
-  call.arguments.length = 0;
-  call.arguments.capacity = 8;
-
-  if (parser->peek_token.type == TOKEN_RPAREN) {
-    parser_next_token(parser);
-  } else {
-    parser_next_token(parser);
-
-    Expression arg = {0};
-    parser_parse_expression(parser, arena, &arg, PRECEDENCE_LOWEST);
-    call.arguments.items[call.arguments.length++] = arg;
-
-    while (parser->peek_token.type == TOKEN_COMMA) {
-      parser_next_token(parser);
-      parser_next_token(parser);
-
-      Expression arg = {0};
-      parser_parse_expression(parser, arena, &arg, PRECEDENCE_LOWEST);
-      call.arguments.items[call.arguments.length++] = arg;
-    }
-
-    if (!parser_expect_peek(parser, arena, TOKEN_RPAREN)) {
-      return;
-    }
+  if (!parser_expect_peek(parser, ast->arena, TOKEN_LBRACE)) {
+    parser->scratch_len = base;
+    return NODE_NONE;
   }
 
-  memset(expression, 0, sizeof(Expression));
-  expression->type = EXPRESSION_CALL;
-  expression->data.call = call;
+  // the body's statements go on the stack above the parameters
+  NodeIndex body = parser_parse_block_statement(parser, ast);
+  NodeIndex function = ast_add_function(ast, &parser->scratch[base],
+                                        parser->scratch_len - base, body);
+  parser->scratch_len = base;
+  return function;
 }
 
 void parser_peek_error(Parser *parser, Arena *arena, TokenType token_type) {
@@ -0,0 +1,146 @@
+#pragma once
+
+#include "ast.c"
+#include "env.c"
+#include "mem.c"
+#include <stddef.h>
+#include <stdint.h>
+
+void resolve_statement(Arena *arena, Arena *env_arena, Environment *env,
+                       Ast *ast, NodeIndex statement);
+void resolve_expression(Arena *arena, Arena *env_arena, Environment *env,
+                        Ast *ast, NodeIndex expression);
+void resolve_block_statement(Arena *arena, Arena *env_arena, Environment *env,
+                             Ast *ast, NodeIndex block);
+
+/**
+ * Assigns every identifier node in `program` a (depth, slot) address
+ * relative to `env`. Must run between `parser_parse_program` and
+ * `eval_program`, with the same environment that will be used for
+ * evaluation. New top-level names are declared in `env` (and copied into
+ * `env_arena`) so that they stay addressable across REPL lines; function
+ * scopes only live in `arena`.
+ *
+ * Names are compared by identity, so every program resolved against `env`
+ * must have been parsed with the same string table.
+ *
+ * Identifiers that do not resolve, or that are nested too deeply for
+ * `Node.depth`, are left unresolved and are reported as "identifier not
+ * found" when evaluated.
+ */
+void resolve_program(Program *program, Arena *arena, Arena *env_arena,
+                     Environment *env) {
+  for (uint32_t i = 0; i < program->statements_len; ++i) {
+    resolve_statement(arena, env_arena, env, &program->ast,
+                      program->statements[i]);
+  }
+}
+
+void resolve_identifier(const Environment *env, const Ast *ast, Node *node) {
+  size_t depth, slot;
+  node->resolved = environment_resolve(env, ast_identifier_symbol(ast, node),
+                                       &depth, &slot) &&
+                   depth <= UINT8_MAX;
+  if (node->resolved) {
+    node->depth = (uint8_t)depth;
+    node->rhs = (uint32_t)slot;
+  }
+}
+
+/** Declares the identifier `name` in `env`, which is its innermost scope. */
+void resolve_define(Environment *env, Arena *arena, Ast *ast, NodeIndex name) {
+  Node *node = ast_node_mut(ast, name);
+  node->rhs = (uint32_t)environment_define(env, arena,
+                                           ast_identifier_symbol(ast, node));
+  node->depth = 0;
+  node->resolved = true;
+}
+
+void resolve_statement(Arena *arena, Arena *env_arena, Environment *env,
+                       Ast *ast, NodeIndex statement) {
+  const Node *node = ast_node(ast, statement);
+  switch (node->type) {
+  case NODE_LET:
+    if (node->lhs == NODE_NONE) {
+      break;
+    }
+    // resolve the value first so that `let x = x;` refers to an outer `x`
+    if (node->rhs != NODE_NONE) {
+      resolve_expression(arena, env_arena, env, ast, node->rhs);
+    }
+    resolve_define(env, env_arena, ast, node->lhs);
+    break;
+  case NODE_RETURN:
+  case NODE_EXPRESSION_STATEMENT:
+    if (node->lhs != NODE_NONE) {
+      resolve_expression(arena, env_arena, env, ast, node->lhs);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void resolve_block_statement(Arena *arena, Arena *env_arena, Environment *env,
+                             Ast *ast, NodeIndex block) {
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(ast, ast_node(ast, block)->lhs, &length);
+
+  for (uint32_t i = 0; i < length; ++i) {
+    resolve_statement(arena, env_arena, env, ast, statements[i]);
+  }
+}
+
+void resolve_expression(Arena *arena, Arena *env_arena, Environment *env,
+                        Ast *ast, NodeIndex expression) {
+  Node *node = ast_node_mut(ast, expression);
+  switch (node->type) {
+  case NODE_IDENTIFIER:
+    resolve_identifier(env, ast, node);
+    break;
+  case NODE_PREFIX:
+    resolve_expression(arena, env_arena, env, ast, node->lhs);
+    break;
+  case NODE_INFIX:
+    resolve_expression(arena, env_arena, env, ast, node->lhs);
+    resolve_expression(arena, env_arena, env, ast, node->rhs);
+    break;
+  case NODE_IF: {
+    resolve_expression(arena, env_arena, env, ast, node->lhs);
+    // blocks share the enclosing environment, as they do in the evaluator
+    NodeIndex consequence = ast_if_consequence(ast, node);
+    NodeIndex alternative = ast_if_alternative(ast, node);
+    if (consequence != NODE_NONE) {
+      resolve_block_statement(arena, env_arena, env, ast, consequence);
+    }
+    if (alternative != NODE_NONE) {
+      resolve_block_statement(arena, env_arena, env, ast, alternative);
+    }
+  } break;
+  case NODE_FUNCTION: {
+    // the function's scope is laid out like the environment a call will
+    // create: parameters first, then the body's `let`s
+    Environment *scope = arena_alloc(arena, sizeof(Environment));
+    environment_init_enclosed(scope, arena, env);
+    uint32_t length;
+    const NodeIndex *parameters = ast_list(ast, node->rhs, &length);
+    for (uint32_t i = 0; i < length; ++i) {
+      resolve_define(scope, arena, ast, parameters[i]);
+    }
+    if (node->lhs != NODE_NONE) {
+      resolve_block_statement(arena, arena, scope, ast, node->lhs);
+    }
+  } break;
+  case NODE_CALL: {
+    resolve_expression(arena, env_arena, env, ast, node->lhs);
+    uint32_t length;
+    const NodeIndex *arguments = ast_list(ast, node->rhs, &length);
+    for (uint32_t i = 0; i < length; ++i) {
+      resolve_expression(arena, env_arena, env, ast, arguments[i]);
+    }
+  } break;
+  default:
+    break;
+  }
+}
@@ -4,6 +4,7 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -41,58 +42,141 @@ bool string_cmp(String s1, String s2) {
          strncmp(s1.buffer, s2.buffer, s1.length) == 0;
 }
 
-typedef struct StringBuilder {
-  String *chunks;
-  size_t capacity;
+/**
+ * An output sink that formats straight into its buffer. An arena writer
+ * (`writer_init_arena`) grows its buffer in the arena and hands the result
+ * back with `writer_string`. A file writer (`writer_init_file`) uses a
+ * caller-provided buffer of at least 32 bytes and writes it out whenever it
+ * fills up, and on `writer_flush`.
+ */
+typedef struct Writer {
+  char *buffer;
   size_t length;
-  Arena *arena;
-} StringBuilder;
+  size_t capacity;
+  Arena *arena; // NULL for file writers
+  FILE *file;   // NULL for arena writers
+} Writer;
+
+void writer_init_arena(Writer *writer, Arena *arena) {
+  writer->capacity = 64;
+  writer->length = 0;
+  writer->buffer = arena_alloc(arena, writer->capacity);
+  writer->arena = arena;
+  writer->file = NULL;
+}
+
+void writer_init_file(Writer *writer, FILE *file, char *buffer,
+                      size_t capacity) {
+  writer->buffer = buffer;
+  writer->length = 0;
+  writer->capacity = capacity;
+  writer->arena = NULL;
+  writer->file = file;
+}
+
+void writer_flush(Writer *writer) {
+  if (writer->file && writer->length > 0) {
+    fwrite(writer->buffer, 1, writer->length, writer->file);
+    writer->length = 0;
+  }
+}
 
-StringBuilder string_builder_create(Arena *arena) {
-  return (StringBuilder){
-      .chunks = arena_alloc(arena, 8 * sizeof(String)),
-      .capacity = 8,
-      .length = 0,
-      .arena = arena,
-  };
+/**
+ * Makes room for `size` more bytes, flushing or growing the buffer. A file
+ * writer may end up with less room than asked for if `size` exceeds its
+ * whole buffer, in which case callers write around the buffer.
+ */
+void writer_reserve(Writer *writer, size_t size) {
+  if (writer->length + size <= writer->capacity) {
+    return;
+  }
+  if (writer->file) {
+    writer_flush(writer);
+    return;
+  }
+
+  size_t new_capacity = writer->capacity * 2;
+  while (new_capacity < writer->length + size) {
+    new_capacity *= 2;
+  }
+  // grows in place as long as nothing else was allocated in the meantime
+  writer->buffer = arena_resize(writer->arena, writer->buffer,
+                                writer->capacity, new_capacity);
+  writer->capacity = new_capacity;
 }
 
-void string_builder_append(StringBuilder *sb, String s) {
-  if (sb->length == sb->capacity) {
-    size_t new_capacity = sb->capacity * 2;
-    String *new_chunks = arena_alloc(sb->arena, new_capacity * sizeof(String));
-    memcpy(new_chunks, sb->chunks, sb->length * sizeof(String));
-    sb->chunks = new_chunks;
-    sb->capacity = new_capacity;
+void writer_write(Writer *writer, const char *data, size_t size) {
+  writer_reserve(writer, size);
+  if (writer->length + size > writer->capacity) {
+    fwrite(data, 1, size, writer->file);
+    return;
   }
+  memcpy(writer->buffer + writer->length, data, size);
+  writer->length += size;
+}
 
-  char *buf = arena_alloc(sb->arena, s.length);
-  memcpy(buf, s.buffer, s.length);
+void writer_write_string(Writer *writer, String s) {
+  writer_write(writer, s.buffer, s.length);
+}
 
-  sb->chunks[sb->length++] = (String){
-      .buffer = buf,
-      .length = s.length,
-  };
+void writer_write_char(Writer *writer, char c) {
+  writer_reserve(writer, 1);
+  writer->buffer[writer->length++] = c;
 }
 
-String string_builder_build(StringBuilder *sb) {
-  size_t total_length = 0;
-  for (size_t i = 0; i < sb->length; ++i) {
-    total_length += sb->chunks[i].length;
+void writer_write_int64(Writer *writer, int64_t value) {
+  char digits[20];
+  size_t n = 0;
+  // negate digit by digit so that INT64_MIN does not overflow
+  bool negative = value < 0;
+  do {
+    int digit = (int)(value % 10);
+    digits[n++] = (char)('0' + (negative ? -digit : digit));
+    value /= 10;
+  } while (value != 0);
+
+  writer_reserve(writer, n + 1);
+  if (negative) {
+    writer->buffer[writer->length++] = '-';
   }
+  while (n > 0) {
+    writer->buffer[writer->length++] = digits[--n];
+  }
+}
 
-  char *buffer = arena_alloc(sb->arena, total_length);
-  size_t offset = 0;
+/**
+ * printf-style formatting into the writer. The common case costs a single
+ * `vsnprintf` directly into the buffer.
+ */
+void writer_fmt(Writer *writer, const char *fmt, ...) {
+  va_list args1;
+  va_list args2;
+  va_start(args1, fmt);
+  va_copy(args2, args1);
+
+  size_t available = writer->capacity - writer->length;
+  int len = vsnprintf(writer->buffer + writer->length, available, fmt, args1);
+  va_end(args1);
 
-  for (size_t i = 0; i < sb->length; ++i) {
-    memcpy(buffer + offset, sb->chunks[i].buffer, sb->chunks[i].length);
-    offset += sb->chunks[i].length;
+  if ((size_t)len >= available) {
+    writer_reserve(writer, len + 1);
+    if (writer->length + len + 1 > writer->capacity) {
+      vfprintf(writer->file, fmt, args2);
+      va_end(args2);
+      return;
+    }
+    vsnprintf(writer->buffer + writer->length, len + 1, fmt, args2);
   }
+  va_end(args2);
+  writer->length += len;
+}
 
-  return (String){
-      .buffer = buffer,
-      .length = total_length,
-  };
+/**
+ * Returns what an arena writer has written so far. The string stays valid
+ * until the next write.
+ */
+String writer_string(const Writer *writer) {
+  return (String){.buffer = writer->buffer, .length = writer->length};
 }
 
 bool is_letter(char c) {
@@ -101,9 +185,251 @@ bool is_letter(char c) {
 
 bool is_digit(char c) { return '0' <= c && c <= '9'; }
 
+bool is_whitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// bulk scanning
+
+typedef enum CharSpan {
+  CHAR_SPAN_WHITESPACE, // is_whitespace
+  CHAR_SPAN_LETTERS,    // is_letter
+  CHAR_SPAN_DIGITS,     // is_digit
+} CharSpan;
+
+bool char_span_contains(CharSpan span, char c) {
+  switch (span) {
+  case CHAR_SPAN_WHITESPACE:
+    return is_whitespace(c);
+  case CHAR_SPAN_LETTERS:
+    return is_letter(c);
+  case CHAR_SPAN_DIGITS:
+    return is_digit(c);
+  }
+  return false;
+}
+
+size_t string_span_scalar(const char *buffer, CharSpan span) {
+  size_t n = 0;
+  while (char_span_contains(span, buffer[n])) {
+    ++n;
+  }
+  return n;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(STRING_NO_SIMD)
+#define STRING_SIMD_X86
+#include <immintrin.h>
+
+// The vector scanners load whole aligned blocks, which may extend past the
+// terminator but never into another page. That is safe, but not something
+// AddressSanitizer can tell apart from an overflow.
+#define STRING_SIMD_SCAN __attribute__((no_sanitize_address))
+
+__m128i char_span_mask_sse2(__m128i chunk, CharSpan span) {
+  switch (span) {
+  case CHAR_SPAN_WHITESPACE:
+    return _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t'))),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+                     _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r'))));
+  case CHAR_SPAN_LETTERS: {
+    // bytes >= 0x80 are negative here, so they never fall in the range
+    __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    __m128i alpha =
+        _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                      _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+    return _mm_or_si128(alpha, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')));
+  }
+  case CHAR_SPAN_DIGITS:
+    return _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+                         _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), chunk));
+  }
+  return _mm_setzero_si128();
+}
+
+STRING_SIMD_SCAN
+size_t string_span_sse2(const char *buffer, CharSpan span) {
+  const char *block = (const char *)((uintptr_t)buffer & ~(uintptr_t)15);
+  // bytes before `buffer` count as part of the span
+  uint32_t before = ((uint32_t)1 << (buffer - block)) - 1;
+  for (;; block += 16) {
+    __m128i chunk = _mm_load_si128((const __m128i *)block);
+    uint32_t in_span =
+        (uint32_t)_mm_movemask_epi8(char_span_mask_sse2(chunk, span)) |
+        before;
+    if (in_span != 0xFFFF) {
+      return (size_t)(block + __builtin_ctz(~in_span) - buffer);
+    }
+    before = 0;
+  }
+}
+
+__attribute__((target("avx2"))) __m256i
+char_span_mask_avx2(__m256i chunk, CharSpan span) {
+  switch (span) {
+  case CHAR_SPAN_WHITESPACE:
+    return _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')),
+                        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')),
+                        _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r'))));
+  case CHAR_SPAN_LETTERS: {
+    __m256i lower = _mm256_or_si256(chunk, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    return _mm256_or_si256(alpha,
+                           _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('_')));
+  }
+  case CHAR_SPAN_DIGITS:
+    return _mm256_and_si256(
+        _mm256_cmpgt_epi8(chunk, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chunk));
+  }
+  return _mm256_setzero_si256();
+}
+
+__attribute__((target("avx2"))) STRING_SIMD_SCAN size_t
+string_span_avx2(const char *buffer, CharSpan span) {
+  const char *block = (const char *)((uintptr_t)buffer & ~(uintptr_t)31);
+  uint64_t before = ((uint64_t)1 << (buffer - block)) - 1;
+  for (;; block += 32) {
+    __m256i chunk = _mm256_load_si256((const __m256i *)block);
+    uint32_t in_span =
+        (uint32_t)_mm256_movemask_epi8(char_span_mask_avx2(chunk, span)) |
+        (uint32_t)before;
+    if (in_span != 0xFFFFFFFF) {
+      return (size_t)(block + __builtin_ctz(~in_span) - buffer);
+    }
+    before = 0;
+  }
+}
+
+bool string_has_avx2(void) {
+  static int has_avx2 = -1;
+  if (has_avx2 < 0) {
+    has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  return has_avx2;
+}
+#endif
+
+/**
+ * Returns the length of the run of `span` characters at the start of the
+ * NUL-terminated `buffer`, i.e. the index of the first character outside
+ * it. Long runs are scanned 16 or 32 bytes at a time where the CPU allows.
+ */
+size_t string_span(const char *buffer, CharSpan span) {
+  // most runs are a few characters long, too short to pay for vector setup
+  size_t n = 0;
+  while (n < 8 && char_span_contains(span, buffer[n])) {
+    ++n;
+  }
+  if (n < 8) {
+    return n;
+  }
+
+#ifdef STRING_SIMD_X86
+  if (string_has_avx2()) {
+    return n + string_span_avx2(buffer + n, span);
+  }
+  return n + string_span_sse2(buffer + n, span);
+#else
+  return n + string_span_scalar(buffer + n, span);
+#endif
+}
+
 String arena_strdup(Arena *arena, String s) {
   char *buffer = arena_alloc(arena, s.length + 1);
   memcpy(buffer, s.buffer, s.length);
   buffer[s.length] = 0;
   return (String){.buffer = buffer, .length = s.length};
 }
+
+/**
+ * A string stored once in a `StringTable`. Interning the same text twice
+ * returns the same pointer, so interned strings compare by identity and
+ * carry their hash with them.
+ */
+typedef struct InternedString {
+  String string;
+  uint64_t hash;
+  int kind; // free for the owner to cache a classification in; starts at 0
+} InternedString;
+
+typedef struct StringTable {
+  InternedString **slots; // open addressing with linear probing
+  size_t capacity;        // always a power of two
+  size_t count;
+  Arena *arena;
+} StringTable;
+
+// FNV-1a
+uint64_t string_hash(String s) {
+  uint64_t hash = 14695981039346656037u;
+  for (size_t i = 0; i < s.length; ++i) {
+    hash ^= (unsigned char)s.buffer[i];
+    hash *= 1099511628211u;
+  }
+  return hash;
+}
+
+/**
+ * Interned strings are copied into `arena`, so the table can outlive the
+ * text that was interned.
+ */
+void string_table_init(StringTable *table, Arena *arena) {
+  table->capacity = 16;
+  table->count = 0;
+  table->arena = arena;
+  table->slots = arena_alloc(arena, table->capacity * sizeof(InternedString *));
+}
+
+void string_table_grow(StringTable *table) {
+  size_t new_capacity = table->capacity * 2;
+  InternedString **new_slots =
+      arena_alloc(table->arena, new_capacity * sizeof(InternedString *));
+  size_t mask = new_capacity - 1;
+  for (size_t i = 0; i < table->capacity; ++i) {
+    InternedString *entry = table->slots[i];
+    if (!entry) {
+      continue;
+    }
+    size_t j = entry->hash & mask;
+    while (new_slots[j]) {
+      j = (j + 1) & mask;
+    }
+    new_slots[j] = entry;
+  }
+  table->slots = new_slots;
+  table->capacity = new_capacity;
+}
+
+InternedString *string_table_intern(StringTable *table, String s) {
+  uint64_t hash = string_hash(s);
+  size_t mask = table->capacity - 1;
+  size_t i = hash & mask;
+  for (; table->slots[i]; i = (i + 1) & mask) {
+    InternedString *entry = table->slots[i];
+    if (entry->hash == hash && string_cmp(entry->string, s)) {
+      return entry;
+    }
+  }
+
+  // keep the load factor under 3/4 so that probe sequences stay short
+  if ((table->count + 1) * 4 > table->capacity * 3) {
+    string_table_grow(table);
+    mask = table->capacity - 1;
+    for (i = hash & mask; table->slots[i]; i = (i + 1) & mask) {
+    }
+  }
+
+  InternedString *entry = arena_alloc(table->arena, sizeof(InternedString));
+  entry->string = arena_strdup(table->arena, s);
+  entry->hash = hash;
+  table->slots[i] = entry;
+  ++table->count;
+  return entry;
+}
@@ -1,10 +1,12 @@
 #pragma once
 
 #include "string.c"
+#include <string.h>
 
 typedef enum TokenType {
   TOKEN_ILLEGAL,
   TOKEN_EOF,
+  TOKEN_NEED_INPUT, // a chunk-fed lexer ran out of input mid-token
 
   // identifiers and literals
   TOKEN_IDENT,
@@ -44,35 +46,54 @@ typedef enum TokenType {
 } TokenType;
 
 const String token_type_strings[] = {
-    String("ILLEGAL"),  String("EOF"),    String("IDENT"),  String("INT"),
-    String("ASSIGN"),   String("PLUS"),   String("MINUS"),  String("BANG"),
-    String("ASTERISK"), String("SLASH"),  String("LT"),     String("GT"),
-    String("EQ"),       String("NOT_EQ"), String("COMMA"),  String("SEMICOLON"),
-    String("LPAREN"),   String("RPAREN"), String("LBRACE"), String("RBRACE"),
-    String("FUNCTION"), String("LET"),    String("TRUE"),   String("FALSE"),
-    String("IF"),       String("ELSE"),   String("RETURN"),
+    String("ILLEGAL"),  String("EOF"),       String("NEED_INPUT"),
+    String("IDENT"),    String("INT"),       String("ASSIGN"),
+    String("PLUS"),     String("MINUS"),     String("BANG"),
+    String("ASTERISK"), String("SLASH"),     String("LT"),
+    String("GT"),       String("EQ"),        String("NOT_EQ"),
+    String("COMMA"),    String("SEMICOLON"), String("LPAREN"),
+    String("RPAREN"),   String("LBRACE"),    String("RBRACE"),
+    String("FUNCTION"), String("LET"),       String("TRUE"),
+    String("FALSE"),    String("IF"),        String("ELSE"),
+    String("RETURN"),
 };
 
 typedef struct Token {
   TokenType type;
   String literal;
+  const InternedString *symbol; // identifiers, when the lexer interns
 } Token;
 
+typedef struct Keyword {
+  String literal;
+  TokenType type;
+} Keyword;
+
+// (length + 2 * first + last) & 7 is distinct for every keyword, so a lookup
+// is one hash, one length check and one memcmp
+#define KEYWORD_HASH(length, first, last)                                      \
+  (((length) + 2 * (unsigned char)(first) + (unsigned char)(last)) & 7)
+
+const Keyword keywords[8] = {
+    [KEYWORD_HASH(2, 'f', 'n')] = {String("fn"), TOKEN_FUNCTION},
+    [KEYWORD_HASH(3, 'l', 't')] = {String("let"), TOKEN_LET},
+    [KEYWORD_HASH(4, 't', 'e')] = {String("true"), TOKEN_TRUE},
+    [KEYWORD_HASH(5, 'f', 'e')] = {String("false"), TOKEN_FALSE},
+    [KEYWORD_HASH(2, 'i', 'f')] = {String("if"), TOKEN_IF},
+    [KEYWORD_HASH(4, 'e', 'e')] = {String("else"), TOKEN_ELSE},
+    [KEYWORD_HASH(6, 'r', 'n')] = {String("return"), TOKEN_RETURN},
+};
+
 TokenType token_type_from_ident(String ident) {
-  if (string_cmp(ident, String("fn"))) {
-    return TOKEN_FUNCTION;
-  } else if (string_cmp(ident, String("let"))) {
-    return TOKEN_LET;
-  } else if (string_cmp(ident, String("true"))) {
-    return TOKEN_TRUE;
-  } else if (string_cmp(ident, String("false"))) {
-    return TOKEN_FALSE;
-  } else if (string_cmp(ident, String("if"))) {
-    return TOKEN_IF;
-  } else if (string_cmp(ident, String("else"))) {
-    return TOKEN_ELSE;
-  } else if (string_cmp(ident, String("return"))) {
-    return TOKEN_RETURN;
+  if (ident.length == 0) {
+    return TOKEN_IDENT;
+  }
+  const Keyword *keyword =
+      &keywords[KEYWORD_HASH(ident.length, ident.buffer[0],
+                             ident.buffer[ident.length - 1])];
+  if (keyword->literal.length == ident.length &&
+      memcmp(keyword->literal.buffer, ident.buffer, ident.length) == 0) {
+    return keyword->type;
   }
   return TOKEN_IDENT;
 }
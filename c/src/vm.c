@@ -0,0 +1,346 @@
+#pragma once
+
+#include "code.c"
+#include "compiler.c"
+#include "gc.c"
+#include "mem.c"
+#include "object.c"
+#include "string.c"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STACK_SIZE 2048
+
+/**
+ * The VM's global bindings, indexed by `Symbol.index`. A slot is assigned at
+ * compile time but only bound once its `let` runs, which may be never, as in
+ * `if (false) { let x = 1; }; x`.
+ */
+typedef struct Globals {
+  Object values[GLOBALS_SIZE];
+  bool bound[GLOBALS_SIZE];
+} Globals;
+
+typedef struct VM {
+  Arena *arena;
+  Gc *gc;
+  const Object *constants;
+  Instructions instructions;
+  const SymbolTable *symbols;
+
+  Object stack[STACK_SIZE];
+  size_t sp; // always points to the next free slot; top of stack is sp - 1
+
+  Globals *globals;
+  Object last_popped;
+} VM;
+
+/**
+ * `globals` is expected to outlive the VM, so that bindings persist across
+ * REPL lines; any heap payload of a global is copied into `gc`, which should
+ * have `vm_mark` as a root. `arena` is used for values and error messages
+ * that only live for this run.
+ */
+void vm_init(VM *vm, Arena *arena, Gc *gc, Bytecode bytecode,
+             Globals *globals) {
+  vm->arena = arena;
+  vm->gc = gc;
+  vm->constants = bytecode.constants;
+  vm->instructions = bytecode.instructions;
+  vm->symbols = bytecode.symbols;
+  vm->sp = 0;
+  vm->globals = globals;
+  null_object(&vm->last_popped);
+}
+
+/**
+ * A `GcMarkRoots` callback for the VM's stack and globals.
+ */
+void vm_mark(Gc *gc, void *context) {
+  VM *vm = context;
+  for (size_t i = 0; i < vm->sp; ++i) {
+    gc_mark_object(gc, &vm->stack[i]);
+  }
+  gc_mark_object(gc, &vm->last_popped);
+  if (vm->globals) {
+    // only slots the symbol table has handed out can be bound
+    for (size_t i = 0; i < vm->symbols->count; ++i) {
+      if (vm->globals->bound[i]) {
+        gc_mark_object(gc, &vm->globals->values[i]);
+      }
+    }
+  }
+}
+
+bool vm_push(VM *vm, Object *result, Object object) {
+  if (vm->sp >= STACK_SIZE) {
+    error_object(result, vm->arena, String("stack overflow"));
+    return false;
+  }
+  vm->stack[vm->sp++] = object;
+  return true;
+}
+
+Object vm_pop(VM *vm) { return vm->stack[--vm->sp]; }
+
+String vm_binary_operator_string(Opcode op) {
+  switch (op) {
+  case OP_ADD:
+    return String("+");
+  case OP_SUB:
+    return String("-");
+  case OP_MUL:
+    return String("*");
+  case OP_DIV:
+    return String("/");
+  case OP_EQUAL:
+    return String("==");
+  case OP_NOT_EQUAL:
+    return String("!=");
+  case OP_GREATER_THAN:
+    return String(">");
+  case OP_LESS_THAN:
+    return String("<");
+  default:
+    return String("?");
+  }
+}
+
+/**
+ * Executes a binary opcode against the two topmost stack values. Error
+ * messages match those produced by `eval_infix_expression`.
+ */
+bool vm_execute_binary_operation(VM *vm, Object *result, Opcode op) {
+  Object right = vm_pop(vm);
+  Object left = vm_pop(vm);
+  ObjectType left_type = object_type(&left);
+  ObjectType right_type = object_type(&right);
+
+  if (left_type != right_type) {
+    String op_str = vm_binary_operator_string(op);
+    String left_str = object_type_strings[left_type];
+    String right_str = object_type_strings[right_type];
+    error_object(result, vm->arena,
+                 string_fmt(vm->arena, "type mismatch: %.*s %.*s %.*s",
+                            (int)left_str.length, left_str.buffer,
+                            (int)op_str.length, op_str.buffer,
+                            (int)right_str.length, right_str.buffer));
+    return false;
+  }
+
+  Object object = {0};
+  switch (left_type) {
+  case OBJECT_INTEGER: {
+    int64_t l = object_integer(&left);
+    int64_t r = object_integer(&right);
+    switch (op) {
+    case OP_ADD:
+      integer_object(&object, vm->arena, integer_add(l, r));
+      break;
+    case OP_SUB:
+      integer_object(&object, vm->arena, integer_sub(l, r));
+      break;
+    case OP_MUL:
+      integer_object(&object, vm->arena, integer_mul(l, r));
+      break;
+    case OP_DIV:
+      integer_object(&object, vm->arena, l / r);
+      break;
+    case OP_EQUAL:
+      boolean_object(&object, l == r);
+      break;
+    case OP_NOT_EQUAL:
+      boolean_object(&object, l != r);
+      break;
+    case OP_GREATER_THAN:
+      boolean_object(&object, l > r);
+      break;
+    case OP_LESS_THAN:
+      boolean_object(&object, l < r);
+      break;
+    default:
+      goto unknown_operator;
+    }
+  } break;
+  case OBJECT_BOOLEAN: {
+    bool l = object_boolean(&left);
+    bool r = object_boolean(&right);
+    switch (op) {
+    case OP_EQUAL:
+      boolean_object(&object, l == r);
+      break;
+    case OP_NOT_EQUAL:
+      boolean_object(&object, l != r);
+      break;
+    default:
+      goto unknown_operator;
+    }
+  } break;
+  case OBJECT_NULL:
+    switch (op) {
+    case OP_EQUAL:
+      boolean_object(&object, true);
+      break;
+    case OP_NOT_EQUAL:
+      boolean_object(&object, false);
+      break;
+    default:
+      goto unknown_operator;
+    }
+    break;
+  default:
+    goto unknown_operator;
+  }
+
+  return vm_push(vm, result, object);
+
+unknown_operator: {
+  String op_str = vm_binary_operator_string(op);
+  String left_str = object_type_strings[left_type];
+  String right_str = object_type_strings[right_type];
+  error_object(result, vm->arena,
+               string_fmt(vm->arena, "unknown operator: %.*s %.*s %.*s",
+                          (int)left_str.length, left_str.buffer,
+                          (int)op_str.length, op_str.buffer,
+                          (int)right_str.length, right_str.buffer));
+  return false;
+}
+}
+
+/**
+ * Runs the loaded bytecode to completion. On success `result` holds the value
+ * of the last statement, or of the first to produce a return value, which
+ * ends the program as in `eval_program`; on failure it holds an error object.
+ */
+void vm_run(VM *vm, Object *result) {
+  const uint8_t *ins = vm->instructions.items;
+  size_t ins_len = vm->instructions.length;
+
+  for (size_t ip = 0; ip < ins_len; ++ip) {
+    Opcode op = (Opcode)ins[ip];
+    switch (op) {
+    case OP_CONSTANT: {
+      uint16_t const_index = code_read_uint16(&ins[ip + 1]);
+      ip += 2;
+      if (!vm_push(vm, result, vm->constants[const_index])) {
+        return;
+      }
+    } break;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_EQUAL:
+    case OP_NOT_EQUAL:
+    case OP_GREATER_THAN:
+    case OP_LESS_THAN:
+      if (!vm_execute_binary_operation(vm, result, op)) {
+        return;
+      }
+      break;
+    case OP_TRUE:
+    case OP_FALSE: {
+      Object object = {0};
+      boolean_object(&object, op == OP_TRUE);
+      if (!vm_push(vm, result, object)) {
+        return;
+      }
+    } break;
+    case OP_NULL: {
+      Object object = {0};
+      null_object(&object);
+      if (!vm_push(vm, result, object)) {
+        return;
+      }
+    } break;
+    case OP_BANG: {
+      Object operand = vm_pop(vm);
+      if (object_type(&operand) == OBJECT_RETURN) {
+        String type_str = object_type_strings[OBJECT_RETURN];
+        error_object(result, vm->arena,
+                     string_fmt(vm->arena, "unknown operator: !%.*s",
+                                (int)type_str.length, type_str.buffer));
+        return;
+      }
+      Object object = {0};
+      boolean_object(&object, !object_is_truthy(&operand));
+      vm_push(vm, result, object);
+    } break;
+    case OP_MINUS: {
+      Object operand = vm_pop(vm);
+      if (object_type(&operand) != OBJECT_INTEGER) {
+        String type_str = object_type_strings[object_type(&operand)];
+        error_object(result, vm->arena,
+                     string_fmt(vm->arena, "unknown operator: -%.*s",
+                                (int)type_str.length, type_str.buffer));
+        return;
+      }
+      Object object = {0};
+      integer_object(&object, vm->arena,
+                     integer_neg(object_integer(&operand)));
+      vm_push(vm, result, object);
+    } break;
+    case OP_POP: {
+      // only statements' values are popped, so a return value here has
+      // reached the top level
+      Object value = vm_pop(vm);
+      if (object_type(&value) == OBJECT_RETURN) {
+        *result = *object_return_value(&value);
+        return;
+      }
+      vm->last_popped = value;
+    } break;
+    case OP_JUMP:
+      // the loop increment moves ip onto the target
+      ip = code_read_uint16(&ins[ip + 1]) - 1;
+      break;
+    case OP_JUMP_NOT_TRUTHY: {
+      size_t target = code_read_uint16(&ins[ip + 1]);
+      ip += 2;
+      Object condition = vm_pop(vm);
+      if (!object_is_truthy(&condition)) {
+        ip = target - 1;
+      }
+    } break;
+    case OP_JUMP_IF_RETURN: {
+      size_t target = code_read_uint16(&ins[ip + 1]);
+      ip += 2;
+      if (object_type(&vm->stack[vm->sp - 1]) == OBJECT_RETURN) {
+        ip = target - 1;
+      }
+    } break;
+    case OP_SET_GLOBAL: {
+      uint16_t global_index = code_read_uint16(&ins[ip + 1]);
+      ip += 2;
+      // the bound value stays on the stack as the value of the `let`
+      gc_object_copy(vm->gc, &vm->globals->values[global_index],
+                     &vm->stack[vm->sp - 1]);
+      vm->globals->bound[global_index] = true;
+    } break;
+    case OP_GET_GLOBAL: {
+      uint16_t global_index = code_read_uint16(&ins[ip + 1]);
+      ip += 2;
+      if (!vm->globals->bound[global_index]) {
+        String name = vm->symbols->symbols[global_index].name->string;
+        error_object(result, vm->arena,
+                     string_fmt(vm->arena, "identifier not found: %.*s",
+                                (int)name.length, name.buffer));
+        return;
+      }
+      if (!vm_push(vm, result, vm->globals->values[global_index])) {
+        return;
+      }
+    } break;
+    case OP_RETURN_VALUE: {
+      Object *value = arena_alloc(vm->arena, sizeof(Object));
+      *value = vm_pop(vm);
+      Object object = {0};
+      return_object(&object, vm->arena, value);
+      vm_push(vm, result, object);
+    } break;
+    }
+  }
+
+  *result = vm->last_popped;
+}
@@ -0,0 +1,83 @@
+#include "../src/aot.c"
+#include "differential.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+void test_unboxed(void);
+void test_same_as_eval(void);
+
+int main(void) {
+  test_unboxed();
+  test_same_as_eval();
+}
+
+void test_unboxed(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+  Arena scratch = {0};
+  assert(arena_init_virtual(&scratch, (size_t)1 << 30, false));
+
+  Program *program =
+      parse(&arena, "let a = 1; let b = a * 2 + 1; if (b > a) { !a } else "
+                    "{ b == 1 }; -b / a; a + true");
+  Environment *env = resolve(&arena, program);
+  Writer out = {0};
+  writer_init_arena(&out, &arena);
+  aot_emit_program(program, env, &scratch, &out);
+  writer_write_char(&out, '\0');
+  const char *c = out.buffer;
+
+  assert(strstr(c, "int64_t value = aot_add(aot_mul(g0, INT64_C(2)), "
+                   "INT64_C(1));"));
+  assert(strstr(c, "int64_t value = ((g1 > g0) ? aot_then(g0, 0) : "
+                   "(g1 == INT64_C(1)));"));
+  assert(strstr(c, "int64_t value = aot_div(aot_neg(g1), g0, &bail);"));
+  // not an integer expression
+  assert(strstr(c, "OPERATOR_PLUS"));
+  assert(strstr(c, "\"a\",\n    \"b\",\n    NULL,"));
+
+  arena_release(&scratch);
+  arena_release(&arena);
+}
+
+/**
+ * Compiles `program` to the executable at `output` and returns what it
+ * printed, without the trailing newline.
+ */
+String run_aot(Arena *arena, Gc *gc, Program *program, void *output) {
+  (void)gc;
+  assert(aot_build(program, resolve(arena, program), arena, output));
+  FILE *run = popen(output, "r");
+  assert(run);
+  char *printed = arena_alloc(arena, 256);
+  size_t length = fread(printed, 1, 255, run);
+  int status = pclose(run);
+  assert(length > 0 && printed[length - 1] == '\n');
+
+  // errors are printed too, but fail the program
+  assert((status == 0) == (strncmp(printed, "ERROR: ", 7) != 0));
+  return (String){.buffer = printed, .length = length - 1};
+}
+
+void test_same_as_eval(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+  char output[64];
+  snprintf(output, sizeof(output), "/tmp/aot_test_%ld", (long)getpid());
+
+  Program *program = parse(&arena, "1");
+  bool compiler =
+      aot_build(program, resolve(&arena, program), &arena, output);
+  arena_release(&arena);
+  if (!compiler) {
+    printf("aot_test: no C compiler; set CC to run the compiled programs\n");
+    return;
+  }
+
+  differential_test(run_aot, output);
+  remove(output);
+}
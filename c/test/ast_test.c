@@ -1,50 +1,53 @@
 #include "../src/ast.c"
 #include "../src/mem.c"
+#include "../src/string.c"
 #include <assert.h>
 
 void test_string(void);
+void test_statement_at(void);
 
-int main(void) { test_string(); }
+int main(void) {
+  test_string();
+  test_statement_at();
+}
 
 void test_string(void) {
   Arena arena = {0};
   char arena_buf[8192];
   arena_init(&arena, &arena_buf, 8192);
 
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+
   Program *program = program_create(&arena);
+  Ast *ast = &program->ast;
 
-  Statement s = {
-      .type = STATEMENT_LET,
-      .data =
-          {
-              .let_statement =
-                  {
-                      .token = {.type = TOKEN_LET, .literal = String("let")},
-                      .name =
-                          &(Identifier){
-                              .token = {.type = TOKEN_IDENT,
-                                        .literal = String("myVar")},
-                              .value = String("myVar"),
-                          },
-                      .value =
-                          &(Expression){
-                              .type = EXPRESSION_IDENTIFIER,
-                              .data =
-                                  {
-                                      .identifier =
-                                          {
-                                              .token = {.type = TOKEN_IDENT,
-                                                        .literal = String(
-                                                            "anotherVar")},
-                                              .value = String("anotherVar"),
-                                          },
-                                  },
-                          },
-                  },
-          },
-  };
-  program_append_statement(program, &arena, s);
+  NodeIndex name = ast_add_identifier(
+      ast, string_table_intern(&strings, String("myVar")));
+  NodeIndex value = ast_add_identifier(
+      ast, string_table_intern(&strings, String("anotherVar")));
+  program_append_statement(program, ast_add_let(ast, name, value));
 
   assert(string_cmp(String("let myVar = anotherVar;"),
                     program_to_string(program, &arena)));
 }
+
+void test_statement_at(void) {
+  Arena arena = {0};
+  static char arena_buf[65536];
+  arena_init(&arena, arena_buf, sizeof(arena_buf));
+
+  Program *program = program_create(&arena);
+  NodeIndex statements[1000];
+  for (size_t i = 0; i < 1000; ++i) {
+    statements[i] = ast_add_expression_statement(
+        &program->ast, ast_add_integer(&program->ast, (int64_t)i));
+    program_append_statement(program, statements[i]);
+  }
+
+  assert(program->statements_len == 1000);
+  for (size_t i = 0; i < 1000; ++i) {
+    assert(program_statement_at(program, i) == statements[i]);
+  }
+  assert(program_statement_at(program, 1000) == NODE_NONE);
+}
@@ -0,0 +1,64 @@
+#include "../src/closure.c"
+#include "differential.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void test_same_as_eval(void);
+void test_specialization(void);
+
+int main(void) {
+  test_same_as_eval();
+  test_specialization();
+}
+
+String run_closures(Arena *arena, Gc *gc, Program *program, void *context) {
+  (void)context;
+  Environment *env = resolve(arena, program);
+  const Closure *compiled = closure_compile_program(arena, NULL, program);
+  Object result = {0};
+  closure_run_program(compiled, arena, gc, env, &result);
+  return object_to_string(&result, arena);
+}
+
+void test_same_as_eval(void) {
+  differential_test(run_closures, NULL);
+
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+  // function literals are reported and skipped, as by eval
+  differential_check(&arena, &gc, "let f = fn(x) { x }; 1", run_closures,
+                     NULL);
+  gc_release(&gc);
+  arena_release(&arena);
+}
+
+void test_specialization(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+
+  Program *program = parse(&arena, "let x = 2; x * 3 + 1 < x; -x == true");
+  resolve(&arena, program);
+
+  const Closure *compiled = closure_compile_program(&arena, NULL, program);
+  assert(compiled->as.block.length == 3);
+
+  const Closure *let = compiled->as.block.items[0];
+  assert(let->run == closure_let && let->rhs->run == closure_integer);
+
+  // ((x * 3) + 1) < x
+  const Closure *lt = compiled->as.block.items[1];
+  assert(lt->run == closure_lt && lt->rhs->run == closure_global);
+  assert(lt->lhs->run == closure_add_constant && lt->lhs->as.integer == 1);
+  const Closure *mul = lt->lhs->lhs;
+  assert(mul->run == closure_mul_constant && mul->as.integer == 3);
+  assert(mul->lhs->run == closure_global);
+
+  const Closure *eq = compiled->as.block.items[2];
+  assert(eq->run == closure_eq && eq->lhs->run == closure_minus);
+  assert(eq->rhs->run == closure_boolean);
+
+  arena_release(&arena);
+}
@@ -0,0 +1,69 @@
+#include "../src/code.c"
+#include "../src/mem.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+void test_make(void);
+void test_instructions_string(void);
+void test_read_operands(void);
+
+int main(void) {
+  test_make();
+  test_instructions_string();
+  test_read_operands();
+}
+
+void test_make(void) {
+  struct {
+    Opcode op;
+    int operand;
+    uint8_t expected[INSTRUCTION_MAX_LENGTH];
+    size_t expected_len;
+  } test_cases[] = {
+      {OP_CONSTANT, 65534, {OP_CONSTANT, 255, 254}, 3},
+      {OP_ADD, 0, {OP_ADD}, 1},
+  };
+
+  for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); ++i) {
+    uint8_t instruction[INSTRUCTION_MAX_LENGTH] = {0};
+    size_t len =
+        code_make(instruction, test_cases[i].op, test_cases[i].operand);
+    assert(len == test_cases[i].expected_len);
+    assert(memcmp(instruction, test_cases[i].expected, len) == 0);
+  }
+}
+
+void test_instructions_string(void) {
+  Arena arena = {0};
+  char arena_buffer[8192];
+  arena_init(&arena, arena_buffer, 8192);
+
+  Instructions ins = {0};
+  instructions_init(&ins, &arena);
+
+  uint8_t instruction[INSTRUCTION_MAX_LENGTH];
+  size_t len = code_make(instruction, OP_ADD);
+  instructions_append(&ins, &arena, instruction, len);
+  len = code_make(instruction, OP_CONSTANT, 2);
+  instructions_append(&ins, &arena, instruction, len);
+  len = code_make(instruction, OP_CONSTANT, 65535);
+  instructions_append(&ins, &arena, instruction, len);
+
+  assert(string_cmp(instructions_to_string(&ins, &arena),
+                    String("0000 OpAdd\n"
+                           "0001 OpConstant 2\n"
+                           "0004 OpConstant 65535\n")));
+}
+
+void test_read_operands(void) {
+  uint8_t instruction[INSTRUCTION_MAX_LENGTH];
+  code_make(instruction, OP_CONSTANT, 65535);
+
+  int operands[OPCODE_MAX_OPERANDS] = {0};
+  size_t read = code_read_operands(&opcode_definitions[OP_CONSTANT],
+                                   &instruction[1], operands);
+  assert(read == 2);
+  assert(operands[0] == 65535);
+}
@@ -0,0 +1,209 @@
+#include "../src/compiler.c"
+#include "../src/lexer.c"
+#include "../src/mem.c"
+#include "../src/parser.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+void test_integer_arithmetic(void);
+void test_boolean_expressions(void);
+void test_conditionals(void);
+void test_global_let_statements(void);
+void test_undefined_identifier(void);
+
+int main(void) {
+  test_integer_arithmetic();
+  test_boolean_expressions();
+  test_conditionals();
+  test_global_let_statements();
+  test_undefined_identifier();
+}
+
+typedef struct CompilerTestCase {
+  char *input;
+  int64_t expected_constants[4];
+  size_t expected_constants_len;
+  String expected_instructions;
+} CompilerTestCase;
+
+void run_compiler_tests(CompilerTestCase *test_cases, size_t len) {
+  Arena arena = {0};
+  const size_t arena_size = 16 * 1024;
+  char arena_buffer[arena_size];
+  arena_init(&arena, arena_buffer, arena_size);
+
+  for (size_t i = 0; i < len; ++i) {
+    Lexer lexer = {0};
+    lexer_init(&lexer, test_cases[i].input);
+    Parser parser = {0};
+    parser_init(&parser, &arena, &lexer);
+
+    Program *program = parser_parse_program(&parser, &arena);
+
+    SymbolTable symbols = {0};
+    symbol_table_init(&symbols, &arena);
+    Compiler compiler = {0};
+    compiler_init(&compiler, &arena, &symbols);
+    assert(compiler_compile_program(&compiler, program));
+
+    Bytecode bytecode = compiler_bytecode(&compiler);
+    String actual = instructions_to_string(&bytecode.instructions, &arena);
+    if (!string_cmp(actual, test_cases[i].expected_instructions)) {
+      fprintf(stderr, "wrong instructions for %s.\nwant=\n%.*s\ngot=\n%.*s\n",
+              test_cases[i].input,
+              (int)test_cases[i].expected_instructions.length,
+              test_cases[i].expected_instructions.buffer, (int)actual.length,
+              actual.buffer);
+      exit(EXIT_FAILURE);
+    }
+
+    assert(bytecode.constants_len == test_cases[i].expected_constants_len);
+    for (size_t j = 0; j < bytecode.constants_len; ++j) {
+      assert(object_type(&bytecode.constants[j]) == OBJECT_INTEGER);
+      assert(object_integer(&bytecode.constants[j]) ==
+             test_cases[i].expected_constants[j]);
+    }
+
+    arena_reset(&arena);
+  }
+}
+
+void test_integer_arithmetic(void) {
+  CompilerTestCase test_cases[] = {
+      {"1 + 2", {1, 2}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpConstant 1\n"
+              "0006 OpAdd\n"
+              "0007 OpPop\n")},
+      {"1; 2", {1, 2}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpPop\n"
+              "0004 OpConstant 1\n"
+              "0007 OpPop\n")},
+      {"1 - 2", {1, 2}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpConstant 1\n"
+              "0006 OpSub\n"
+              "0007 OpPop\n")},
+      {"1 * 2", {1, 2}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpConstant 1\n"
+              "0006 OpMul\n"
+              "0007 OpPop\n")},
+      {"2 / 1", {2, 1}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpConstant 1\n"
+              "0006 OpDiv\n"
+              "0007 OpPop\n")},
+      {"-1", {1}, 1,
+       String("0000 OpConstant 0\n"
+              "0003 OpMinus\n"
+              "0004 OpPop\n")},
+  };
+  run_compiler_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_boolean_expressions(void) {
+  CompilerTestCase test_cases[] = {
+      {"true", {0}, 0,
+       String("0000 OpTrue\n"
+              "0001 OpPop\n")},
+      {"1 > 2", {1, 2}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpConstant 1\n"
+              "0006 OpGreaterThan\n"
+              "0007 OpPop\n")},
+      {"1 < 2", {1, 2}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpConstant 1\n"
+              "0006 OpLessThan\n"
+              "0007 OpPop\n")},
+      {"true != false", {0}, 0,
+       String("0000 OpTrue\n"
+              "0001 OpFalse\n"
+              "0002 OpNotEqual\n"
+              "0003 OpPop\n")},
+      {"!true", {0}, 0,
+       String("0000 OpTrue\n"
+              "0001 OpBang\n"
+              "0002 OpPop\n")},
+  };
+  run_compiler_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_conditionals(void) {
+  CompilerTestCase test_cases[] = {
+      {"if (true) { 10 }; 3333;", {10, 3333}, 2,
+       String("0000 OpTrue\n"
+              "0001 OpJumpNotTruthy 10\n"
+              "0004 OpConstant 0\n"
+              "0007 OpJump 11\n"
+              "0010 OpNull\n"
+              "0011 OpPop\n"
+              "0012 OpConstant 1\n"
+              "0015 OpPop\n")},
+      {"if (true) { 10 } else { 20 }; 3333;", {10, 20, 3333}, 3,
+       String("0000 OpTrue\n"
+              "0001 OpJumpNotTruthy 10\n"
+              "0004 OpConstant 0\n"
+              "0007 OpJump 13\n"
+              "0010 OpConstant 1\n"
+              "0013 OpPop\n"
+              "0014 OpConstant 2\n"
+              "0017 OpPop\n")},
+      {"if (true) { return 1; 2 }", {1, 2}, 2,
+       String("0000 OpTrue\n"
+              "0001 OpJumpNotTruthy 18\n"
+              "0004 OpConstant 0\n"
+              "0007 OpReturnValue\n"
+              "0008 OpJumpIfReturn 15\n"
+              "0011 OpPop\n"
+              "0012 OpConstant 1\n"
+              "0015 OpJump 19\n"
+              "0018 OpNull\n"
+              "0019 OpPop\n")},
+  };
+  run_compiler_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_global_let_statements(void) {
+  CompilerTestCase test_cases[] = {
+      {"let one = 1; let two = 2;", {1, 2}, 2,
+       String("0000 OpConstant 0\n"
+              "0003 OpSetGlobal 0\n"
+              "0006 OpPop\n"
+              "0007 OpConstant 1\n"
+              "0010 OpSetGlobal 1\n"
+              "0013 OpPop\n")},
+      {"let one = 1; one;", {1}, 1,
+       String("0000 OpConstant 0\n"
+              "0003 OpSetGlobal 0\n"
+              "0006 OpPop\n"
+              "0007 OpGetGlobal 0\n"
+              "0010 OpPop\n")},
+  };
+  run_compiler_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_undefined_identifier(void) {
+  Arena arena = {0};
+  char arena_buffer[8192];
+  arena_init(&arena, arena_buffer, 8192);
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, "foobar");
+  Parser parser = {0};
+  parser_init(&parser, &arena, &lexer);
+
+  Program *program = parser_parse_program(&parser, &arena);
+
+  SymbolTable symbols = {0};
+  symbol_table_init(&symbols, &arena);
+  Compiler compiler = {0};
+  compiler_init(&compiler, &arena, &symbols);
+  assert(!compiler_compile_program(&compiler, program));
+  assert(string_cmp(compiler.error, String("identifier not found: foobar")));
+}
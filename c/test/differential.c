@@ -0,0 +1,134 @@
+#pragma once
+
+#include "../src/eval.c"
+#include "../src/lexer.c"
+#include "../src/mem.c"
+#include "../src/parser.c"
+#include "../src/resolver.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Differential testing of the engines against `eval_program`, shared by
+// their tests. Each engine supplies a `DifferentialRun`; the result of
+// running a program is compared with eval's as printed by `object_write`.
+
+/**
+ * Runs `program`, freshly parsed in `arena`, and returns what it printed.
+ */
+typedef String DifferentialRun(Arena *arena, Gc *gc, Program *program,
+                               void *context);
+
+char *differential_inputs[] = {
+    // arithmetic, including overflow, which wraps
+    "5",
+    "-10",
+    "5 + 5 + 5 + 5 - 10",
+    "(5 + 10 * 2 + 15 / 3) * 2 + -10",
+    "4611686018427387903 + 1",
+    "-4611686018427387904 - 1",
+    "9223372036854775807 + 1",
+    "let big = 9223372036854775807; big - 1",
+    "let a = 7; let b = 2; a / b + a * b - -a",
+    "let a = -7; let b = -1; a / b",
+    // comparisons and truthiness
+    "1 < 2",
+    "1 > 2 == false",
+    "1 != 1",
+    "true == false",
+    "true != false",
+    "let a = 3; a > 4 != (a == 3)",
+    "!5",
+    "!!true",
+    "let a = 0; !!a",
+    // conditionals and returns
+    "if (1) { 10 }",
+    "if (1 > 2) { 10 }",
+    "if (1 > 2) { 10 } else { 20 }",
+    "let a = 5; if (a > 2) { a * 2 } else { a - 2 }",
+    "let a = 1; if (a) { 1; a + 1 } else { 0 }",
+    "let a = 1; if (a > 2) { a }",
+    "let x = 10; if (x > 5) { let y = x - 5; y * 2 } else { x }",
+    "9; return 2 * 5; 9;",
+    "if (10 > 1) { if (10 > 1) { return 10; } return 1; }",
+    "!if (true) { return 1; }",
+    "-if (true) { return 1; }",
+    "let a = if (true) { return 1; } + 2; a",
+    "let a = if (true) { return 1; }; 5",
+    "if (true) { 1; return 2; 3 }",
+    "if (true) { let a = if (true) { return 4; }; 5 }",
+    "if (true) { let a = 3; }",
+    // errors
+    "5 + true;",
+    "5 + true; 5;",
+    "-true",
+    "true + false;",
+    "true * 2",
+    "true == 2",
+    "1 < true",
+    "if (10 > 1) { return true + false; }",
+    "let a = true; a + 1",
+    // names
+    "foobar",
+    "if (false) { let x = 1; }; x",
+    "let a = 5; let b = a * 2; let a = b + a; a",
+    "let a = 1; let a = a + 1; let a = a + 1; a == 3",
+};
+
+Program *parse(Arena *arena, char *input) {
+  Lexer lexer = {0};
+  lexer_init(&lexer, input);
+  Parser parser = {0};
+  parser_init(&parser, arena, &lexer);
+  Program *program = parser_parse_program(&parser, arena);
+  assert(parser.errors.length == 0);
+  return program;
+}
+
+/** Resolves `program` against a new environment in `arena`. */
+Environment *resolve(Arena *arena, Program *program) {
+  Environment *env = arena_alloc(arena, sizeof(Environment));
+  environment_init(env, arena);
+  resolve_program(program, arena, arena, env);
+  return env;
+}
+
+/**
+ * Asserts that `run` prints the same for `input` as `eval_program` does.
+ * The program is parsed again for `run`, since evaluating quickens it.
+ */
+void differential_check(Arena *arena, Gc *gc, char *input,
+                        DifferentialRun *run, void *context) {
+  Program *program = parse(arena, input);
+  Object evaluated = {0};
+  eval_program(program, arena, gc, resolve(arena, program), &evaluated);
+  String expected = object_to_string(&evaluated, arena);
+
+  String actual = run(arena, gc, parse(arena, input), context);
+  if (!string_cmp(actual, expected)) {
+    fprintf(stderr, "%s: got %.*s, eval gives %.*s\n", input,
+            (int)actual.length, actual.buffer, (int)expected.length,
+            expected.buffer);
+    assert(false);
+  }
+}
+
+/**
+ * Checks `run` against eval on every program in `differential_inputs`.
+ */
+void differential_test(DifferentialRun *run, void *context) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
+  size_t length = sizeof(differential_inputs) / sizeof(differential_inputs[0]);
+  for (size_t i = 0; i < length; ++i) {
+    differential_check(&arena, &gc, differential_inputs[i], run, context);
+    arena_reset(&arena);
+  }
+
+  gc_release(&gc);
+  arena_release(&arena);
+}
@@ -3,6 +3,7 @@
 #include "../src/mem.c"
 #include "../src/object.c"
 #include "../src/parser.c"
+#include "../src/resolver.c"
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -16,6 +17,9 @@ void test_if_else_expressions(void);
 void test_return_statements(void);
 void test_error_handling(void);
 void test_let_statements(void);
+void test_out_of_memory(void);
+void test_temporaries_released(void);
+void test_quickening(void);
 
 int main(void) {
   test_eval_integer_expression();
@@ -25,6 +29,9 @@ int main(void) {
   test_return_statements();
   test_error_handling();
   test_let_statements();
+  test_out_of_memory();
+  test_temporaries_released();
+  test_quickening();
 }
 
 void test_eval_integer_expression(void) {
@@ -47,6 +54,13 @@ void test_eval_integer_expression(void) {
       {"3 * 3 * 3 + 10", 37},
       {"3 * (3 * 3) + 10", 37},
       {"(5 + 10 * 2 + 15 / 3) * 2 + -10", 50},
+      {"4611686018427387903 + 1", 4611686018427387904},
+      {"-4611686018427387904 - 1", -4611686018427387905},
+      {"let big = 9223372036854775807; big - 1", 9223372036854775806},
+      // overflow wraps
+      {"9223372036854775807 + 1", INT64_MIN},
+      {"-(-9223372036854775807 - 1)", INT64_MIN},
+      {"4611686018427387904 * 2", INT64_MIN},
   };
 
   Arena arena = {0};
@@ -59,6 +73,9 @@ void test_eval_integer_expression(void) {
   char env_arena_buffer[arena_size];
   arena_init(&env_arena, env_arena_buffer, env_arena_size);
 
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
     Lexer lexer = {0};
     lexer_init(&lexer, test_cases[i].input);
@@ -69,15 +86,18 @@ void test_eval_integer_expression(void) {
 
     Environment env = {0};
     environment_init(&env, &arena);
+    resolve_program(program, &arena, &env_arena, &env);
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    eval_program(program, &arena, &gc, &env, &evaluated);
 
-    assert(evaluated.type == OBJECT_INTEGER);
-    assert(evaluated.data.integer_object.value == test_cases[i].expected);
+    assert(object_type(&evaluated) == OBJECT_INTEGER);
+    assert(object_integer(&evaluated) == test_cases[i].expected);
 
     arena_reset(&arena);
   }
+
+  gc_release(&gc);
 }
 
 void test_eval_boolean_expression(void) {
@@ -116,6 +136,9 @@ void test_eval_boolean_expression(void) {
   char env_arena_buffer[arena_size];
   arena_init(&env_arena, env_arena_buffer, env_arena_size);
 
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
     Lexer lexer = {0};
     lexer_init(&lexer, test_cases[i].input);
@@ -126,15 +149,18 @@ void test_eval_boolean_expression(void) {
 
     Environment env = {0};
     environment_init(&env, &arena);
+    resolve_program(program, &arena, &env_arena, &env);
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    eval_program(program, &arena, &gc, &env, &evaluated);
 
-    assert(evaluated.type == OBJECT_BOOLEAN);
-    assert(evaluated.data.boolean_object.value == test_cases[i].expected);
+    assert(object_type(&evaluated) == OBJECT_BOOLEAN);
+    assert(object_boolean(&evaluated) == test_cases[i].expected);
 
     arena_reset(&arena);
   }
+
+  gc_release(&gc);
 }
 
 void test_bang_operator(void) {
@@ -156,6 +182,9 @@ void test_bang_operator(void) {
   char env_arena_buffer[arena_size];
   arena_init(&env_arena, env_arena_buffer, env_arena_size);
 
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
     Lexer lexer = {0};
     lexer_init(&lexer, test_cases[i].input);
@@ -166,15 +195,18 @@ void test_bang_operator(void) {
 
     Environment env = {0};
     environment_init(&env, &arena);
+    resolve_program(program, &arena, &env_arena, &env);
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    eval_program(program, &arena, &gc, &env, &evaluated);
 
-    assert(evaluated.type == OBJECT_BOOLEAN);
-    assert(evaluated.data.boolean_object.value == test_cases[i].expected);
+    assert(object_type(&evaluated) == OBJECT_BOOLEAN);
+    assert(object_boolean(&evaluated) == test_cases[i].expected);
 
     arena_reset(&arena);
   }
+
+  gc_release(&gc);
 }
 
 void test_if_else_expressions(void) {
@@ -202,6 +234,9 @@ void test_if_else_expressions(void) {
   char env_arena_buffer[arena_size];
   arena_init(&env_arena, env_arena_buffer, env_arena_size);
 
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
     Lexer lexer = {0};
     lexer_init(&lexer, test_cases[i].input);
@@ -212,15 +247,16 @@ void test_if_else_expressions(void) {
 
     Environment env = {0};
     environment_init(&env, &arena);
+    resolve_program(program, &arena, &env_arena, &env);
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    eval_program(program, &arena, &gc, &env, &evaluated);
 
-    assert(evaluated.type == test_cases[i].expected_type);
+    assert(object_type(&evaluated) == test_cases[i].expected_type);
 
     switch (test_cases[i].expected_type) {
     case OBJECT_INTEGER:
-      assert(evaluated.data.integer_object.value ==
+      assert(object_integer(&evaluated) ==
              test_cases[i].expected_value);
       break;
     case OBJECT_NULL:
@@ -228,13 +264,15 @@ void test_if_else_expressions(void) {
       break;
     default:
       fprintf(stderr, "unhandled if-else expression type %.*s\n",
-              (int)expression_type_strings[test_cases[i].expected_type].length,
-              expression_type_strings[test_cases[i].expected_type].buffer);
+              (int)object_type_strings[test_cases[i].expected_type].length,
+              object_type_strings[test_cases[i].expected_type].buffer);
       exit(EXIT_FAILURE);
     }
 
     arena_reset(&arena);
   }
+
+  gc_release(&gc);
 }
 
 void test_return_statements(void) {
@@ -268,6 +306,9 @@ void test_return_statements(void) {
   char env_arena_buffer[arena_size];
   arena_init(&env_arena, env_arena_buffer, env_arena_size);
 
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
     Lexer lexer = {0};
     lexer_init(&lexer, test_cases[i].input);
@@ -278,14 +319,17 @@ void test_return_statements(void) {
 
     Environment env = {0};
     environment_init(&env, &arena);
+    resolve_program(program, &arena, &env_arena, &env);
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    eval_program(program, &arena, &gc, &env, &evaluated);
 
-    assert(evaluated.data.integer_object.value == test_cases[i].expected_value);
+    assert(object_integer(&evaluated) == test_cases[i].expected_value);
 
     arena_reset(&arena);
   }
+
+  gc_release(&gc);
 }
 
 void test_error_handling(void) {
@@ -316,6 +360,10 @@ void test_error_handling(void) {
           "foobar",
           String("identifier not found: foobar"),
       },
+      {
+          "if (false) { let x = 1; }; x",
+          String("identifier not found: x"),
+      },
   };
 
   Arena arena = {0};
@@ -328,6 +376,9 @@ void test_error_handling(void) {
   char env_arena_buffer[arena_size];
   arena_init(&env_arena, env_arena_buffer, env_arena_size);
 
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
     Lexer lexer = {0};
     lexer_init(&lexer, test_cases[i].input);
@@ -338,16 +389,19 @@ void test_error_handling(void) {
 
     Environment env = {0};
     environment_init(&env, &arena);
+    resolve_program(program, &arena, &env_arena, &env);
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    eval_program(program, &arena, &gc, &env, &evaluated);
 
-    assert(evaluated.type == OBJECT_ERROR);
-    assert(string_cmp(evaluated.data.error_object.message,
+    assert(object_type(&evaluated) == OBJECT_ERROR);
+    assert(string_cmp(object_error_message(&evaluated),
                       test_cases[i].expected_message));
 
     arena_reset(&arena);
   }
+
+  gc_release(&gc);
 }
 
 void test_let_statements(void) {
@@ -359,6 +413,7 @@ void test_let_statements(void) {
       {"let a = 5 * 5; a;", 25},
       {"let a = 5; let b = a; b;", 5},
       {"let a = 5; let b = a; let c = a + b + 5; c;", 15},
+      {"let a = 5; let a = a * 2; a;", 10},
   };
 
   Arena arena = {0};
@@ -371,6 +426,9 @@ void test_let_statements(void) {
   char env_arena_buffer[arena_size];
   arena_init(&env_arena, env_arena_buffer, env_arena_size);
 
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
     Lexer lexer = {0};
     lexer_init(&lexer, test_cases[i].input);
@@ -381,13 +439,150 @@ void test_let_statements(void) {
 
     Environment env = {0};
     environment_init(&env, &arena);
+    resolve_program(program, &arena, &env_arena, &env);
 
     Object evaluated = {0};
-    eval_program(program, &arena, &env_arena, &env, &evaluated);
+    eval_program(program, &arena, &gc, &env, &evaluated);
 
-    assert(evaluated.type == OBJECT_INTEGER);
-    assert(evaluated.data.integer_object.value == test_cases[i].expected_value);
+    assert(object_type(&evaluated) == OBJECT_INTEGER);
+    assert(object_integer(&evaluated) == test_cases[i].expected_value);
 
     arena_reset(&arena);
   }
+
+  gc_release(&gc);
+}
+
+void test_out_of_memory(void) {
+  Arena arena = {0};
+  char arena_buffer[8192];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  // too small for the "identifier not found" message
+  Arena eval_arena = {0};
+  char eval_arena_buffer[8];
+  arena_init(&eval_arena, eval_arena_buffer, sizeof(eval_arena_buffer));
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, "let a = 1; foobar");
+  Parser parser = {0};
+  parser_init(&parser, &arena, &lexer);
+
+  Program *program = parser_parse_program(&parser, &arena);
+
+  Environment env = {0};
+  environment_init(&env, &arena);
+  resolve_program(program, &arena, &arena, &env);
+
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+  Object evaluated = {0};
+  eval_program(program, &eval_arena, &gc, &env, &evaluated);
+
+  assert(object_type(&evaluated) == OBJECT_ERROR);
+  assert(string_cmp(object_error_message(&evaluated),
+                    String("out of memory")));
+  assert(eval_arena.out_of_memory == NULL);
+  assert(gc.out_of_memory == NULL);
+  gc_release(&gc);
+}
+
+void test_temporaries_released(void) {
+  Arena arena = {0};
+  static char arena_buffer[65536];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  Arena env_arena = {0};
+  char env_arena_buffer[8192];
+  arena_init(&env_arena, env_arena_buffer, sizeof(env_arena_buffer));
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, "let a = 9223372036854775807; "
+                     "if (a > 1) { a - 1 } else { -a }; "
+                     "if (true) { a + 0 > 0 }; "
+                     "a - a");
+  Parser parser = {0};
+  parser_init(&parser, &arena, &lexer);
+
+  Program *program = parser_parse_program(&parser, &arena);
+
+  Environment env = {0};
+  environment_init(&env, &env_arena);
+  resolve_program(program, &arena, &env_arena, &env);
+
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+  size_t offset = arena.offset;
+  Object evaluated = {0};
+  eval_program(program, &arena, &gc, &env, &evaluated);
+
+  assert(object_type(&evaluated) == OBJECT_INTEGER);
+  assert(object_integer(&evaluated) == 0);
+  assert(arena.offset == offset);
+  gc_release(&gc);
+}
+
+void test_quickening(void) {
+  Arena arena = {0};
+  static char arena_buffer[65536];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  Arena env_arena = {0};
+  char env_arena_buffer[8192];
+  arena_init(&env_arena, env_arena_buffer, sizeof(env_arena_buffer));
+
+  Environment env = {0};
+  environment_init(&env, &env_arena);
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
+  // names must compare by identity across the three programs
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+  char *inputs[] = {"let a = 2; let b = true;", "a * a; !b; b == b; !a",
+                    "let a = true; let b = 3;"};
+  Program *programs[3];
+  for (size_t i = 0; i < 3; ++i) {
+    Lexer lexer = {0};
+    lexer_init(&lexer, inputs[i]);
+    lexer.strings = &strings;
+    Parser parser = {0};
+    parser_init(&parser, &arena, &lexer);
+    programs[i] = parser_parse_program(&parser, &arena);
+  }
+  Program *program = programs[1];
+
+  const Node *expressions[4];
+  for (size_t i = 0; i < 4; ++i) {
+    NodeIndex statement = program->statements[i];
+    expressions[i] =
+        ast_node(&program->ast, ast_node(&program->ast, statement)->lhs);
+    assert(ast_node_quickening(expressions[i]) == QUICKENING_NONE);
+  }
+
+  Object evaluated = {0};
+  resolve_program(programs[0], &arena, &env_arena, &env);
+  eval_program(programs[0], &arena, &gc, &env, &evaluated);
+  resolve_program(program, &arena, &env_arena, &env);
+  // the second run takes the specialized paths
+  for (size_t run = 0; run < 2; ++run) {
+    eval_program(program, &arena, &gc, &env, &evaluated);
+    assert(object_type(&evaluated) == OBJECT_BOOLEAN);
+    assert(!object_boolean(&evaluated));
+    assert(ast_node_quickening(expressions[0]) == QUICKENING_INTEGER);
+    assert(ast_node_quickening(expressions[1]) == QUICKENING_BOOLEAN);
+    assert(ast_node_quickening(expressions[2]) == QUICKENING_BOOLEAN);
+    assert(ast_node_quickening(expressions[3]) == QUICKENING_INTEGER);
+  }
+
+  // the types change under the specialized nodes
+  resolve_program(programs[2], &arena, &env_arena, &env);
+  eval_program(programs[2], &arena, &gc, &env, &evaluated);
+  eval_program(program, &arena, &gc, &env, &evaluated);
+  assert(object_type(&evaluated) == OBJECT_ERROR);
+  assert(string_cmp(object_error_message(&evaluated),
+                    String("unknown operator: BOOLEAN * BOOLEAN")));
+  assert(ast_node_quickening(expressions[0]) == QUICKENING_GENERIC);
+  assert(ast_node_quickening(expressions[1]) == QUICKENING_BOOLEAN);
+  gc_release(&gc);
 }
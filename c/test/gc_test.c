@@ -0,0 +1,173 @@
+#include "../src/env.c"
+#include "../src/gc.c"
+#include "../src/mem.c"
+#include "../src/object.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void test_collect_unreachable(void);
+void test_threshold(void);
+void test_environment_rebinding(void);
+void test_environment_return(void);
+void test_copy_error(void);
+
+int main(void) {
+  test_collect_unreachable();
+  test_threshold();
+  test_environment_rebinding();
+  test_environment_return();
+  test_copy_error();
+}
+
+typedef struct TestRoots {
+  void *allocations[4];
+  size_t length;
+} TestRoots;
+
+void test_roots_mark(Gc *gc, void *context) {
+  (void)gc;
+  TestRoots *roots = context;
+  for (size_t i = 0; i < roots->length; ++i) {
+    gc_mark(roots->allocations[i]);
+  }
+}
+
+void test_collect_unreachable(void) {
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+  TestRoots roots = {0};
+  gc_add_root(&gc, test_roots_mark, &roots);
+
+  roots.allocations[roots.length++] = gc_alloc(&gc, 16);
+  gc_alloc(&gc, 32);
+  roots.allocations[roots.length++] = gc_alloc(&gc, 64);
+  assert(gc.stats.objects_allocated == 3);
+  assert(gc.stats.bytes_allocated == 112);
+
+  gc_collect(&gc);
+  assert(gc.stats.collections == 1);
+  assert(gc.stats.objects_allocated == 2);
+  assert(gc.stats.bytes_allocated == 80);
+  assert(gc.stats.objects_freed == 1);
+  assert(gc.stats.bytes_freed == 32);
+
+  // survivors are unmarked again, so they can be freed later
+  roots.length = 0;
+  gc_collect(&gc);
+  assert(gc.stats.objects_allocated == 0);
+  assert(gc.stats.bytes_freed == 112);
+
+  gc_release(&gc);
+}
+
+void test_threshold(void) {
+  Gc gc = {0};
+  gc_init(&gc, 256);
+
+  for (size_t i = 0; i < 100; ++i) {
+    gc_alloc(&gc, 64);
+  }
+
+  // nothing is rooted, so the heap never grows past the threshold
+  assert(gc.stats.collections > 0);
+  assert(gc.stats.bytes_allocated < 256);
+  assert(gc.next_collection == 256);
+
+  gc_release(&gc);
+}
+
+void test_environment_rebinding(void) {
+  Arena arena = {0};
+  char arena_buffer[8192];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  Gc gc = {0};
+  gc_init(&gc, 1024);
+  Environment env = {0};
+  environment_init(&env, &arena);
+  gc_add_root(&gc, environment_mark, &env);
+
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+  InternedString *a = string_table_intern(&strings, String("a"));
+  size_t slot = environment_define(&env, &arena, a);
+  for (int64_t i = 0; i < 1000; ++i) {
+    TempArenaMemory temp = temp_arena_memory_begin(&arena);
+    // out of range for a compact integer, so it has a heap payload there
+    Object value = {0};
+    integer_object(&value, &arena, INT64_MAX - i);
+    environment_set(&env, &gc, 0, slot, &value);
+    temp_arena_memory_end(temp);
+  }
+
+  assert(object_integer(environment_get(&env, 0, slot)) == INT64_MAX - 999);
+  assert(gc.stats.bytes_allocated < 1024);
+
+  gc_collect(&gc);
+  assert(object_integer(environment_get(&env, 0, slot)) == INT64_MAX - 999);
+
+  gc_release(&gc);
+}
+
+void test_environment_return(void) {
+  Arena arena = {0};
+  char arena_buffer[8192];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+  Environment env = {0};
+  environment_init(&env, &arena);
+  gc_add_root(&gc, environment_mark, &env);
+
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+  InternedString *a = string_table_intern(&strings, String("a"));
+  size_t slot = environment_define(&env, &arena, a);
+
+  // `let a = if (true) { return 5; };`, with the line's arena reset after
+  TempArenaMemory temp = temp_arena_memory_begin(&arena);
+  Object *five = arena_alloc(&arena, sizeof(Object));
+  integer_object(five, &arena, 5);
+  Object value = {0};
+  return_object(&value, &arena, five);
+  environment_set(&env, &gc, 0, slot, &value);
+  temp_arena_memory_end(temp);
+  integer_object(arena_alloc(&arena, sizeof(Object)), &arena, 0);
+
+  gc_collect(&gc);
+  Object *bound = environment_get(&env, 0, slot);
+  assert(object_type(bound) == OBJECT_RETURN);
+  assert(object_integer(object_return_value(bound)) == 5);
+
+  gc_release(&gc);
+}
+
+void test_copy_error(void) {
+  Arena arena = {0};
+  char arena_buffer[1024];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
+  Object error = {0};
+  error_object(&error, &arena, string_fmt(&arena, "error %d", 42));
+  Object copy = {0};
+  gc_object_copy(&gc, &copy, &error);
+
+  // the copy no longer depends on the arena
+  memset(arena_buffer, 0, sizeof(arena_buffer));
+  assert(object_type(&copy) == OBJECT_ERROR);
+  assert(string_cmp(object_error_message(&copy), String("error 42")));
+
+  // marking keeps the message alive without a root
+  size_t allocated = gc.stats.objects_allocated;
+  assert(allocated > 0);
+  gc_mark_object(&gc, &copy);
+  gc_collect(&gc);
+  assert(gc.stats.objects_allocated == allocated);
+
+  gc_release(&gc);
+}
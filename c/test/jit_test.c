@@ -0,0 +1,147 @@
+#include "../src/closure.c"
+#include "../src/jit.c"
+#include "differential.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+void test_same_as_eval(void);
+void test_bail(void);
+void test_perf_map(void);
+
+static Jit jit;
+
+int main(void) {
+  if (!jit_init(&jit)) {
+    printf("jit_test: no JIT on this platform\n");
+    return 0;
+  }
+  test_same_as_eval();
+  test_bail();
+  test_perf_map();
+  jit_release(&jit);
+}
+
+/**
+ * Runs `program` as closures with integer code compiled. `compiled`, if not
+ * NULL, says whether any of it is expected to become machine code.
+ */
+String run_jit(Arena *arena, Gc *gc, Program *program, void *compiled) {
+  Environment *env = resolve(arena, program);
+  jit_reset(&jit);
+  uint32_t before = jit.compiled;
+  const Closure *closures = closure_compile_program(arena, &jit, program);
+  if (compiled) {
+    assert((jit.compiled > before) == *(bool *)compiled);
+  }
+  Object result = {0};
+  closure_run_program(closures, arena, gc, env, &result);
+  return object_to_string(&result, arena);
+}
+
+void test_same_as_eval(void) {
+  struct {
+    char *input;
+    bool compiled; // whether any of it becomes machine code
+  } tests[] = {
+      {"5", false},
+      {"-10", true},
+      {"(5 + 10 * 2 + 15 / 3) * 2 + -10", true},
+      {"let a = 7; let b = 2; a / b + a * b - -a", true},
+      {"let a = -7; a / 2", true},
+      {"let big = 9223372036854775807; big - 1", true},
+      {"4611686018427387903 + 1", true},
+      {"let a = 3; a < 4 == true", true},
+      {"let a = 3; a > 4 != (a == 3)", true},
+      {"!5", true},
+      {"let a = 0; !!a", true},
+      {"!!(1 < 2)", true},
+      {"let a = 5; if (a > 2) { a * 2 } else { a - 2 }", true},
+      {"let a = 1; if (a > 2) { a * 2 } else { a - 2 }", true},
+      {"let a = 1; if (a) { 1; a + 1 } else { 0 }", true},
+      {"if (1 < 2) { true } else { false }", true},
+      // not compiled as a whole: a branch is missing or types differ
+      {"let a = 1; if (a > 2) { a }", true},
+      {"if (1 < 2) { true } else { 1 }", true},
+      // names that do not hold integers fall back on the closures
+      {"let a = true; a + 1", true},
+      {"let a = true; a == true", false},
+      {"let a = if (false) { 1 }; a + 1", true},
+      {"if (false) { let x = 1; }; x + 1", true},
+      {"let a = 6; let b = a / 2; let a = b * a; a", true},
+      {"true + false", false},
+      {"5 + true", false},
+      {"if (10 > 1) { return 2 * 5; }", true},
+  };
+
+  differential_test(run_jit, NULL);
+
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+  Gc gc = {0};
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+    differential_check(&arena, &gc, tests[i].input, run_jit,
+                       &tests[i].compiled);
+    arena_reset(&arena);
+  }
+
+  gc_release(&gc);
+  arena_release(&arena);
+}
+
+void test_bail(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+
+  Program *program = parse(&arena, "let a = 1; let b = 2; (a + b) / (b - a)");
+  resolve(&arena, program);
+  NodeIndex division =
+      ast_node(&program->ast, program->statements[2])->lhs;
+
+  jit_reset(&jit);
+  JitCode code = {0};
+  assert(jit_begin(&jit));
+  assert(jit_compile(&jit, &arena, &program->ast, division, &code));
+  jit_end(&jit);
+  assert(code.slots_len == 2 && !code.boolean);
+
+  int64_t arguments[2];
+  int64_t result = 0;
+  arguments[code.slots[0] == 0 ? 0 : 1] = 10; // a
+  arguments[code.slots[0] == 0 ? 1 : 0] = 4;  // b
+  assert(code.run(arguments, &result) == 0 && result == 14 / -6);
+
+  // a divisor of 0 or -1 is left to the evaluator
+  arguments[0] = arguments[1] = 3;
+  assert(code.run(arguments, &result) != 0);
+  arguments[code.slots[0] == 0 ? 0 : 1] = 4;
+  assert(code.run(arguments, &result) != 0);
+
+  arena_release(&arena);
+}
+
+void test_perf_map(void) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+  FILE *file = fopen(path, "r");
+  if (!file) {
+    return; // the map is best effort
+  }
+  char line[128];
+  uint32_t entries = 0;
+  while (fgets(line, sizeof(line), file)) {
+    unsigned long address;
+    size_t size;
+    char name[64];
+    assert(sscanf(line, "%lx %zx %63s", &address, &size, name) == 3);
+    assert(size > 0 && strncmp(name, "monkey_jit_", 11) == 0);
+    ++entries;
+  }
+  fclose(file);
+  assert(entries == jit.compiled);
+  remove(path);
+}
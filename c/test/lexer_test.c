@@ -5,10 +5,20 @@
 
 void test_token_type(void);
 void test_next_token(void);
+void test_interned_identifiers(void);
+void test_keywords(void);
+void test_illegal_and_eof(void);
+void test_tokenize(void);
+void test_chunked(void);
 
 int main(void) {
   test_token_type();
   test_next_token();
+  test_interned_identifiers();
+  test_keywords();
+  test_illegal_and_eof();
+  test_tokenize();
+  test_chunked();
 }
 
 void test_token_type(void) {
@@ -143,3 +153,157 @@ void test_next_token(void) {
                    t.literal.length) == 0);
   }
 }
+
+void test_interned_identifiers(void) {
+  Arena arena = {0};
+  char arena_buffer[4096];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+
+  Lexer l = {0};
+  lexer_init(&l, "let x = x + y; let");
+  l.strings = &strings;
+
+  Token let = lexer_next_token(&l);
+  Token x = lexer_next_token(&l);
+  lexer_next_token(&l);
+  Token x_again = lexer_next_token(&l);
+  lexer_next_token(&l);
+  Token y = lexer_next_token(&l);
+  lexer_next_token(&l);
+  Token let_again = lexer_next_token(&l);
+
+  assert(let.type == TOKEN_LET && let_again.type == TOKEN_LET);
+  assert(let.symbol == let_again.symbol);
+  assert(x.type == TOKEN_IDENT && x.symbol == x_again.symbol);
+  assert(y.type == TOKEN_IDENT && y.symbol != x.symbol);
+  assert(string_cmp(y.symbol->string, String("y")));
+}
+
+void test_keywords(void) {
+  struct {
+    String ident;
+    TokenType expected;
+  } test_cases[] = {
+      {String("fn"), TOKEN_FUNCTION},  {String("let"), TOKEN_LET},
+      {String("true"), TOKEN_TRUE},    {String("false"), TOKEN_FALSE},
+      {String("if"), TOKEN_IF},        {String("else"), TOKEN_ELSE},
+      {String("return"), TOKEN_RETURN}, {String("f"), TOKEN_IDENT},
+      {String("fun"), TOKEN_IDENT},    {String("lets"), TOKEN_IDENT},
+      {String("tree"), TOKEN_IDENT},   {String("iff"), TOKEN_IDENT},
+      {String("ease"), TOKEN_IDENT},   {String("rerun"), TOKEN_IDENT},
+      {String("retain"), TOKEN_IDENT}, {String("_"), TOKEN_IDENT},
+  };
+  for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); ++i) {
+    assert(token_type_from_ident(test_cases[i].ident) ==
+           test_cases[i].expected);
+  }
+}
+
+void test_illegal_and_eof(void) {
+  Lexer l = {0};
+  lexer_init(&l, "a ? \xc3\xa9");
+
+  Token t = lexer_next_token(&l);
+  assert(t.type == TOKEN_IDENT);
+  t = lexer_next_token(&l);
+  assert(t.type == TOKEN_ILLEGAL && t.literal.buffer[0] == '?');
+  t = lexer_next_token(&l);
+  assert(t.type == TOKEN_ILLEGAL);
+  t = lexer_next_token(&l);
+  assert(t.type == TOKEN_ILLEGAL);
+
+  // the lexer stays on the terminator
+  for (int i = 0; i < 3; ++i) {
+    assert(lexer_next_token(&l).type == TOKEN_EOF);
+  }
+}
+
+void test_tokenize(void) {
+  char *input = "let x = fn(a, b) { a + 12 }; x(3, 9223372036854775807) != "
+                "x ? let";
+  Arena arena = {0};
+  char arena_buffer[4096];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+
+  Lexer l = {0};
+  lexer_init(&l, input);
+  l.strings = &strings;
+  TokenStream stream = {0};
+  lexer_tokenize(&l, &arena, &stream);
+
+  // the stream holds exactly what the lexer produces token by token
+  Lexer expected = {0};
+  lexer_init(&expected, input);
+  expected.strings = &strings;
+  TokenCursor cursor = {0};
+  size_t count = 0;
+  while (true) {
+    Token want = lexer_next_token(&expected);
+    int64_t integer = 0;
+    Token got = token_stream_next(&stream, &cursor, &integer);
+    assert(got.type == want.type);
+    assert(string_cmp(got.literal, want.literal));
+    if (got.type == TOKEN_IDENT) {
+      assert(got.symbol == want.symbol);
+    }
+    if (got.type == TOKEN_INT) {
+      size_t end;
+      assert(integer == string_to_int64(got.literal, &end));
+    }
+    ++count;
+    if (got.type == TOKEN_EOF) {
+      break;
+    }
+  }
+  assert(stream.length == count);
+  assert(stream.integers_length == 3);
+  assert(stream.integers[2] == INT64_MAX);
+  assert(stream.symbols_length == 6);
+
+  // the cursor stays on EOF
+  int64_t integer = 0;
+  assert(token_stream_next(&stream, &cursor, &integer).type == TOKEN_EOF);
+  assert(cursor.token == stream.length - 1);
+}
+
+void test_chunked(void) {
+  char *input = "let ab = 12 != 345;\nab == !ab; fn(x) { x }";
+  size_t input_length = strlen(input);
+
+  // every split into two chunks lexes the same as the whole input
+  for (size_t split = 0; split <= input_length; ++split) {
+    Lexer whole = {0};
+    lexer_init(&whole, input);
+    Lexer l = {0};
+    lexer_init_chunked(&l);
+
+    bool fed_rest = false;
+    assert(lexer_feed(&l, input, split));
+    while (true) {
+      Token t = lexer_next_token(&l);
+      if (t.type == TOKEN_NEED_INPUT) {
+        assert(t.literal.length == 0);
+        if (!fed_rest) {
+          // the partial token is kept across the feed
+          l.mark = l.pos;
+          assert(lexer_feed(&l, input + split, input_length - split));
+          fed_rest = true;
+        } else {
+          lexer_finish(&l);
+        }
+        continue;
+      }
+      Token want = lexer_next_token(&whole);
+      assert(t.type == want.type);
+      assert(string_cmp(t.literal, want.literal));
+      if (t.type == TOKEN_EOF) {
+        break;
+      }
+    }
+    lexer_release(&l);
+  }
+}
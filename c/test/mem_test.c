@@ -0,0 +1,120 @@
+#include "../src/mem.c"
+#include <assert.h>
+#include <setjmp.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void test_fixed_arena_exhaustion(void);
+void test_virtual_arena_growth(void);
+void test_virtual_arena_exhaustion(void);
+void test_out_of_memory_handler(void);
+void test_resize_in_place(void);
+void test_temp_arena_memory(void);
+
+int main(void) {
+  test_fixed_arena_exhaustion();
+  test_virtual_arena_growth();
+  test_virtual_arena_exhaustion();
+  test_out_of_memory_handler();
+  test_resize_in_place();
+  test_temp_arena_memory();
+}
+
+void test_fixed_arena_exhaustion(void) {
+  Arena arena = {0};
+  char buffer[64];
+  arena_init(&arena, buffer, sizeof(buffer));
+
+  assert(arena_alloc(&arena, 32));
+  assert(!arena_alloc(&arena, 64));
+}
+
+void test_virtual_arena_growth(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, 64 * 1024 * 1024, false));
+  assert(arena.buffer_size == 0);
+
+  // spans several commit steps; every byte must be writable and zeroed
+  size_t size = 3 * ARENA_COMMIT_GRANULARITY + 1;
+  unsigned char *ptr = arena_alloc(&arena, size);
+  assert(ptr);
+  assert(arena.buffer_size >= size);
+  for (size_t i = 0; i < size; ++i) {
+    assert(ptr[i] == 0);
+    ptr[i] = 0xAB;
+  }
+
+  // committed pages are reused after a reset
+  size_t committed = arena.buffer_size;
+  arena_reset(&arena);
+  ptr = arena_alloc(&arena, size);
+  assert(ptr && ptr[size - 1] == 0);
+  assert(arena.buffer_size == committed);
+
+  arena_release(&arena);
+}
+
+void test_virtual_arena_exhaustion(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, 2 * ARENA_COMMIT_GRANULARITY, false));
+
+  assert(arena_alloc(&arena, ARENA_COMMIT_GRANULARITY));
+  assert(!arena_alloc(&arena, 2 * ARENA_COMMIT_GRANULARITY));
+
+  arena_release(&arena);
+}
+
+void test_out_of_memory_handler(void) {
+  Arena arena = {0};
+  char buffer[64];
+  arena_init(&arena, buffer, sizeof(buffer));
+
+  jmp_buf out_of_memory;
+  volatile int allocations = 0;
+  if (setjmp(out_of_memory)) {
+    assert(allocations == 4);
+    return;
+  }
+  arena.out_of_memory = &out_of_memory;
+
+  for (;;) {
+    arena_alloc(&arena, 16);
+    ++allocations;
+  }
+}
+
+void test_resize_in_place(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, 64 * 1024 * 1024, false));
+
+  unsigned char *ptr = arena_alloc(&arena, 16);
+  ptr[0] = 42;
+  size_t new_size = 2 * ARENA_COMMIT_GRANULARITY;
+  unsigned char *resized = arena_resize(&arena, ptr, 16, new_size);
+  assert(resized == ptr);
+  assert(resized[0] == 42);
+  assert(resized[new_size - 1] == 0);
+
+  arena_release(&arena);
+}
+
+void test_temp_arena_memory(void) {
+  Arena arena = {0};
+  char buffer[256];
+  arena_init(&arena, buffer, sizeof(buffer));
+
+  void *kept = arena_alloc(&arena, 16);
+  size_t offset = arena.offset;
+
+  TempArenaMemory outer = temp_arena_memory_begin(&arena);
+  arena_alloc(&arena, 32);
+  TempArenaMemory inner = temp_arena_memory_begin(&arena);
+  arena_alloc(&arena, 64);
+  temp_arena_memory_end(inner);
+  assert(arena.offset == inner.offset);
+  temp_arena_memory_end(outer);
+  assert(arena.offset == offset);
+
+  // the last allocation before the scope can still be resized in place
+  assert(arena_resize(&arena, kept, 16, 32) == kept);
+}
@@ -0,0 +1,79 @@
+#include "../src/optimize.c"
+#include "differential.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+void test_optimize(void);
+void test_same_as_eval(void);
+
+int main(void) {
+  test_optimize();
+  test_same_as_eval();
+}
+
+void test_optimize(void) {
+  struct {
+    char *input;
+    String expected;
+    OptimizeStats stats;
+  } test_cases[] = {
+      {"2 * (5 + 10)", String("30"), {.folded = 2}},
+      {"-(1 - 2) > 0 == !false", String("true"), {.folded = 5}},
+      {"!5; 1 == true; true + true",
+       String("false(1 == true)(true + true)"),
+       {.folded = 1}},
+      {"1 / 0; 10 / 3", String("(1 / 0)3"), {.folded = 1}},
+      {"let a = 6; let b = a * 7; b - a",
+       String("let a = 6;let b = 42;36"),
+       {.folded = 2, .propagated = 3}},
+      // bound twice, or first in a block
+      {"let a = 1; let a = a + 1; a", String("let a = 1;let a = (a + 1);a"),
+       {0}},
+      {"if (true) { let a = 1; }; let a = 2; a",
+       String("if true let a = 1;let a = 2;a"),
+       {0}},
+      {"a; let a = 1; a", String("alet a = 1;1"), {.propagated = 1}},
+      {"let a = 1; fn(x) { a + x }", String("let a = 1;fn(x) (a + x)"), {0}},
+      {"if (1 < 2) { 10 } else { 20 }", String("10"),
+       {.folded = 1, .pruned = 1}},
+      {"if (false) { 10 } else { let a = 1; a }",
+       String("if true let a = 1;a"),
+       {.pruned = 1}},
+      {"if (false) { 10 }", String("if false "), {.pruned = 1}},
+      {"if (true) { return 1; 2; 3 }", String("if true return 1;"),
+       {.dropped = 2}},
+      {"let c = 3; if (c > 2) { c * 2 } else { c }", String("let c = 3;6"),
+       {.folded = 2, .propagated = 3, .pruned = 1}},
+  };
+
+  Arena arena = {0};
+  static char arena_buffer[65536];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[i]); ++i) {
+    Program *program = parse(&arena, test_cases[i].input);
+    OptimizeStats stats = {0};
+    optimize_program(program, &arena, &stats);
+
+    String actual = program_to_string(program, &arena);
+    assert(string_cmp(actual, test_cases[i].expected));
+    assert(stats.folded == test_cases[i].stats.folded);
+    assert(stats.propagated == test_cases[i].stats.propagated);
+    assert(stats.pruned == test_cases[i].stats.pruned);
+    assert(stats.dropped == test_cases[i].stats.dropped);
+
+    arena_reset(&arena);
+  }
+}
+
+String run_optimized(Arena *arena, Gc *gc, Program *program, void *context) {
+  (void)context;
+  OptimizeStats stats = {0};
+  optimize_program(program, arena, &stats);
+  Object result = {0};
+  eval_program(program, arena, gc, resolve(arena, program), &result);
+  return object_to_string(&result, arena);
+}
+
+void test_same_as_eval(void) { differential_test(run_optimized, NULL); }
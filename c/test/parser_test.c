@@ -1,3 +1,6 @@
+// small enough that the test inputs are split between workers
+#define PARSE_PARALLEL_MIN_BYTES 64
+
 #include "../src/parser.c"
 #include <assert.h>
 #include <inttypes.h>
@@ -7,8 +10,8 @@
 #include <stdlib.h>
 
 void test_let_statements(void);
-void test_let_statement(Statement s, String name, ExpressionType type,
-                        String literal);
+void test_let_statement(Arena *arena, const Ast *ast, NodeIndex index,
+                        String name, NodeType type, String literal);
 void test_return_statements(void);
 void test_identifier_expression(void);
 void test_integer_literal_expression(void);
@@ -21,6 +24,11 @@ void test_if_else_expression(void);
 void test_function_literal_parsing(void);
 void test_function_parameter_parsing(void);
 void test_call_expression_parsing(void);
+void test_token_stream_parsing(void);
+void test_chunked_parsing(void);
+void test_deep_nesting(void);
+void test_parallel_parsing(void);
+void test_incremental_parsing(void);
 
 int main(void) {
   test_let_statements();
@@ -36,6 +44,11 @@ int main(void) {
   test_function_literal_parsing();
   test_function_parameter_parsing();
   test_call_expression_parsing();
+  test_token_stream_parsing();
+  test_chunked_parsing();
+  test_deep_nesting();
+  test_parallel_parsing();
+  test_incremental_parsing();
 }
 
 void check_parser_errors(const Parser *p) {
@@ -50,6 +63,37 @@ void check_parser_errors(const Parser *p) {
   exit(EXIT_FAILURE);
 }
 
+/** The expression of the expression statement at `index` in `program`. */
+const Node *expression_at(Program *program, size_t index) {
+  const Node *s = ast_node(&program->ast, program_statement_at(program, index));
+  assert(s->type == NODE_EXPRESSION_STATEMENT);
+  return ast_node(&program->ast, s->lhs);
+}
+
+/** The expression of the single expression statement in `block`. */
+const Node *block_expression(const Ast *ast, NodeIndex block) {
+  assert(ast_node(ast, block)->type == NODE_BLOCK);
+  uint32_t length;
+  const NodeIndex *statements =
+      ast_list(ast, ast_node(ast, block)->lhs, &length);
+  assert(length == 1);
+  const Node *s = ast_node(ast, statements[0]);
+  assert(s->type == NODE_EXPRESSION_STATEMENT);
+  return ast_node(ast, s->lhs);
+}
+
+void test_identifier(const Ast *ast, NodeIndex index, String name) {
+  const Node *node = ast_node(ast, index);
+  assert(node->type == NODE_IDENTIFIER);
+  assert(string_cmp(ast_identifier_name(ast, node), name));
+}
+
+void test_integer_literal(const Ast *ast, NodeIndex index, int64_t value) {
+  const Node *node = ast_node(ast, index);
+  assert(node->type == NODE_INTEGER);
+  assert(ast_integer_value(node) == value);
+}
+
 void test_let_statements(void) {
   char *input = "let x = 5;\n"
                 "let y = 10;\n"
@@ -71,42 +115,41 @@ void test_let_statements(void) {
 
   typedef struct {
     String expected_identifier;
-    ExpressionType expected_type;
+    NodeType expected_type;
     String expected_literal;
   } TestCase;
   TestCase tests[] = {
-      {String("x"), EXPRESSION_INTEGER, String("5")},
-      {String("y"), EXPRESSION_INTEGER, String("10")},
-      {String("foobar"), EXPRESSION_IDENTIFIER, String("y")},
+      {String("x"), NODE_INTEGER, String("5")},
+      {String("y"), NODE_INTEGER, String("10")},
+      {String("foobar"), NODE_IDENTIFIER, String("y")},
   };
   for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
-    test_let_statement(*program_statement_at(program, i),
+    test_let_statement(&arena, &program->ast, program_statement_at(program, i),
                        tests[i].expected_identifier, tests[i].expected_type,
                        tests[i].expected_literal);
   }
 }
 
-void test_let_statement(Statement s, String name, ExpressionType type,
-                        String literal) {
-  assert(string_cmp(statement_token_literal(s), String("let")));
-  assert(s.type == STATEMENT_LET);
+void test_let_statement(Arena *arena, const Ast *ast, NodeIndex index,
+                        String name, NodeType type, String literal) {
+  const Node *let = ast_node(ast, index);
+  assert(let->type == NODE_LET);
+  test_identifier(ast, let->lhs, name);
 
-  LetStatement let = s.data.let_statement;
-  assert(string_cmp(let.name->value, name));
-  assert(string_cmp(let.name->token.literal, name));
-
-  assert(let.value->type == type);
+  const Node *value = ast_node(ast, let->rhs);
+  assert(value->type == type);
   switch (type) {
-  case EXPRESSION_IDENTIFIER:
-    assert(string_cmp(let.value->data.identifier.value, literal));
+  case NODE_IDENTIFIER:
+    test_identifier(ast, let->rhs, literal);
     break;
-  case EXPRESSION_INTEGER:
-    assert(string_cmp(let.value->data.integer.token.literal, literal));
+  case NODE_INTEGER:
+    assert(string_cmp(string_fmt(arena, "%" PRId64, ast_integer_value(value)),
+                      literal));
     break;
   default: {
-    String exp_str = expression_type_strings[type];
-    fprintf(stderr, "unhandled expression type %.*s\n", (int)exp_str.length,
-            exp_str.buffer);
+    String type_str = node_type_strings[type];
+    fprintf(stderr, "unhandled node type %.*s\n", (int)type_str.length,
+            type_str.buffer);
   } break;
   }
 }
@@ -130,13 +173,11 @@ void test_return_statements(void) {
   check_parser_errors(&parser);
   assert(program->statements_len == 3);
 
-  StatementIterator iter = {0};
-  statement_iterator_init(&iter, program->first_chunk);
-  Statement *s;
-  while ((s = statement_iterator_next(&iter))) {
-    assert(s->type == STATEMENT_RETURN);
-    assert(
-        string_cmp(s->data.return_statement.token.literal, String("return")));
+  int64_t values[] = {5, 10, 838383};
+  for (size_t i = 0; i < program->statements_len; ++i) {
+    const Node *node = ast_node(&program->ast, program->statements[i]);
+    assert(node->type == NODE_RETURN);
+    test_integer_literal(&program->ast, node->lhs, values[i]);
   }
 }
 
@@ -156,15 +197,10 @@ void test_identifier_expression(void) {
   check_parser_errors(&parser);
 
   assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement expression_statement =
-      program->first_chunk->statements[0].data.expression_statement;
-
-  assert(expression_statement.expression->type == EXPRESSION_IDENTIFIER);
-  Identifier identifier = expression_statement.expression->data.identifier;
-  assert(string_cmp(identifier.value, String("foobar")));
-  assert(string_cmp(identifier.token.literal, String("foobar")));
+  const Node *identifier = expression_at(program, 0);
+  assert(identifier->type == NODE_IDENTIFIER);
+  assert(string_cmp(ast_identifier_name(&program->ast, identifier),
+                    String("foobar")));
 }
 
 void test_integer_literal_expression(void) {
@@ -183,24 +219,9 @@ void test_integer_literal_expression(void) {
   check_parser_errors(&parser);
 
   assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement expression_statement =
-      program->first_chunk->statements[0].data.expression_statement;
-  assert(expression_statement.expression->type == EXPRESSION_INTEGER);
-
-  IntegerLiteral integer_literal =
-      expression_statement.expression->data.integer;
-  assert(integer_literal.value == 5);
-  assert(string_cmp(integer_literal.token.literal, String("5")));
-}
-
-void test_integer_literal(Arena *arena, Expression *expression, int64_t value) {
-  assert(expression->type == EXPRESSION_INTEGER);
-  IntegerLiteral integer_literal = expression->data.integer;
-  assert(integer_literal.value == value);
-  assert(string_cmp(integer_literal.token.literal,
-                    string_fmt(arena, "%" PRId64, value)));
+  const Node *integer_literal = expression_at(program, 0);
+  assert(integer_literal->type == NODE_INTEGER);
+  assert(ast_integer_value(integer_literal) == 5);
 }
 
 void test_parsing_prefix_expressions(void) {
@@ -234,16 +255,12 @@ void test_parsing_prefix_expressions(void) {
     check_parser_errors(&parser);
 
     assert(program->statements_len == 1);
-    assert(program->current_chunk->statements[0].type == STATEMENT_EXPRESSION);
-    ExpressionStatement expression_statement =
-        program->current_chunk->statements[0].data.expression_statement;
+    const Node *prefix_expression = expression_at(program, 0);
+    assert(prefix_expression->type == NODE_PREFIX);
 
-    assert(expression_statement.expression->type == EXPRESSION_PREFIX);
-    PrefixExpression prefix_expression =
-        expression_statement.expression->data.prefix;
-
-    assert(string_cmp(prefix_expression.op, test_cases[i].op));
-    test_integer_literal(&arena, prefix_expression.right,
+    assert(string_cmp(operator_strings[prefix_expression->operator],
+                      test_cases[i].op));
+    test_integer_literal(&program->ast, prefix_expression->lhs,
                          test_cases[i].integer_value);
 
     arena_reset(&arena);
@@ -320,18 +337,14 @@ void test_parsing_infix_expressions(void) {
     check_parser_errors(&parser);
 
     assert(program->statements_len == 1);
-    assert(program->current_chunk->statements[0].type == STATEMENT_EXPRESSION);
-    ExpressionStatement expression_statement =
-        program->current_chunk->statements[0].data.expression_statement;
-
-    assert(expression_statement.expression->type == EXPRESSION_INFIX);
-    InfixExpression infix_expression =
-        expression_statement.expression->data.infix;
+    const Node *infix_expression = expression_at(program, 0);
+    assert(infix_expression->type == NODE_INFIX);
 
-    test_integer_literal(&arena, infix_expression.left,
+    test_integer_literal(&program->ast, infix_expression->lhs,
                          test_cases[i].left_value);
-    assert(string_cmp(infix_expression.op, test_cases[i].op));
-    test_integer_literal(&arena, infix_expression.right,
+    assert(string_cmp(operator_strings[infix_expression->operator],
+                      test_cases[i].op));
+    test_integer_literal(&program->ast, infix_expression->rhs,
                          test_cases[i].right_value);
 
     arena_reset(&arena);
@@ -412,6 +425,10 @@ void test_operator_precedence_parsing(void) {
           "add(a + b + c * d / f + g)",
           String("add((((a + b) + ((c * d) / f)) + g))"),
       },
+      {
+          "f(1, 2, 3, 4, 5, 6, 7, 8, g(9, fn(x) { x; 10 }), 11)",
+          String("f(1, 2, 3, 4, 5, 6, 7, 8, g(9, fn(x) x10), 11)"),
+      },
   };
 
   Arena arena = {0};
@@ -433,38 +450,13 @@ void test_operator_precedence_parsing(void) {
   }
 }
 
-void test_boolean_expression_true(void) {
+void test_boolean_expression_value(char *input, bool value) {
   Arena arena = {0};
   char arena_buffer[8192];
   arena_init(&arena, &arena_buffer, 8192);
 
   Lexer lexer = {0};
-  lexer_init(&lexer, "true;");
-  Parser parser = {0};
-  parser_init(&parser, &arena, &lexer);
-
-  Program *program = parser_parse_program(&parser, &arena);
-  check_parser_errors(&parser);
-
-  assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement expression_statement =
-      program->first_chunk->statements[0].data.expression_statement;
-  assert(expression_statement.expression->type == EXPRESSION_BOOLEAN);
-
-  Boolean boolean = expression_statement.expression->data.boolean;
-  assert(boolean.value == true);
-  assert(string_cmp(boolean.token.literal, String("true")));
-}
-
-void test_boolean_expression_false(void) {
-  Arena arena = {0};
-  char arena_buffer[8192];
-  arena_init(&arena, &arena_buffer, 8192);
-
-  Lexer lexer = {0};
-  lexer_init(&lexer, "false;");
+  lexer_init(&lexer, input);
   Parser parser = {0};
   parser_init(&parser, &arena, &lexer);
 
@@ -472,26 +464,20 @@ void test_boolean_expression_false(void) {
   check_parser_errors(&parser);
 
   assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement expression_statement =
-      program->first_chunk->statements[0].data.expression_statement;
-  assert(expression_statement.expression->type == EXPRESSION_BOOLEAN);
-
-  Boolean boolean = expression_statement.expression->data.boolean;
-  assert(boolean.value == false);
-  assert(string_cmp(boolean.token.literal, String("false")));
+  const Node *boolean = expression_at(program, 0);
+  assert(boolean->type == NODE_BOOLEAN);
+  assert(boolean->lhs == value);
 }
 
 void test_boolean_expression(void) {
-  test_boolean_expression_true();
-  test_boolean_expression_false();
+  test_boolean_expression_value("true;", true);
+  test_boolean_expression_value("false;", false);
 }
 
 void test_if_expression(void) {
   Arena arena = {0};
-  char arena_buffer[8192];
-  arena_init(&arena, &arena_buffer, 8192);
+  char arena_buffer[16384];
+  arena_init(&arena, &arena_buffer, 16384);
 
   Lexer lexer = {0};
   lexer_init(&lexer, "if (x < y) { x }");
@@ -502,36 +488,20 @@ void test_if_expression(void) {
   check_parser_errors(&parser);
 
   assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement expression_statement =
-      program->first_chunk->statements[0].data.expression_statement;
-  assert(expression_statement.expression->type == EXPRESSION_IF);
-
-  IfExpression ie = expression_statement.expression->data.if_expression;
-  assert(ie.condition->type == EXPRESSION_INFIX);
-
-  InfixExpression condition = ie.condition->data.infix;
-  assert(condition.left->type == EXPRESSION_IDENTIFIER);
-  assert(string_cmp(condition.left->data.identifier.value, String("x")));
+  const Ast *ast = &program->ast;
+  const Node *ie = expression_at(program, 0);
+  assert(ie->type == NODE_IF);
 
-  assert(string_cmp(condition.op, String("<")));
+  const Node *condition = ast_node(ast, ie->lhs);
+  assert(condition->type == NODE_INFIX);
+  test_identifier(ast, condition->lhs, String("x"));
+  assert(condition->operator == OPERATOR_LT);
+  test_identifier(ast, condition->rhs, String("y"));
 
-  assert(condition.right->type == EXPRESSION_IDENTIFIER);
-  assert(string_cmp(condition.right->data.identifier.value, String("y")));
+  const Node *consequence = block_expression(ast, ast_if_consequence(ast, ie));
+  assert(string_cmp(ast_identifier_name(ast, consequence), String("x")));
 
-  assert(ie.consequence->statements_len == 1);
-
-  Statement consequence = ie.consequence->current_chunk->statements[0];
-  assert(consequence.type == STATEMENT_EXPRESSION);
-
-  assert(consequence.data.expression_statement.expression->type ==
-         EXPRESSION_IDENTIFIER);
-  assert(string_cmp(
-      consequence.data.expression_statement.expression->data.identifier.value,
-      String("x")));
-
-  assert(ie.alternative == NULL);
+  assert(ast_if_alternative(ast, ie) == NODE_NONE);
 }
 
 void test_if_else_expression(void) {
@@ -549,43 +519,23 @@ void test_if_else_expression(void) {
   check_parser_errors(&parser);
 
   assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement expression_statement =
-      program->first_chunk->statements[0].data.expression_statement;
-  assert(expression_statement.expression->type == EXPRESSION_IF);
-
-  IfExpression ie = expression_statement.expression->data.if_expression;
-  assert(ie.condition->type == EXPRESSION_INFIX);
-
-  InfixExpression condition = ie.condition->data.infix;
-  assert(condition.left->type == EXPRESSION_IDENTIFIER);
-  assert(string_cmp(condition.left->data.identifier.value, String("x")));
-
-  assert(string_cmp(condition.op, String("<")));
-
-  assert(condition.right->type == EXPRESSION_IDENTIFIER);
-  assert(string_cmp(condition.right->data.identifier.value, String("y")));
-
-  assert(ie.consequence->statements_len == 1);
-  Statement consequence = ie.consequence->current_chunk->statements[0];
-  assert(consequence.type == STATEMENT_EXPRESSION);
-
-  assert(consequence.data.expression_statement.expression->type ==
-         EXPRESSION_IDENTIFIER);
-  assert(string_cmp(
-      consequence.data.expression_statement.expression->data.identifier.value,
-      String("x")));
-
-  assert(ie.alternative->statements_len == 1);
-  Statement alternative = ie.alternative->current_chunk->statements[0];
-  assert(alternative.type == STATEMENT_EXPRESSION);
-
-  assert(alternative.data.expression_statement.expression->type ==
-         EXPRESSION_IDENTIFIER);
-  assert(string_cmp(
-      alternative.data.expression_statement.expression->data.identifier.value,
-      String("y")));
+  const Ast *ast = &program->ast;
+  const Node *ie = expression_at(program, 0);
+  assert(ie->type == NODE_IF);
+
+  const Node *condition = ast_node(ast, ie->lhs);
+  assert(condition->type == NODE_INFIX);
+  test_identifier(ast, condition->lhs, String("x"));
+  assert(condition->operator == OPERATOR_LT);
+  test_identifier(ast, condition->rhs, String("y"));
+
+  const Node *consequence = block_expression(ast, ast_if_consequence(ast, ie));
+  assert(consequence->type == NODE_IDENTIFIER);
+  assert(string_cmp(ast_identifier_name(ast, consequence), String("x")));
+
+  const Node *alternative = block_expression(ast, ast_if_alternative(ast, ie));
+  assert(alternative->type == NODE_IDENTIFIER);
+  assert(string_cmp(ast_identifier_name(ast, alternative), String("y")));
 }
 
 void test_function_literal_parsing(void) {
@@ -602,45 +552,28 @@ void test_function_literal_parsing(void) {
   check_parser_errors(&parser);
 
   assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement statement =
-      program->first_chunk->statements[0].data.expression_statement;
-  assert(statement.expression->type == EXPRESSION_FUNCTION);
-
-  FunctionLiteral fn = statement.expression->data.function;
-  assert(fn.parameters.length == 2);
-
-  assert(string_cmp(fn.parameters.items[0].value, String("x")));
-  assert(string_cmp(fn.parameters.items[1].value, String("y")));
-
-  BlockStatement *body = fn.body;
-  assert(body->statements_len == 1);
-  assert(body->current_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement body_expression =
-      body->current_chunk->statements[0].data.expression_statement;
-  assert(body_expression.expression->type == EXPRESSION_INFIX);
-
-  InfixExpression body_infix_expression =
-      body_expression.expression->data.infix;
-
-  assert(body_infix_expression.left->type == EXPRESSION_IDENTIFIER);
-  assert(string_cmp(body_infix_expression.left->data.identifier.value,
-                    String("x")));
-
-  assert(string_cmp(body_infix_expression.op, String("+")));
-
-  assert(body_infix_expression.right->type == EXPRESSION_IDENTIFIER);
-  assert(string_cmp(body_infix_expression.right->data.identifier.value,
-                    String("y")));
+  const Ast *ast = &program->ast;
+  const Node *fn = expression_at(program, 0);
+  assert(fn->type == NODE_FUNCTION);
+
+  uint32_t length;
+  const NodeIndex *parameters = ast_list(ast, fn->rhs, &length);
+  assert(length == 2);
+  test_identifier(ast, parameters[0], String("x"));
+  test_identifier(ast, parameters[1], String("y"));
+
+  const Node *body_infix_expression = block_expression(ast, fn->lhs);
+  assert(body_infix_expression->type == NODE_INFIX);
+  test_identifier(ast, body_infix_expression->lhs, String("x"));
+  assert(body_infix_expression->operator == OPERATOR_PLUS);
+  test_identifier(ast, body_infix_expression->rhs, String("y"));
 }
 
 void test_function_parameter_parsing(void) {
   struct {
     char *input;
     size_t expected_length;
-    String expected[8];
+    String expected[10];
   } test_cases[] = {
       {
           .input = "fn() {};",
@@ -657,11 +590,18 @@ void test_function_parameter_parsing(void) {
           .expected_length = 3,
           .expected = {String("x"), String("y"), String("z")},
       },
+      {
+          .input = "fn(a, b, c, d, e, f, g, h, i, j) {};",
+          .expected_length = 10,
+          .expected = {String("a"), String("b"), String("c"), String("d"),
+                       String("e"), String("f"), String("g"), String("h"),
+                       String("i"), String("j")},
+      },
   };
 
   Arena arena = {0};
-  char arena_buffer[8192];
-  arena_init(&arena, &arena_buffer, 8192);
+  char arena_buffer[16384];
+  arena_init(&arena, &arena_buffer, 16384);
 
   for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); ++i) {
     Lexer lexer = {0};
@@ -671,14 +611,14 @@ void test_function_parameter_parsing(void) {
     Program *program = parser_parse_program(&parser, &arena);
     check_parser_errors(&parser);
 
-    ExpressionStatement statement =
-        program->current_chunk->statements[0].data.expression_statement;
-    FunctionLiteral fn = statement.expression->data.function;
+    const Node *fn = expression_at(program, 0);
+    assert(fn->type == NODE_FUNCTION);
 
-    assert(fn.parameters.length == test_cases[i].expected_length);
-    for (size_t j = 0; j < fn.parameters.length; ++j) {
-      assert(
-          string_cmp(fn.parameters.items[j].value, test_cases[i].expected[j]));
+    uint32_t length;
+    const NodeIndex *parameters = ast_list(&program->ast, fn->rhs, &length);
+    assert(length == test_cases[i].expected_length);
+    for (size_t j = 0; j < length; ++j) {
+      test_identifier(&program->ast, parameters[j], test_cases[i].expected[j]);
     }
 
     arena_reset(&arena);
@@ -700,45 +640,346 @@ void test_call_expression_parsing(void) {
   check_parser_errors(&parser);
 
   assert(program->statements_len == 1);
-  assert(program->first_chunk->statements[0].type == STATEMENT_EXPRESSION);
-
-  ExpressionStatement statement =
-      program->current_chunk->statements[0].data.expression_statement;
-  assert(statement.expression->type == EXPRESSION_CALL);
-
-  CallExpression call = statement.expression->data.call;
+  const Ast *ast = &program->ast;
+  const Node *call = expression_at(program, 0);
+  assert(call->type == NODE_CALL);
 
   // function ident
-  assert(call.function->type == EXPRESSION_IDENTIFIER);
-  assert(string_cmp(call.function->data.identifier.value, String("add")));
+  test_identifier(ast, call->lhs, String("add"));
 
   // args
-  assert(call.arguments.length == 3);
+  uint32_t length;
+  const NodeIndex *arguments = ast_list(ast, call->rhs, &length);
+  assert(length == 3);
+
+  test_integer_literal(ast, arguments[0], 1);
+
+  const Node *arg_1 = ast_node(ast, arguments[1]);
+  assert(arg_1->type == NODE_INFIX);
+  test_integer_literal(ast, arg_1->lhs, 2);
+  assert(arg_1->operator == OPERATOR_ASTERISK);
+  test_integer_literal(ast, arg_1->rhs, 3);
+
+  const Node *arg_2 = ast_node(ast, arguments[2]);
+  assert(arg_2->type == NODE_INFIX);
+  test_integer_literal(ast, arg_2->lhs, 4);
+  assert(arg_2->operator == OPERATOR_PLUS);
+  test_integer_literal(ast, arg_2->rhs, 5);
+}
+
+// TODO: test_call_expression_parameter_parsing
+
+void test_token_stream_parsing(void) {
+  char *inputs[] = {
+      "let x = 5; let y = x * (2 + -3); return y;",
+      "let add = fn(a, b) { a + b }; add(1, add(2, 3)) == 6;",
+      "if (1 < 2) { true } else { !false }",
+      "let big = 9223372036854775807; big",
+      "let = 5; x +",
+  };
+
+  Arena arena = {0};
+  static char arena_buffer[65536];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
 
-  assert(call.arguments.items[0].type == EXPRESSION_INTEGER);
-  assert(call.arguments.items[0].data.integer.value == 1);
+  for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); ++i) {
+    arena_reset(&arena);
+    Lexer lexer = {0};
+    lexer_init(&lexer, inputs[i]);
+    Parser parser = {0};
+    parser_init(&parser, &arena, &lexer);
+    Program *program = parser_parse_program(&parser, &arena);
 
-  assert(call.arguments.items[1].type == EXPRESSION_INFIX);
-  InfixExpression arg_1 = call.arguments.items[1].data.infix;
+    Lexer stream_lexer = {0};
+    lexer_init(&stream_lexer, inputs[i]);
+    Parser stream_parser = {0};
+    parser_init_token_stream(&stream_parser, &arena, &stream_lexer);
+    Program *stream_program = parser_parse_program(&stream_parser, &arena);
 
-  assert(arg_1.left->type == EXPRESSION_INTEGER);
-  assert(arg_1.left->data.integer.value == 2);
+    assert(parser.errors.length == stream_parser.errors.length);
+    for (size_t j = 0; j < parser.errors.length; ++j) {
+      assert(string_cmp(parser.errors.errors[j].message,
+                        stream_parser.errors.errors[j].message));
+    }
+    if (parser.errors.length > 0) {
+      continue; // programs with errors have holes that can't be printed
+    }
+    assert(string_cmp(program_to_string(program, &arena),
+                      program_to_string(stream_program, &arena)));
+  }
+}
 
-  assert(string_cmp(arg_1.op, String("*")));
+void test_chunked_parsing(void) {
+  char *input = "let x = 5; let y = x * (2 + -3)\nreturn y; "
+                "if (x < y) { x } else { y } x + 10";
+  size_t input_length = strlen(input);
 
-  assert(arg_1.right->type == EXPRESSION_INTEGER);
-  assert(arg_1.right->data.integer.value == 3);
+  Arena arena = {0};
+  static char arena_buffer[65536];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
 
-  assert(call.arguments.items[2].type == EXPRESSION_INFIX);
-  InfixExpression arg_2 = call.arguments.items[2].data.infix;
+  Lexer lexer = {0};
+  lexer_init(&lexer, input);
+  Parser parser = {0};
+  parser_init(&parser, &arena, &lexer);
+  Program *program = parser_parse_program(&parser, &arena);
+  check_parser_errors(&parser);
+  String expected = program_to_string(program, &arena);
+
+  // feed the input `chunk_size` bytes at a time, as a pipe would
+  for (size_t chunk_size = 1; chunk_size <= input_length; ++chunk_size) {
+    TempArenaMemory temp = temp_arena_memory_begin(&arena);
+    StringTable strings = {0};
+    string_table_init(&strings, &arena);
+    Lexer chunked = {0};
+    lexer_init_chunked(&chunked);
+    chunked.strings = &strings;
+    Parser stream = {0};
+    parser_init(&stream, &arena, &chunked);
+
+    // identifiers are interned, so the tree does not point into the
+    // lexer's buffer and can be printed after all the input is gone
+    Program *streamed = program_create(&arena);
+
+    size_t fed = 0;
+    while (true) {
+      ParseStatus status = parser_next_statement(&stream, streamed);
+      if (status == PARSE_OK) {
+        continue;
+      }
+      if (status == PARSE_EOF) {
+        break;
+      }
+      size_t length = input_length - fed;
+      if (length == 0) {
+        lexer_finish(&chunked);
+        continue;
+      }
+      length = length < chunk_size ? length : chunk_size;
+      assert(lexer_feed(&chunked, input + fed, length));
+      fed += length;
+    }
+    check_parser_errors(&stream);
+    assert(string_cmp(program_to_string(streamed, &arena), expected));
 
-  assert(arg_2.left->type == EXPRESSION_INTEGER);
-  assert(arg_2.left->data.integer.value == 4);
+    lexer_release(&chunked);
+    temp_arena_memory_end(temp);
+  }
+}
 
-  assert(string_cmp(arg_2.op, String("+")));
+void test_deep_nesting(void) {
+  // far deeper than the C stack would allow if each level were a call
+  const size_t depth = 1000000;
+  char *input = malloc(4 * depth + 2);
+  assert(input);
+  size_t length = 0;
+  for (size_t i = 0; i < depth; ++i) {
+    input[length++] = '(';
+    input[length++] = '-';
+  }
+  input[length++] = '1';
+  for (size_t i = 0; i < depth; ++i) {
+    input[length++] = ')';
+  }
+  input[length] = '\0';
+
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, input);
+  Parser parser = {0};
+  parser_init(&parser, &arena, &lexer);
+  Program *program = parser_parse_program(&parser, &arena);
+  check_parser_errors(&parser);
+  assert(program->statements_len == 1);
+
+  // (-(-(...(-1)...)))
+  const Ast *ast = &program->ast;
+  const Node *node = expression_at(program, 0);
+  for (size_t i = 0; i < depth; ++i) {
+    assert(node->type == NODE_PREFIX && node->operator == OPERATOR_MINUS);
+    node = ast_node(ast, node->lhs);
+  }
+  test_integer_literal(ast, (NodeIndex)(node - ast->nodes), 1);
 
-  assert(arg_2.right->type == EXPRESSION_INTEGER);
-  assert(arg_2.right->data.integer.value == 5);
+  arena_release(&arena);
+  free(input);
 }
 
-// TODO: test_call_expression_parameter_parsing
+void test_parallel_parsing(void) {
+  char *statements[] = {
+      "let f = fn(a, b) { let c = a; c * b; };\n",
+      "f(1, (2 + 3));\n",
+      "if (x < y) { x; } else { y; };\n",
+      "let x = -5 * (f(x, 2) + 1);\n",
+      "return fn() { true };\n",
+      "let = 5;\n",
+  };
+  size_t statements_len = sizeof(statements) / sizeof(statements[0]);
+
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+
+  Writer writer = {0};
+  writer_init_arena(&writer, &arena);
+  for (size_t i = 0; i < 600; ++i) {
+    writer_write_string(&writer, String(statements[i % statements_len]));
+  }
+  String input = writer_string(&writer);
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, input.buffer);
+  Parser parser = {0};
+  parser_init(&parser, &arena, &lexer);
+  Program *program = parser_parse_program(&parser, &arena);
+
+  Lexer parallel_lexer = {0};
+  lexer_init(&parallel_lexer, input.buffer);
+  Parser parallel_parser = {0};
+  parser_init(&parallel_parser, &arena, &parallel_lexer);
+  Program *parallel =
+      parser_parse_program_parallel(&parallel_parser, &arena, 7);
+  assert(parallel_parser.current_token.type == TOKEN_EOF);
+
+  assert(parser.errors.length == 200); // two for each `let = 5;`
+  assert(parallel_parser.errors.length == parser.errors.length);
+  for (size_t i = 0; i < parser.errors.length; ++i) {
+    assert(string_cmp(parser.errors.errors[i].message,
+                      parallel_parser.errors.errors[i].message));
+  }
+
+  assert(parallel->statements_len == program->statements_len);
+  assert(parallel->ast.nodes_len == program->ast.nodes_len);
+  for (size_t i = 0; i < program->statements_len; ++i) {
+    assert(string_cmp(
+        ast_to_string(&program->ast, program->statements[i], &arena),
+        ast_to_string(&parallel->ast, parallel->statements[i], &arena)));
+  }
+
+  // names are interned in the parser's own table, as if parsed sequentially
+  for (uint32_t i = 0; i < parallel->ast.symbols_len; ++i) {
+    const InternedString *symbol = parallel->ast.symbols[i];
+    assert(symbol ==
+           string_table_intern(parallel_lexer.strings, symbol->string));
+  }
+
+  arena_release(&arena);
+}
+
+/** Asserts that `program` is what parsing the parser's input afresh gives. */
+void test_same_as_full_parse(Arena *arena, const Parser *parser,
+                             const Program *program) {
+  Lexer lexer = {0};
+  lexer_init(&lexer, parser->lexer->buffer.buffer);
+  lexer.strings = parser->lexer->strings;
+  Parser full_parser = {0};
+  parser_init(&full_parser, arena, &lexer);
+  Program *full = parser_parse_program(&full_parser, arena);
+
+  assert(parser->errors.length == full_parser.errors.length);
+  for (size_t i = 0; i < parser->errors.length; ++i) {
+    assert(string_cmp(parser->errors.errors[i].message,
+                      full_parser.errors.errors[i].message));
+  }
+
+  assert(program->spans_len == full->spans_len);
+  for (uint32_t i = 0; i < full->spans_len; ++i) {
+    SourceSpan expected = full->spans[i], actual = program->spans[i];
+    assert(actual.start == expected.start && actual.end == expected.end &&
+           actual.depends == expected.depends &&
+           actual.errors == expected.errors);
+    assert((actual.statement == NODE_NONE) ==
+           (expected.statement == NODE_NONE));
+    // statements with errors have holes that can't be printed
+    if (expected.statement != NODE_NONE && expected.errors == 0) {
+      assert(string_cmp(ast_to_string(&program->ast, actual.statement, arena),
+                        ast_to_string(&full->ast, expected.statement, arena)));
+    }
+  }
+
+  assert(program->statements_len == full->statements_len);
+  for (uint32_t i = 0, j = 0; i < program->spans_len; ++i) {
+    if (program->spans[i].statement != NODE_NONE) {
+      assert(program->statements[j++] == program->spans[i].statement);
+    }
+  }
+}
+
+void test_incremental_parsing(void) {
+  char *statements[] = {
+      "let f = fn(a, b) { a * b };\n",
+      "f(1, (2 + 3));\n",
+      "if (x < y) { x } else { y }\n",
+      "let x = -5 * (f(x, 2) + 1);\n",
+      "x\n",
+      "return !true;\n",
+  };
+  size_t statements_len = sizeof(statements) / sizeof(statements[0]);
+  // pieces of statements, so edits also break and join them
+  char *insertions[] = {
+      "", " ", "x", ";", "=", "+ 1", "(", ")", "{", "}", "let y = ",
+      "fn(a) { a }", "if (x) {", "!", "12", "\n", "let = 5;",
+  };
+  size_t insertions_len = sizeof(insertions) / sizeof(insertions[0]);
+
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+
+  static char source[65536];
+  size_t length = 0;
+  for (size_t i = 0; i < 60; ++i) {
+    String statement = String(statements[i % statements_len]);
+    memcpy(source + length, statement.buffer, statement.length);
+    length += statement.length;
+  }
+  source[length] = '\0';
+
+  Lexer lexer = {0};
+  lexer_init(&lexer, source);
+  Parser parser = {0};
+  parser_init(&parser, &arena, &lexer);
+  Program *program = parser_parse_program(&parser, &arena);
+  check_parser_errors(&parser);
+
+  // an edit inside one statement parses just that statement again
+  char *target = strstr(source + length / 2, "(2 + 3)");
+  assert(target);
+  TextEdit edit = {.offset = (size_t)(target - source) + 1,
+                   .removed = 1,
+                   .inserted = String("7")};
+  *(target + 1) = '7';
+  uint32_t nodes_len = program->ast.nodes_len;
+  parser_reparse(&parser, program, source, edit);
+  assert(program->ast.nodes_len - nodes_len < 10);
+  test_same_as_full_parse(&arena, &parser, program);
+
+  uint64_t random = 42;
+  for (size_t i = 0; i < 2000; ++i) {
+    random = random * 6364136223846793005u + 1442695040888963407u;
+    size_t offset = (size_t)(random >> 33) % (length + 1);
+    size_t removed = (size_t)(random >> 20) % 6;
+    removed = removed < length - offset ? removed : length - offset;
+    String inserted =
+        String(insertions[(size_t)(random >> 40) % insertions_len]);
+    if (length - removed + inserted.length >= sizeof(source)) {
+      continue;
+    }
+
+    memmove(source + offset + inserted.length, source + offset + removed,
+            length - offset - removed + 1);
+    memcpy(source + offset, inserted.buffer, inserted.length);
+    length = length - removed + inserted.length;
+
+    parser_reparse(&parser, program, source,
+                   (TextEdit){.offset = offset,
+                              .removed = removed,
+                              .inserted = inserted});
+    assert(parser.current_token.type == TOKEN_EOF);
+    TempArenaMemory temp = temp_arena_memory_begin(&arena);
+    test_same_as_full_parse(&arena, &parser, program);
+    temp_arena_memory_end(temp);
+  }
+
+  arena_release(&arena);
+}
@@ -0,0 +1,180 @@
+#include "../src/env.c"
+#include "../src/lexer.c"
+#include "../src/mem.c"
+#include "../src/parser.c"
+#include "../src/resolver.c"
+#include <assert.h>
+#include <stddef.h>
+
+void test_resolve_globals(void);
+void test_resolve_function_scopes(void);
+void test_unresolved_identifier(void);
+void test_many_globals(void);
+
+int main(void) {
+  test_resolve_globals();
+  test_resolve_function_scopes();
+  test_unresolved_identifier();
+  test_many_globals();
+}
+
+Program *parse(Arena *arena, StringTable *strings, char *input) {
+  Lexer lexer = {0};
+  lexer_init(&lexer, input);
+  lexer.strings = strings;
+  Parser parser = {0};
+  parser_init(&parser, arena, &lexer);
+
+  Program *program = parser_parse_program(&parser, arena);
+  assert(parser.errors.length == 0);
+  return program;
+}
+
+const Node *expression_statement_identifier(Program *program, size_t index) {
+  Ast *ast = &program->ast;
+  const Node *s = ast_node(ast, program_statement_at(program, index));
+  assert(s->type == NODE_EXPRESSION_STATEMENT);
+  const Node *e = ast_node(ast, s->lhs);
+  assert(e->type == NODE_IDENTIFIER);
+  return e;
+}
+
+/** The slot assigned to the name declared by the `let` at `statement`. */
+uint32_t let_slot(const Ast *ast, NodeIndex statement) {
+  const Node *let = ast_node(ast, statement);
+  assert(let->type == NODE_LET);
+  const Node *name = ast_node(ast, let->lhs);
+  assert(name->resolved && name->depth == 0);
+  return name->rhs;
+}
+
+void test_resolve_globals(void) {
+  Arena arena = {0};
+  char arena_buffer[16 * 1024];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+  Environment env = {0};
+  environment_init(&env, &arena);
+
+  Program *program =
+      parse(&arena, &strings, "let a = 1; let b = 2; let a = 3; b; a;");
+  resolve_program(program, &arena, &arena, &env);
+
+  assert(env.count == 2);
+  assert(let_slot(&program->ast, program_statement_at(program, 0)) == 0);
+  assert(let_slot(&program->ast, program_statement_at(program, 1)) == 1);
+  assert(let_slot(&program->ast, program_statement_at(program, 2)) == 0);
+
+  const Node *b = expression_statement_identifier(program, 3);
+  assert(b->resolved && b->depth == 0 && b->rhs == 1);
+  const Node *a = expression_statement_identifier(program, 4);
+  assert(a->resolved && a->depth == 0 && a->rhs == 0);
+
+  // later programs see bindings declared by earlier ones
+  Program *next = parse(&arena, &strings, "b;");
+  resolve_program(next, &arena, &arena, &env);
+  b = expression_statement_identifier(next, 0);
+  assert(b->resolved && b->depth == 0 && b->rhs == 1);
+}
+
+void test_resolve_function_scopes(void) {
+  Arena arena = {0};
+  char arena_buffer[16 * 1024];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+  Environment env = {0};
+  environment_init(&env, &arena);
+
+  Program *program =
+      parse(&arena, &strings, "let g = 1; fn(x, y) { let z = x; y + g + z; };");
+  resolve_program(program, &arena, &arena, &env);
+
+  Ast *ast = &program->ast;
+  const Node *fn_statement = ast_node(ast, program_statement_at(program, 1));
+  const Node *fn = ast_node(ast, fn_statement->lhs);
+  uint32_t length;
+  const NodeIndex *params = ast_list(ast, fn->rhs, &length);
+  assert(length == 2);
+  assert(ast_node(ast, params[0])->rhs == 0);
+  assert(ast_node(ast, params[1])->rhs == 1);
+
+  assert(let_slot(ast, program_statement_at(program, 0)) == 0);
+
+  const NodeIndex *body = ast_list(ast, ast_node(ast, fn->lhs)->lhs, &length);
+  assert(length == 2);
+  assert(let_slot(ast, body[0]) == 2);
+  const Node *x = ast_node(ast, ast_node(ast, body[0])->rhs);
+  assert(x->resolved && x->depth == 0 && x->rhs == 0);
+
+  // (y + g) + z
+  const Node *outer = ast_node(ast, ast_node(ast, body[1])->lhs);
+  const Node *inner = ast_node(ast, outer->lhs);
+  const Node *y = ast_node(ast, inner->lhs);
+  const Node *g = ast_node(ast, inner->rhs);
+  const Node *z = ast_node(ast, outer->rhs);
+  assert(y->resolved && y->depth == 0 && y->rhs == 1);
+  assert(g->resolved && g->depth == 1 && g->rhs == 0);
+  assert(z->resolved && z->depth == 0 && z->rhs == 2);
+
+  // function scopes do not leak into the global environment
+  assert(env.count == 1);
+}
+
+void test_unresolved_identifier(void) {
+  Arena arena = {0};
+  char arena_buffer[8192];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+  Environment env = {0};
+  environment_init(&env, &arena);
+
+  Program *program = parse(&arena, &strings, "foobar;");
+  resolve_program(program, &arena, &arena, &env);
+
+  const Node *foobar = expression_statement_identifier(program, 0);
+  assert(!foobar->resolved);
+}
+
+void test_many_globals(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+
+  StringTable strings = {0};
+  string_table_init(&strings, &arena);
+  Environment env = {0};
+  environment_init(&env, &arena);
+  Environment inner = {0};
+  environment_init_enclosed(&inner, &arena, &env);
+
+  // enough to grow the table several times
+  enum { NAMES = 5000 };
+  static const InternedString *names[NAMES];
+  for (size_t i = 0; i < NAMES; ++i) {
+    char name[8] = {0};
+    for (size_t n = i, j = 0; j == 0 || n > 0; n /= 26, ++j) {
+      name[j] = (char)('a' + n % 26);
+    }
+    names[i] = string_table_intern(&strings, String(name));
+    assert(environment_define(&env, &arena, names[i]) == i);
+  }
+  assert(env.count == NAMES);
+  assert(environment_define(&env, &arena, names[42]) == 42);
+
+  for (size_t i = 0; i < NAMES; ++i) {
+    size_t depth, slot;
+    assert(environment_resolve(&inner, names[i], &depth, &slot));
+    assert(depth == 1 && slot == i);
+  }
+  size_t depth, slot;
+  assert(!environment_resolve(
+      &inner, string_table_intern(&strings, String("unknown")), &depth,
+      &slot));
+
+  arena_release(&arena);
+}
@@ -0,0 +1,159 @@
+#include "../src/mem.c"
+#include "../src/string.c"
+#include <assert.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+void test_intern(void);
+void test_intern_grows(void);
+void test_arena_writer(void);
+void test_file_writer(void);
+void test_span(void);
+
+int main(void) {
+  test_intern();
+  test_intern_grows();
+  test_arena_writer();
+  test_file_writer();
+  test_span();
+}
+
+void test_intern(void) {
+  Arena arena = {0};
+  char arena_buffer[4096];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  StringTable table = {0};
+  string_table_init(&table, &arena);
+
+  char source[] = "foo bar foo";
+  InternedString *foo = string_table_intern(
+      &table, string_slice((String){source, sizeof(source) - 1}, 0, 3));
+  InternedString *bar = string_table_intern(&table, String("bar"));
+  InternedString *foo_again = string_table_intern(&table, String("foo"));
+
+  assert(foo == foo_again);
+  assert(foo != bar);
+  assert(table.count == 2);
+  assert(foo->hash == string_hash(String("foo")));
+  assert(foo->kind == 0);
+
+  // the table keeps its own copy of the text
+  source[0] = 'g';
+  assert(string_cmp(foo->string, String("foo")));
+  assert(string_table_intern(&table, String("foo")) == foo);
+}
+
+void test_intern_grows(void) {
+  Arena arena = {0};
+  static char arena_buffer[256 * 1024];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  StringTable table = {0};
+  string_table_init(&table, &arena);
+
+  InternedString *interned[1000];
+  for (int i = 0; i < 1000; ++i) {
+    interned[i] = string_table_intern(&table, string_fmt(&arena, "x%d", i));
+  }
+
+  assert(table.count == 1000);
+  assert(table.capacity * 3 >= table.count * 4);
+  for (int i = 0; i < 1000; ++i) {
+    String name = string_fmt(&arena, "x%d", i);
+    assert(string_table_intern(&table, name) == interned[i]);
+  }
+}
+
+void test_arena_writer(void) {
+  Arena arena = {0};
+  char arena_buffer[4096];
+  arena_init(&arena, arena_buffer, sizeof(arena_buffer));
+
+  Writer writer = {0};
+  writer_init_arena(&writer, &arena);
+  char *start = writer.buffer;
+
+  writer_write_string(&writer, String("let x = "));
+  writer_write_int64(&writer, INT64_MIN);
+  writer_write_char(&writer, ';');
+  writer_write_int64(&writer, 0);
+  writer_fmt(&writer, " %04d %s", 7, "a fairly long string to force growth");
+
+  assert(string_cmp(writer_string(&writer),
+                    String("let x = -9223372036854775808;0 0007 "
+                           "a fairly long string to force growth")));
+  // nothing else was allocated, so the buffer grew in place
+  assert(writer.buffer == start);
+  assert(writer.capacity > 64);
+}
+
+void test_file_writer(void) {
+  FILE *file = tmpfile();
+  assert(file);
+
+  char buffer[32];
+  Writer writer = {0};
+  writer_init_file(&writer, file, buffer, sizeof(buffer));
+
+  writer_write_string(&writer, String("0123456789"));
+  writer_write_string(&writer, String("0123456789"));
+  writer_fmt(&writer, "%s", "a format result longer than the whole buffer");
+  writer_write_int64(&writer, -42);
+  writer_write_string(&writer,
+                      String("a string that is longer than the buffer"));
+  writer_flush(&writer);
+
+  char expected[] = "01234567890123456789"
+                    "a format result longer than the whole buffer"
+                    "-42"
+                    "a string that is longer than the buffer";
+  char actual[sizeof(expected)] = {0};
+  rewind(file);
+  assert(fread(actual, 1, sizeof(actual), file) == sizeof(expected) - 1);
+  assert(memcmp(actual, expected, sizeof(expected) - 1) == 0);
+  fclose(file);
+}
+
+void check_span(const char *buffer, CharSpan span) {
+  size_t expected = string_span_scalar(buffer, span);
+  assert(string_span(buffer, span) == expected);
+#ifdef STRING_SIMD_X86
+  assert(string_span_sse2(buffer, span) == expected);
+  if (string_has_avx2()) {
+    assert(string_span_avx2(buffer, span) == expected);
+  }
+#endif
+}
+
+void test_span(void) {
+  // every run length up to past two AVX2 blocks, at every alignment, ended
+  // by each kind of character that can follow a run
+  const char fill[] = {' ', 'x', '7'};
+  const CharSpan spans[] = {CHAR_SPAN_WHITESPACE, CHAR_SPAN_LETTERS,
+                            CHAR_SPAN_DIGITS};
+  const char ends[] = {0, ';', '\x80', '@', '[', '`', '{', '/', ':'};
+
+  // offsets are counted from a 32-byte boundary inside `storage`
+  char storage[128 + 31];
+  char *buffer = storage + (32 - (uintptr_t)storage % 32) % 32;
+  for (size_t s = 0; s < 3; ++s) {
+    for (size_t offset = 0; offset < 32; ++offset) {
+      for (size_t length = 0; length < 70; ++length) {
+        for (size_t e = 0; e < sizeof(ends); ++e) {
+          memset(buffer, 0, 128);
+          memset(buffer + offset, fill[s], length);
+          buffer[offset + length] = ends[e];
+          check_span(buffer + offset, spans[s]);
+        }
+      }
+    }
+  }
+
+  char mixed[] = "\t\r\n  abc_XYZ_0123456789abcdefghijklmnopqrstuvwxyz9";
+  assert(string_span(mixed, CHAR_SPAN_WHITESPACE) == 5);
+  assert(string_span(mixed + 5, CHAR_SPAN_LETTERS) == 8);
+  assert(string_span(mixed + 13, CHAR_SPAN_DIGITS) == 10);
+  assert(string_span(mixed + 23, CHAR_SPAN_LETTERS) == 26);
+}
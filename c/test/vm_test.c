@@ -0,0 +1,276 @@
+#include "../src/compiler.c"
+#include "../src/lexer.c"
+#include "../src/mem.c"
+#include "../src/object.c"
+#include "../src/parser.c"
+#include "../src/vm.c"
+#include "differential.c"
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void test_integer_arithmetic(void);
+void test_boolean_expressions(void);
+void test_conditionals(void);
+void test_return_statements(void);
+void test_global_let_statements(void);
+void test_error_handling(void);
+void test_program_too_large(void);
+void test_same_as_eval(void);
+
+static Globals globals;
+static VM vm;
+static Gc gc;
+
+int main(void) {
+  test_integer_arithmetic();
+  test_boolean_expressions();
+  test_conditionals();
+  test_return_statements();
+  test_global_let_statements();
+  test_error_handling();
+  test_program_too_large();
+  test_same_as_eval();
+}
+
+typedef struct VMTestCase {
+  char *input;
+  ObjectType expected_type;
+  int64_t expected_value;
+} VMTestCase;
+
+/**
+ * Compiles and runs `program` on `vm`. Returns false, with the compiler's
+ * error in `result`, if it does not compile.
+ */
+bool run_vm_program(Arena *arena, Gc *gc, Program *program, Object *result) {
+  SymbolTable symbols = {0};
+  symbol_table_init(&symbols, arena);
+  Compiler compiler = {0};
+  compiler_init(&compiler, arena, &symbols);
+  if (!compiler_compile_program(&compiler, program)) {
+    error_object(result, arena, compiler.error);
+    return false;
+  }
+
+  // each input gets a fresh symbol table, so slots are reused
+  memset(&globals, 0, sizeof(globals));
+  vm_init(&vm, arena, gc, compiler_bytecode(&compiler), &globals);
+  vm_run(&vm, result);
+  return true;
+}
+
+void run_vm(Arena *arena, char *input, Object *result) {
+  assert(run_vm_program(arena, &gc, parse(arena, input), result));
+}
+
+void run_vm_tests(VMTestCase *test_cases, size_t len) {
+  Arena arena = {0};
+  const size_t arena_size = 16 * 1024;
+  char arena_buffer[arena_size];
+  arena_init(&arena, arena_buffer, arena_size);
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
+  for (size_t i = 0; i < len; ++i) {
+    Object result = {0};
+    run_vm(&arena, test_cases[i].input, &result);
+
+    if (object_type(&result) != test_cases[i].expected_type) {
+      fprintf(stderr, "wrong object type for %s\n", test_cases[i].input);
+      exit(EXIT_FAILURE);
+    }
+
+    switch (test_cases[i].expected_type) {
+    case OBJECT_INTEGER:
+      assert(object_integer(&result) == test_cases[i].expected_value);
+      break;
+    case OBJECT_BOOLEAN:
+      assert(object_boolean(&result) ==
+             (bool)test_cases[i].expected_value);
+      break;
+    default:
+      break;
+    }
+
+    arena_reset(&arena);
+  }
+
+  gc_release(&gc);
+}
+
+void test_integer_arithmetic(void) {
+  VMTestCase test_cases[] = {
+      {"1", OBJECT_INTEGER, 1},
+      {"1 + 2", OBJECT_INTEGER, 3},
+      {"1 - 2", OBJECT_INTEGER, -1},
+      {"4 / 2", OBJECT_INTEGER, 2},
+      {"50 / 2 * 2 + 10 - 5", OBJECT_INTEGER, 55},
+      {"5 * (2 + 10)", OBJECT_INTEGER, 60},
+      {"-5", OBJECT_INTEGER, -5},
+      {"-50 + 100 + -50", OBJECT_INTEGER, 0},
+      {"(5 + 10 * 2 + 15 / 3) * 2 + -10", OBJECT_INTEGER, 50},
+  };
+  run_vm_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_boolean_expressions(void) {
+  VMTestCase test_cases[] = {
+      {"true", OBJECT_BOOLEAN, true},
+      {"false", OBJECT_BOOLEAN, false},
+      {"1 < 2", OBJECT_BOOLEAN, true},
+      {"1 > 2", OBJECT_BOOLEAN, false},
+      {"1 == 1", OBJECT_BOOLEAN, true},
+      {"1 != 2", OBJECT_BOOLEAN, true},
+      {"true == false", OBJECT_BOOLEAN, false},
+      {"(1 < 2) == true", OBJECT_BOOLEAN, true},
+      {"!true", OBJECT_BOOLEAN, false},
+      {"!5", OBJECT_BOOLEAN, false},
+      {"!!5", OBJECT_BOOLEAN, true},
+      {"!(if (false) { 5; })", OBJECT_BOOLEAN, true},
+  };
+  run_vm_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_conditionals(void) {
+  VMTestCase test_cases[] = {
+      {"if (true) { 10 }", OBJECT_INTEGER, 10},
+      {"if (true) { 10 } else { 20 }", OBJECT_INTEGER, 10},
+      {"if (false) { 10 } else { 20 } ", OBJECT_INTEGER, 20},
+      {"if (1) { 10 }", OBJECT_INTEGER, 10},
+      {"if (1 < 2) { 10 }", OBJECT_INTEGER, 10},
+      {"if (1 > 2) { 10 }", OBJECT_NULL, 0},
+      {"if (false) { 10 }", OBJECT_NULL, 0},
+      {"if ((if (false) { 10 })) { 10 } else { 20 }", OBJECT_INTEGER, 20},
+  };
+  run_vm_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_return_statements(void) {
+  VMTestCase test_cases[] = {
+      {"return 10;", OBJECT_INTEGER, 10},
+      {"9; return 2 * 5; 9;", OBJECT_INTEGER, 10},
+      {"if (10 > 1) {\n"
+       "  if (10 > 1) {\n"
+       "    return 10;\n"
+       "  }\n"
+       "\n"
+       "  return 1;\n"
+       "}\n",
+       OBJECT_INTEGER, 10},
+  };
+  run_vm_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_global_let_statements(void) {
+  VMTestCase test_cases[] = {
+      {"let one = 1; one", OBJECT_INTEGER, 1},
+      {"let one = 1; let two = 2; one + two", OBJECT_INTEGER, 3},
+      {"let one = 1; let two = one + one; one + two", OBJECT_INTEGER, 3},
+      {"let big = 9223372036854775807; big - 1", OBJECT_INTEGER,
+       9223372036854775806},
+      // a `let` produces the value it binds, as in eval
+      {"let a = 1; let a = 2;", OBJECT_INTEGER, 2},
+      {"if (true) { let a = 3; }", OBJECT_INTEGER, 3},
+  };
+  run_vm_tests(test_cases, sizeof(test_cases) / sizeof(test_cases[0]));
+}
+
+void test_error_handling(void) {
+  struct {
+    char *input;
+    String expected_message;
+  } test_cases[] = {
+      {"5 + true;", String("type mismatch: INTEGER + BOOLEAN")},
+      {"5 + true; 5;", String("type mismatch: INTEGER + BOOLEAN")},
+      {"-true", String("unknown operator: -BOOLEAN")},
+      {"true + false;", String("unknown operator: BOOLEAN + BOOLEAN")},
+      {"if (10 > 1) { true + false; }",
+       String("unknown operator: BOOLEAN + BOOLEAN")},
+      // operands are evaluated and reported left to right
+      {"1 < true", String("type mismatch: INTEGER < BOOLEAN")},
+      {"true < false", String("unknown operator: BOOLEAN < BOOLEAN")},
+      {"if (false) { let x = 1; }; x", String("identifier not found: x")},
+  };
+
+  Arena arena = {0};
+  const size_t arena_size = 16 * 1024;
+  char arena_buffer[arena_size];
+  arena_init(&arena, arena_buffer, arena_size);
+  gc_init(&gc, GC_DEFAULT_THRESHOLD);
+
+  for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); ++i) {
+    Object result = {0};
+    run_vm(&arena, test_cases[i].input, &result);
+
+    assert(object_type(&result) == OBJECT_ERROR);
+    assert(string_cmp(object_error_message(&result),
+                      test_cases[i].expected_message));
+
+    arena_reset(&arena);
+  }
+
+  gc_release(&gc);
+}
+
+/**
+ * Compiles `count` copies of `statement`, or the statements `0;` to
+ * `count - 1;` if it is NULL, between `prefix` and `suffix`. Returns false,
+ * with the error in `*error`, if that fails.
+ */
+bool compile_repeated(Arena *arena, const char *prefix, const char *statement,
+                      size_t count, const char *suffix, String *error) {
+  Writer input = {0};
+  writer_init_arena(&input, arena);
+  writer_fmt(&input, "%s", prefix);
+  for (size_t i = 0; i < count; ++i) {
+    if (statement) {
+      writer_fmt(&input, "%s", statement);
+    } else {
+      writer_fmt(&input, "%d; ", (int)i);
+    }
+  }
+  writer_fmt(&input, "%s", suffix);
+  writer_write_char(&input, '\0');
+
+  Program *program = parse(arena, input.buffer);
+
+  SymbolTable symbols = {0};
+  symbol_table_init(&symbols, arena);
+  Compiler compiler = {0};
+  compiler_init(&compiler, arena, &symbols);
+  bool compiled = compiler_compile_program(&compiler, program);
+  *error = compiler.error;
+  return compiled;
+}
+
+void test_program_too_large(void) {
+  Arena arena = {0};
+  assert(arena_init_virtual(&arena, (size_t)1 << 30, false));
+  String error = {0};
+
+  // operands are 16 bits, so neither a jump past 65535 bytes of code nor a
+  // 65537th constant can be encoded
+  assert(compile_repeated(&arena, "if (1 > 2) { ", "1; ", 5000, "}; 42",
+                          &error));
+  assert(!compile_repeated(&arena, "if (1 > 2) { ", "1; ", 25000, "}; 42",
+                           &error));
+  assert(string_cmp(error,
+                    String("program too large: jump target out of range")));
+  assert(!compile_repeated(&arena, "", NULL, 70000, "7", &error));
+  assert(string_cmp(error, String("program too large: too many constants")));
+
+  arena_release(&arena);
+}
+
+String run_vm_to_string(Arena *arena, Gc *gc, Program *program,
+                        void *context) {
+  (void)context;
+  Object result = {0};
+  run_vm_program(arena, gc, program, &result);
+  return object_to_string(&result, arena);
+}
+
+void test_same_as_eval(void) { differential_test(run_vm_to_string, NULL); }